@@ -0,0 +1,121 @@
+#include "epiphany/bench/catalog.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace epiphany {
+namespace bench {
+
+namespace {
+
+const char *const kBrands[] = {"Apple",    "Samsung", "Xiaomi", "Huawei",
+                               "Sony",     "Dell",    "Lenovo", "ASUS",
+                               "LG",       "Panasonic", "Logitech", "Bose",
+                               "JBL",      "TP-Link", "Dyson"};
+const char *const kCategories[] = {"手机", "笔记本电脑", "平板电脑", "耳机",
+                                   "智能手表", "相机", "电视", "冰箱",
+                                   "洗衣机", "空调", "键盘", "鼠标",
+                                   "显示器", "音箱", "路由器"};
+const char *const kAdjectives[] = {"Pro", "Max",  "Ultra", "Plus",
+                                   "Lite", "Air", "Mini",  "Elite",
+                                   "Premium", "Standard"};
+
+template <typename T, size_t N> size_t Size(const T (&)[N]) { return N; }
+
+// Rows written per transaction while building a catalog.
+constexpr size_t kBuildChunk = 100000;
+
+} // namespace
+
+std::vector<database::Database::Item> SyntheticItems(size_t begin,
+                                                     size_t end) {
+  std::vector<database::Database::Item> items;
+  items.reserve(end > begin ? end - begin : 0);
+  for (size_t i = begin; i < end; ++i) {
+    database::Database::Item item;
+    item.id = static_cast<int64_t>(i);
+    item.title = std::string(kBrands[i % Size(kBrands)]) + " " +
+                 kCategories[(i / 7) % Size(kCategories)] + " " +
+                 kAdjectives[(i / 3) % Size(kAdjectives)] + " " +
+                 std::to_string(i);
+    // A cheap deterministic spread over 500 .. 10499.
+    item.price = 500.0 + static_cast<double>((i * 2654435761u) % 10000);
+    item.image_url = "https://images.unsplash.com/photo-" +
+                     std::to_string(1500000000000 + i % 997) +
+                     "?w=300&h=300&fit=crop";
+    item.brand = kBrands[i % Size(kBrands)];
+    item.category = kCategories[(i / 7) % Size(kCategories)];
+    items.push_back(std::move(item));
+  }
+  return items;
+}
+
+std::string SqliteCatalog(size_t rows) {
+  const char *tmp = std::getenv("TMPDIR");
+  // The v2 catalogs have brands and categories; older files are ignored.
+  std::string path = std::string(tmp && *tmp ? tmp : "/tmp") +
+                     "/epiphany_bench_v2_" + std::to_string(rows) + ".db";
+  {
+    auto db = database::Database::Create("sqlite:" + path);
+    if (db && db->Count(query::Node()) == static_cast<int>(rows))
+      return path;
+  }
+  std::remove(path.c_str());
+  std::cerr << "Building " << rows << "-row catalog at " << path << std::endl;
+  auto db = database::Database::Create("sqlite:" + path);
+  if (!db ||
+      !db->Execute("CREATE TABLE brands (id INTEGER PRIMARY KEY, "
+                    "name TEXT NOT NULL UNIQUE);"
+                    "CREATE TABLE categories (id INTEGER PRIMARY KEY, "
+                    "name TEXT NOT NULL UNIQUE);"
+                    "CREATE TABLE items (id INTEGER PRIMARY KEY, "
+                    "title TEXT, price REAL, image_url TEXT, "
+                    "brand_id INTEGER REFERENCES brands(id), "
+                    "category_id INTEGER REFERENCES categories(id));")) {
+    std::cerr << "Cannot create " << path << std::endl;
+    std::exit(1);
+  }
+  db->Execute("CREATE UNIQUE INDEX idx_items_title ON items(title);");
+  database::Database::BulkOptions options;
+  options.batch_size = kBuildChunk;
+  options.fast = true;
+  for (size_t begin = 1; begin <= rows; begin += kBuildChunk) {
+    database::Database::BulkResult result;
+    size_t end = std::min(rows + 1, begin + kBuildChunk);
+    if (!db->BulkInsert(SyntheticItems(begin, end), options, &result)) {
+      std::cerr << "Cannot fill " << path << std::endl;
+      std::exit(1);
+    }
+  }
+  return path;
+}
+
+std::shared_ptr<database::Database> OpenCatalog(const std::string &backend,
+                                                size_t rows) {
+  static std::mutex mu;
+  static std::map<std::pair<std::string, size_t>,
+                  std::shared_ptr<database::Database>>
+      open;
+  std::lock_guard<std::mutex> lock(mu);
+  auto &db = open[{backend, rows}];
+  if (!db) {
+    db = database::Database::Create(backend + ":" + SqliteCatalog(rows));
+    if (!db) {
+      std::cerr << "Cannot open " << backend << " catalog" << std::endl;
+      std::exit(1);
+    }
+    // The same indexes the server creates at startup.
+    for (const auto &migration : db->SchemaMigrations())
+      db->Execute(migration);
+    // Index backends build lazily; keep that out of the timings.
+    db->Count(query::Node());
+  }
+  return db;
+}
+
+} // namespace bench
+} // namespace epiphany
@@ -0,0 +1,28 @@
+#pragma once
+#include "epiphany/database/database.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace epiphany {
+namespace bench {
+
+// Items numbered [begin, end), shaped like the demo catalog main.cc seeds:
+// "<brand> <category> <adjective> <n>" with a price and an image URL. The
+// same n always yields the same item.
+std::vector<database::Database::Item> SyntheticItems(size_t begin, size_t end);
+
+// Path of a SQLite catalog holding SyntheticItems(1, rows + 1), built on
+// first use under $TMPDIR (default /tmp) and reused by later runs, so the
+// suite needs nothing but a writable temp directory. Large catalogs take
+// a while to build the first time.
+std::string SqliteCatalog(size_t rows);
+
+// backend ("sqlite" or "index") opened over SqliteCatalog(rows), shared by
+// every benchmark in the process that asks for the same pair.
+std::shared_ptr<database::Database> OpenCatalog(const std::string &backend,
+                                                size_t rows);
+
+} // namespace bench
+} // namespace epiphany
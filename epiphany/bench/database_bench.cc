@@ -0,0 +1,141 @@
+// Search, SearchRanked, SearchByPrice, Count, PriceStats and facets over
+// synthetic catalogs of 1K to 10M rows.
+// SQLite runs the full range; the in-memory index stops at 1M, where its
+// build already dominates the run. EP_BENCH_MAX_ROWS caps both.
+#include "epiphany/bench/catalog.h"
+#include "epiphany/query/query.h"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <string>
+
+namespace epiphany {
+namespace bench {
+namespace {
+
+int64_t MaxRows(int64_t limit) {
+  const char *cap = std::getenv("EP_BENCH_MAX_ROWS");
+  if (cap && *cap)
+    return std::min<int64_t>(limit, std::atoll(cap));
+  return limit;
+}
+
+void SqliteSizes(benchmark::internal::Benchmark *b) {
+  for (int64_t rows = 1000; rows <= MaxRows(10000000); rows *= 10)
+    b->Arg(rows);
+}
+
+void IndexSizes(benchmark::internal::Benchmark *b) {
+  for (int64_t rows = 1000; rows <= MaxRows(1000000); rows *= 10)
+    b->Arg(rows);
+}
+
+// Queries of decreasing selectivity: one adjective in ten, a brand and
+// category pair, and a negation.
+constexpr const char *kCommon = "Pro";
+constexpr const char *kNarrow = "Dyson 相机";
+constexpr const char *kNegated = "Pro -Apple";
+// Ranked by which terms each title holds rather than by length alone.
+constexpr const char *kEither = "Pro OR Dyson";
+
+void BM_Search(benchmark::State &state, const char *backend, const char *q) {
+  auto db = OpenCatalog(backend, static_cast<size_t>(state.range(0)));
+  query::Node query = query::Parse(q);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db->Search(query, 10, 0));
+}
+
+void BM_SearchDeepPage(benchmark::State &state, const char *backend,
+                       const char *q) {
+  auto db = OpenCatalog(backend, static_cast<size_t>(state.range(0)));
+  query::Node query = query::Parse(q);
+  int offset = static_cast<int>(state.range(0) / 20);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db->Search(query, 10, offset));
+}
+
+void BM_Count(benchmark::State &state, const char *backend, const char *q) {
+  auto db = OpenCatalog(backend, static_cast<size_t>(state.range(0)));
+  query::Node query = query::Parse(q);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db->Count(query));
+}
+
+void BM_PriceStats(benchmark::State &state, const char *backend,
+                   const char *q) {
+  auto db = OpenCatalog(backend, static_cast<size_t>(state.range(0)));
+  query::Node query = query::Parse(q);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db->PriceStats(query));
+}
+
+void BM_SearchWithStats(benchmark::State &state, const char *backend,
+                        const char *q) {
+  auto db = OpenCatalog(backend, static_cast<size_t>(state.range(0)));
+  query::Node query = query::Parse(q);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db->SearchWithStats(query, 10, 0, 0));
+}
+
+// SearchWithStats counting every facet as well.
+void BM_SearchFacets(benchmark::State &state, const char *backend,
+                     const char *q) {
+  auto db = OpenCatalog(backend, static_cast<size_t>(state.range(0)));
+  query::Node query = query::Parse(q);
+  unsigned facets = database::Database::kFacetBrand |
+                    database::Database::kFacetCategory |
+                    database::Database::kFacetPrice;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db->SearchWithStats(query, 10, 0, facets));
+}
+
+void BM_SearchRanked(benchmark::State &state, const char *backend,
+                     const char *q) {
+  auto db = OpenCatalog(backend, static_cast<size_t>(state.range(0)));
+  query::Node query = query::Parse(q);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db->SearchRanked(query, 10, 0, false, 0));
+}
+
+// The cheapest page within a fifth of the synthetic price spread.
+void BM_SearchByPrice(benchmark::State &state, const char *backend,
+                      const char *q) {
+  auto db = OpenCatalog(backend, static_cast<size_t>(state.range(0)));
+  query::PriceRange price;
+  price.min = 1000;
+  price.max = 3000;
+  query::Node query = query::Restrict(query::Parse(q), price);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db->SearchByPrice(query, 10, 0, false, false, 0));
+}
+
+#define EP_DATABASE_BENCH(fn, backend, sizes)                                  \
+  BENCHMARK_CAPTURE(fn, backend##_common, #backend, kCommon)->Apply(sizes);    \
+  BENCHMARK_CAPTURE(fn, backend##_narrow, #backend, kNarrow)->Apply(sizes);    \
+  BENCHMARK_CAPTURE(fn, backend##_negated, #backend, kNegated)->Apply(sizes)
+
+EP_DATABASE_BENCH(BM_Search, sqlite, SqliteSizes);
+EP_DATABASE_BENCH(BM_SearchDeepPage, sqlite, SqliteSizes);
+EP_DATABASE_BENCH(BM_Count, sqlite, SqliteSizes);
+EP_DATABASE_BENCH(BM_PriceStats, sqlite, SqliteSizes);
+EP_DATABASE_BENCH(BM_SearchWithStats, sqlite, SqliteSizes);
+EP_DATABASE_BENCH(BM_SearchFacets, sqlite, SqliteSizes);
+EP_DATABASE_BENCH(BM_SearchRanked, sqlite, SqliteSizes);
+EP_DATABASE_BENCH(BM_SearchByPrice, sqlite, SqliteSizes);
+BENCHMARK_CAPTURE(BM_SearchRanked, sqlite_either, "sqlite", kEither)
+    ->Apply(SqliteSizes);
+
+EP_DATABASE_BENCH(BM_Search, index, IndexSizes);
+EP_DATABASE_BENCH(BM_SearchDeepPage, index, IndexSizes);
+EP_DATABASE_BENCH(BM_Count, index, IndexSizes);
+EP_DATABASE_BENCH(BM_PriceStats, index, IndexSizes);
+EP_DATABASE_BENCH(BM_SearchWithStats, index, IndexSizes);
+EP_DATABASE_BENCH(BM_SearchFacets, index, IndexSizes);
+EP_DATABASE_BENCH(BM_SearchRanked, index, IndexSizes);
+EP_DATABASE_BENCH(BM_SearchByPrice, index, IndexSizes);
+BENCHMARK_CAPTURE(BM_SearchRanked, index_either, "index", kEither)
+    ->Apply(IndexSizes);
+
+} // namespace
+} // namespace bench
+} // namespace epiphany
@@ -0,0 +1,80 @@
+// Request-side parsing: query-string decoding, header parsing and the
+// incremental HTTP parser, plus response head serialization.
+#include "epiphany/server/http_parser.h"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <string>
+
+namespace epiphany {
+namespace bench {
+namespace {
+
+const char kRequest[] =
+    "GET /api/search_v2?q=%E9%94%AE%E7%9B%98+Pro&limit=10&offset=0 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: application/json, text/plain, */*\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://localhost:8080/\r\n"
+    "X-Trace-Id: 4bf92f3577b34da6\r\n"
+    "\r\n";
+
+void BM_UrlDecode(benchmark::State &state, const char *input) {
+  std::string in = input;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(server::UrlDecode(in));
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(in.size()));
+}
+BENCHMARK_CAPTURE(BM_UrlDecode, plain, "logitech keyboard pro");
+BENCHMARK_CAPTURE(BM_UrlDecode, percent,
+                  "%E9%94%AE%E7%9B%98+Pro+%22wireless%22+-%E9%BC%A0%E6%A0%87");
+
+void BM_ParseHeaders(benchmark::State &state) {
+  std::string request = kRequest;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(server::ParseHeaders(request));
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(request.size()));
+}
+BENCHMARK(BM_ParseHeaders);
+
+// The whole request through HttpParser, delivered in state.range(0)-byte
+// reads (0 = all at once).
+void BM_HttpParser(benchmark::State &state) {
+  std::string request = kRequest;
+  size_t chunk = state.range(0) > 0 ? static_cast<size_t>(state.range(0))
+                                    : request.size();
+  server::HttpParser parser(64 * 1024, 8 << 20);
+  for (auto _ : state) {
+    size_t pos = 0;
+    while (pos < request.size()) {
+      size_t consumed = 0;
+      auto status = parser.Parse(request.data() + pos,
+                                 std::min(chunk, request.size() - pos),
+                                 &consumed);
+      pos += consumed;
+      if (status == server::HttpParser::Status::kComplete)
+        benchmark::DoNotOptimize(parser.TakeRequest());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(request.size()));
+}
+BENCHMARK(BM_HttpParser)->Arg(0)->Arg(64)->Arg(1);
+
+void BM_SerializeHead(benchmark::State &state) {
+  server::HttpResponse response;
+  response.body.assign(4096, 'x');
+  response.headers.emplace_back("X-Trace-Id", "4bf92f3577b34da6");
+  for (auto _ : state)
+    benchmark::DoNotOptimize(server::SerializeHead(response, true));
+}
+BENCHMARK(BM_SerializeHead);
+
+} // namespace
+} // namespace bench
+} // namespace epiphany
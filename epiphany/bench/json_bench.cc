@@ -0,0 +1,77 @@
+// Escaping and formatting of the JSON written for every search result.
+#include "epiphany/database/item_json.h"
+#include "epiphany/database/json_writer.h"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <string>
+
+namespace epiphany {
+namespace bench {
+namespace {
+
+std::string Repeat(const std::string &unit, size_t bytes) {
+  std::string s;
+  while (s.size() < bytes)
+    s += unit;
+  s.resize(bytes);
+  return s;
+}
+
+// Title-like input at state.range(0) bytes: plain ASCII, UTF-8 CJK (no
+// escapes but high bytes), or one escape every 8 bytes.
+void BM_JsonString(benchmark::State &state, const char *unit) {
+  std::string input = Repeat(unit, static_cast<size_t>(state.range(0)));
+  std::string out;
+  for (auto _ : state) {
+    out.clear();
+    database::JsonWriter(&out).String(input);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(input.size()));
+}
+BENCHMARK_CAPTURE(BM_JsonString, ascii, "Logitech Keyboard Pro ")
+    ->RangeMultiplier(8)->Range(16, 4096);
+BENCHMARK_CAPTURE(BM_JsonString, cjk, "键盘显示器路由器")
+    ->RangeMultiplier(8)->Range(16, 4096);
+BENCHMARK_CAPTURE(BM_JsonString, escapes, "ab\"cd\\e\n")
+    ->RangeMultiplier(8)->Range(16, 4096);
+
+void BM_JsonNumbers(benchmark::State &state) {
+  std::string out;
+  double price = 1234.5;
+  for (auto _ : state) {
+    out.clear();
+    database::JsonWriter(&out).Fixed(price, 6).Raw(",").General(price).Raw(
+        ",").Int(123456789);
+    benchmark::DoNotOptimize(out.data());
+    price += 0.25;
+  }
+}
+BENCHMARK(BM_JsonNumbers);
+
+// A full page of state.range(0) items, as the backends emit it.
+void BM_ItemsPage(benchmark::State &state) {
+  const std::string title = "Logitech 键盘 Pro 10";
+  const std::string image =
+      "https://images.unsplash.com/photo-1587829741301-dc798b83add3?w=300";
+  std::string json;
+  for (auto _ : state) {
+    auto start = std::chrono::high_resolution_clock::now();
+    json.clear();
+    database::StartItems(&json);
+    for (int64_t i = 0; i < state.range(0); ++i) {
+      if (i != 0)
+        json += ",";
+      database::AppendItemJson(&json, title, 3243.0, image);
+    }
+    database::FinishItems(&json, start);
+    benchmark::DoNotOptimize(json.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ItemsPage)->Arg(10)->Arg(100)->Arg(1000);
+
+} // namespace
+} // namespace bench
+} // namespace epiphany
@@ -0,0 +1,51 @@
+// Per-request observability costs under contention. BM_SharedCounter is
+// the baseline every thread bumping one atomic, as request counting did
+// before the per-thread histograms.
+#include "epiphany/observability/metrics.h"
+#include "epiphany/observability/trace.h"
+#include <atomic>
+#include <benchmark/benchmark.h>
+
+namespace epiphany {
+namespace bench {
+namespace {
+
+std::atomic<long> shared_counter{0};
+
+void BM_SharedCounter(benchmark::State &state) {
+  for (auto _ : state)
+    shared_counter.fetch_add(1);
+}
+BENCHMARK(BM_SharedCounter)->ThreadRange(1, 16)->UseRealTime();
+
+void BM_RecordRequest(benchmark::State &state) {
+  long us = 100 + state.thread_index() * 37;
+  for (auto _ : state) {
+    observability::Metrics::RecordRequest(observability::Endpoint::kSearch,
+                                          us);
+    us = (us * 7 + 13) % 100000;
+  }
+}
+BENCHMARK(BM_RecordRequest)->ThreadRange(1, 16)->UseRealTime();
+
+// One traced request: four spans and the publish into the ring.
+void BM_TraceRequest(benchmark::State &state) {
+  for (auto _ : state) {
+    observability::Trace trace("", observability::NowNs());
+    observability::ScopedTrace current(&trace);
+    for (int i = 0; i < 4; ++i)
+      observability::ScopedSpan span(observability::Stage::kSearch);
+    trace.Finish();
+  }
+}
+BENCHMARK(BM_TraceRequest)->ThreadRange(1, 16)->UseRealTime();
+
+void BM_MetricsJson(benchmark::State &state) {
+  for (auto _ : state)
+    benchmark::DoNotOptimize(observability::Metrics::ToJson());
+}
+BENCHMARK(BM_MetricsJson);
+
+} // namespace
+} // namespace bench
+} // namespace epiphany
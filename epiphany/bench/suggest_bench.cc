@@ -0,0 +1,70 @@
+// Typeahead: completing a prefix against a built trie, building the trie
+// the suggester swaps in after a rewrite, and growing it after an append.
+#include "epiphany/bench/catalog.h"
+#include "epiphany/suggest/completion_trie.h"
+#include "epiphany/suggest/suggester.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+namespace epiphany {
+namespace bench {
+namespace {
+
+// A whole /api/suggest answer, JSON included, from catalogs of 1K to 1M
+// titles: a short prefix whose node holds thousands of titles, and one
+// deep inside a single title.
+void BM_Suggest(benchmark::State &state, const char *prefix) {
+  suggest::Suggester suggester(
+      OpenCatalog("sqlite", static_cast<size_t>(state.range(0))));
+  suggester.SuggestJson("", 1);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(suggester.SuggestJson(prefix, 10));
+}
+BENCHMARK_CAPTURE(BM_Suggest, short, "ap")
+    ->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK_CAPTURE(BM_Suggest, deep, "Dyson 相机 Pro 1")
+    ->RangeMultiplier(10)->Range(1000, 1000000);
+
+void BM_TrieBuild(benchmark::State &state) {
+  std::vector<suggest::CompletionTrie::Entry> entries;
+  for (auto &item : SyntheticItems(1, static_cast<size_t>(state.range(0)) + 1))
+    entries.push_back(suggest::CompletionTrie::Entry{std::move(item.title), 1});
+  size_t bytes = 0;
+  for (auto _ : state) {
+    suggest::CompletionTrie trie(entries);
+    bytes = trie.bytes();
+    benchmark::DoNotOptimize(bytes);
+  }
+  state.counters["trie_bytes"] = static_cast<double>(bytes);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TrieBuild)->RangeMultiplier(10)->Range(1000, 1000000)
+    ->Unit(benchmark::kMillisecond);
+
+// Adding the titles of a 1000-row append to a trie of state.range(0)
+// titles, as the suggester does in place.
+void BM_TrieAdd(benchmark::State &state) {
+  auto size = static_cast<size_t>(state.range(0));
+  std::vector<suggest::CompletionTrie::Entry> entries;
+  for (auto &item : SyntheticItems(1, size + 1))
+    entries.push_back(suggest::CompletionTrie::Entry{std::move(item.title), 1});
+  std::vector<database::Database::Item> appended =
+      SyntheticItems(size + 1, size + 1001);
+  for (auto _ : state) {
+    state.PauseTiming();
+    suggest::CompletionTrie trie(entries);
+    state.ResumeTiming();
+    for (const auto &item : appended)
+      trie.Add(item.title, 1);
+    benchmark::DoNotOptimize(trie.size());
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(appended.size()));
+}
+BENCHMARK(BM_TrieAdd)->RangeMultiplier(10)->Range(1000, 100000)
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace bench
+} // namespace epiphany
@@ -0,0 +1,23 @@
+#include "epiphany/builder/builder.h"
+#include <cstring>
+#include <iostream>
+
+// Offline segment builder:
+//   epiphany_build <items.db|dump.jsonl|dump.tsv> <output.seg>
+// or, to keep a segment up to date from an event topic:
+//   epiphany_build --realtime <events.jsonl|unix:socket> <output.seg>
+int main(int argc, char *argv[]) {
+  epiphany::builder::Builder builder;
+  if (argc == 4 && std::strcmp(argv[1], "--realtime") == 0) {
+    return builder.BuildRealtime(argv[2], argv[3]) ? 0 : 1;
+  }
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0]
+              << " <items.db|dump.jsonl|dump.tsv> <output.seg>\n"
+              << "       " << argv[0]
+              << " --realtime <events.jsonl|unix:socket> <output.seg>"
+              << std::endl;
+    return 2;
+  }
+  return builder.BuildOffline(argv[1], argv[2]) ? 0 : 1;
+}
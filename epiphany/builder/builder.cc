@@ -0,0 +1,201 @@
+#include "epiphany/builder/builder.h"
+#include "epiphany/database/database.h"
+#include "epiphany/database/item_json.h"
+#include "epiphany/index/ngram_index.h"
+#include "epiphany/index/segment.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <csignal>
+#include <iostream>
+#include <pthread.h>
+#include <vector>
+
+namespace epiphany {
+namespace builder {
+
+namespace {
+
+using Item = database::Database::Item;
+
+bool EndsWith(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool ReadJsonLines(const std::string &path, std::vector<Item> *items) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot open " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  for (int line_no = 1; std::getline(in, line); ++line_no) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+    Item item;
+    if (!database::ParseItemJson(line, &item)) {
+      std::cerr << path << ":" << line_no << ": invalid item" << std::endl;
+      return false;
+    }
+    items->push_back(std::move(item));
+  }
+  return true;
+}
+
+bool ReadTsv(const std::string &path, std::vector<Item> *items) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot open " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  for (int line_no = 1; std::getline(in, line); ++line_no) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty())
+      continue;
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+      size_t tab = line.find('\t', start);
+      fields.push_back(line.substr(start, tab - start));
+      if (tab == std::string::npos)
+        break;
+      start = tab + 1;
+    }
+    if (line_no == 1 && (fields[0] == "id" || fields[0] == "title"))
+      continue;
+    if (fields.size() != 3 && fields.size() != 4) {
+      std::cerr << path << ":" << line_no << ": expected 3 or 4 columns"
+                << std::endl;
+      return false;
+    }
+    size_t f = fields.size() - 3;
+    Item item;
+    char *end = nullptr;
+    if (f == 1) {
+      item.id = std::strtoll(fields[0].c_str(), &end, 10);
+      if (end == fields[0].c_str() || *end) {
+        std::cerr << path << ":" << line_no << ": invalid id" << std::endl;
+        return false;
+      }
+    }
+    item.title = fields[f];
+    item.price = std::strtod(fields[f + 1].c_str(), &end);
+    if (end == fields[f + 1].c_str() || *end) {
+      std::cerr << path << ":" << line_no << ": invalid price" << std::endl;
+      return false;
+    }
+    item.image_url = fields[f + 2];
+    items->push_back(std::move(item));
+  }
+  return true;
+}
+
+bool ReadSqlite(const std::string &path, std::vector<Item> *items) {
+  // Opening a missing file would silently create an empty database, and
+  // any other file would read as one with no items.
+  std::ifstream in(path, std::ios::binary);
+  char magic[16] = {};
+  if (!in) {
+    std::cerr << "Cannot open " << path << std::endl;
+    return false;
+  }
+  if (!in.read(magic, sizeof(magic)) ||
+      std::string(magic, sizeof(magic)) != std::string("SQLite format 3", 16)) {
+    std::cerr << path << " is not an SQLite database" << std::endl;
+    return false;
+  }
+  auto db = database::Database::Create("sqlite:" + path);
+  if (!db) {
+    return false;
+  }
+  db->ScanItems(0, [&](Item &&item) { items->push_back(std::move(item)); });
+  return true;
+}
+
+} // namespace
+
+bool Builder::BuildOffline(const std::string &input_path,
+                           const std::string &output_path) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Item> items;
+  bool ok;
+  if (EndsWith(input_path, ".jsonl") || EndsWith(input_path, ".ndjson")) {
+    ok = ReadJsonLines(input_path, &items);
+  } else if (EndsWith(input_path, ".tsv")) {
+    ok = ReadTsv(input_path, &items);
+  } else {
+    std::string path = input_path.rfind("sqlite:", 0) == 0
+                           ? input_path.substr(7)
+                           : input_path;
+    ok = ReadSqlite(path, &items);
+  }
+  if (!ok) {
+    return false;
+  }
+
+  int64_t max_id = 0;
+  for (const auto &item : items)
+    max_id = std::max(max_id, item.id);
+  for (auto &item : items) {
+    if (item.id <= 0)
+      item.id = ++max_id;
+  }
+  std::stable_sort(items.begin(), items.end(),
+                   [](const Item &a, const Item &b) { return a.id < b.id; });
+
+  index::NgramIndex index;
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (i + 1 < items.size() && items[i + 1].id == items[i].id)
+      continue;
+    index::Document doc;
+    doc.id = items[i].id;
+    doc.title = std::move(items[i].title);
+    doc.price = items[i].price;
+    doc.image_url = std::move(items[i].image_url);
+    doc.brand = std::move(items[i].brand);
+    doc.category = std::move(items[i].category);
+    index.Add(std::move(doc));
+  }
+  if (!index::WriteSegment(index, output_path)) {
+    return false;
+  }
+
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+  std::cout << "Built " << output_path << ": " << index.size() << " items, "
+            << index.postings().size() << " grams in " << ms << " ms"
+            << std::endl;
+  return true;
+}
+
+bool Builder::BuildRealtime(const std::string &topic,
+                            const std::string &output_path) {
+  // Block the stop signals before the ingest and merge threads start, so
+  // they inherit the mask and sigwait below is the only receiver.
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+  auto db = database::Database::Create("live:" + output_path +
+                                       "?topic=" + topic);
+  if (!db) {
+    return false;
+  }
+  std::cout << "Ingesting " << topic << " into " << output_path
+            << "; stop with SIGINT or SIGTERM" << std::endl;
+  int signal = 0;
+  sigwait(&stop_signals, &signal);
+  // Closing the database stops ingest and runs the final merge.
+  db.reset();
+  std::cout << "Stopped on signal " << signal << std::endl;
+  return true;
+}
+
+} // namespace builder
+} // namespace epiphany
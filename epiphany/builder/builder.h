@@ -4,7 +4,19 @@ namespace epiphany {
 namespace builder {
 class Builder {
 public:
+  // Reads a catalog and writes an immutable segment file (see
+  // index/segment.h) that "segment:<output_path>" serves from mmap. The
+  // input is an SQLite database with an items table, or a dump named
+  // *.jsonl / *.ndjson (one {"id","title","price","image_url","brand",
+  // "category"} object per line) or *.tsv ([id\t]title\tprice\timage_url,
+  // without brand or category). Rows without an id are numbered after
+  // the largest one; a repeated id keeps the last row.
   bool BuildOffline(const std::string &input_path, const std::string &output_path);
+  // Applies the add/update/delete events of topic (see EventTopic and
+  // ParseItemEvent) to the segment at output_path, creating it if missing,
+  // and merges them into the file periodically and once more on exit.
+  // Runs until SIGINT or SIGTERM. A server reading the same events
+  // through "live:<output_path>?topic=<topic>" serves them as they arrive.
   bool BuildRealtime(const std::string &topic, const std::string &output_path);
 };
 } // namespace builder
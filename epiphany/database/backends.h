@@ -0,0 +1,38 @@
+#pragma once
+#include "epiphany/database/database.h"
+#include <memory>
+#include <string>
+
+namespace epiphany {
+namespace database {
+
+// Statements behind BulkInsert: an upsert by id that fires the same
+// triggers as an UPDATE (unlike INSERT OR REPLACE), and an append that
+// keeps titles unique. Both take the brand and category by name and store
+// their dictionary ids; a name not in the dictionary, such as "", stores
+// NULL. A row's names are added to the dictionaries first.
+constexpr const char *kBulkUpsertSql =
+    "INSERT INTO items (id, title, price, image_url, brand_id, category_id) "
+    "VALUES (?, ?, ?, ?, (SELECT id FROM brands WHERE name = ?), "
+    "(SELECT id FROM categories WHERE name = ?)) "
+    "ON CONFLICT(id) DO UPDATE SET title = excluded.title, "
+    "price = excluded.price, image_url = excluded.image_url, "
+    "brand_id = excluded.brand_id, category_id = excluded.category_id;";
+constexpr const char *kBulkAppendSql =
+    "INSERT OR IGNORE INTO items (title, price, image_url, brand_id, "
+    "category_id) VALUES (?, ?, ?, (SELECT id FROM brands WHERE name = ?), "
+    "(SELECT id FROM categories WHERE name = ?));";
+constexpr const char *kBulkBrandSql =
+    "INSERT OR IGNORE INTO brands (name) VALUES (?);";
+constexpr const char *kBulkCategorySql =
+    "INSERT OR IGNORE INTO categories (name) VALUES (?);";
+
+// Backend constructors used by Database::Create. Each takes the connection
+// string with its scheme prefix removed.
+std::unique_ptr<Database> CreateSqliteDatabase(const std::string &spec);
+std::unique_ptr<Database> CreateIndexDatabase(const std::string &spec);
+std::unique_ptr<Database> CreateSegmentDatabase(const std::string &spec);
+std::unique_ptr<Database> CreateLiveDatabase(const std::string &spec);
+
+} // namespace database
+} // namespace epiphany
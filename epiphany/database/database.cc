@@ -0,0 +1,139 @@
+#include "epiphany/database/backends.h"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <string_view>
+
+namespace epiphany {
+namespace database {
+
+namespace {
+
+bool StartsWithWord(const std::string &sql, size_t pos, const char *word) {
+  for (; *word; ++word, ++pos) {
+    if (pos >= sql.size() ||
+        std::toupper(static_cast<unsigned char>(sql[pos])) != *word)
+      return false;
+  }
+  return true;
+}
+
+// Whether an INSERT starting at pos can only add rows with new, larger
+// ids: no OR action but IGNORE, no upsert clause, and a column list that
+// leaves the id to SQLite. Anything unclear counts as a rewrite.
+bool InsertOnlyAppends(const std::string &sql, size_t pos) {
+  const char *kSpace = " \t\r\n";
+  std::string upper(sql);
+  std::transform(upper.begin(), upper.end(), upper.begin(), [](char c) {
+    return static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  });
+  if (upper.find("ON CONFLICT") != std::string::npos)
+    return false;
+  size_t next = sql.find_first_not_of(kSpace, pos + 6);
+  if (next != std::string::npos && StartsWithWord(sql, next, "OR")) {
+    size_t action = sql.find_first_not_of(kSpace, next + 2);
+    if (action == std::string::npos || !StartsWithWord(sql, action, "IGNORE"))
+      return false;
+  }
+  // The column list follows the table name; without one, every column,
+  // the id included, gets a value.
+  size_t into = upper.find("INTO", pos);
+  if (into == std::string::npos)
+    return false;
+  size_t table = sql.find_first_not_of(kSpace, into + 4);
+  if (table == std::string::npos)
+    return false;
+  size_t open = sql.find_first_of(" \t\r\n(", table);
+  if (open != std::string::npos)
+    open = sql.find_first_not_of(kSpace, open);
+  if (open == std::string::npos || sql[open] != '(')
+    return false;
+  size_t close = sql.find(')', open);
+  if (close == std::string::npos)
+    return false;
+  std::string_view columns(upper.data() + open + 1, close - open - 1);
+  while (!columns.empty()) {
+    size_t comma = columns.find(',');
+    std::string_view column = columns.substr(0, comma);
+    size_t first = column.find_first_not_of(" \t\r\n\"`[");
+    size_t last = column.find_last_not_of(" \t\r\n\"`]");
+    if (first != std::string_view::npos) {
+      column = column.substr(first, last - first + 1);
+      if (column == "ID" || column == "ROWID" || column == "OID" ||
+          column == "_ROWID_")
+        return false;
+    }
+    if (comma == std::string_view::npos)
+      break;
+    columns.remove_prefix(comma + 1);
+  }
+  return true;
+}
+
+} // namespace
+
+WriteKind ClassifyWrite(const std::string &sql) {
+  size_t pos = sql.find_first_not_of(" \t\r\n");
+  if (pos == std::string::npos)
+    return WriteKind::kNone;
+  if (StartsWithWord(sql, pos, "INSERT"))
+    return InsertOnlyAppends(sql, pos) ? WriteKind::kAppend
+                                       : WriteKind::kRewrite;
+  if (StartsWithWord(sql, pos, "CREATE") ||
+      StartsWithWord(sql, pos, "SELECT") ||
+      StartsWithWord(sql, pos, "PRAGMA"))
+    return WriteKind::kNone;
+  return WriteKind::kRewrite;
+}
+
+std::unique_ptr<Database>
+Database::Create(const std::string &connection_string) {
+  if (connection_string.rfind("sqlite:", 0) == 0) {
+    return CreateSqliteDatabase(connection_string.substr(7));
+  }
+  if (connection_string.rfind("index:", 0) == 0) {
+    return CreateIndexDatabase(connection_string.substr(6));
+  }
+  if (connection_string.rfind("mem:", 0) == 0) {
+    // Items live only in memory: an in-memory SQLite store behind the index.
+    return CreateIndexDatabase("sqlite::memory:");
+  }
+  if (connection_string.rfind("segment:", 0) == 0) {
+    return CreateSegmentDatabase(connection_string.substr(8));
+  }
+  if (connection_string.rfind("live:", 0) == 0) {
+    return CreateLiveDatabase(connection_string.substr(5));
+  }
+  std::cerr << "Invalid connection string. Must start with 'sqlite:', "
+               "'index:', 'mem:', 'segment:' or 'live:'"
+            << std::endl;
+  return nullptr;
+}
+
+bool Database::BulkInsert(const std::vector<Item> &items,
+                          const BulkOptions &, BulkResult *result) {
+  *result = BulkResult();
+  if (ReadOnly()) {
+    std::cerr << "Bulk insert into a read-only database" << std::endl;
+    return false;
+  }
+  for (const auto &item : items) {
+    if (!item.brand.empty())
+      Execute(kBulkBrandSql, {item.brand});
+    if (!item.category.empty())
+      Execute(kBulkCategorySql, {item.category});
+    std::string price = std::to_string(item.price);
+    bool ok =
+        item.id > 0
+            ? Execute(kBulkUpsertSql,
+                      {std::to_string(item.id), item.title, price,
+                       item.image_url, item.brand, item.category})
+            : Execute(kBulkAppendSql, {item.title, price, item.image_url,
+                                       item.brand, item.category});
+    ++(ok ? result->inserted : result->skipped);
+  }
+  return true;
+}
+
+} // namespace database
+} // namespace epiphany
@@ -1,4 +1,8 @@
 #pragma once
+#include "epiphany/query/query.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -6,6 +10,17 @@
 namespace epiphany {
 namespace database {
 
+// How much of what was derived from the catalog (indexes, suggestions) a
+// write may invalidate: nothing, only by adding rows with new, larger ids,
+// or anything.
+enum class WriteKind { kNone = 0, kAppend = 1, kRewrite = 2 };
+
+// INSERTs and INSERT OR IGNOREs that leave the id to SQLite only append;
+// CREATE, SELECT and PRAGMA leave rows alone; anything else (an INSERT
+// naming the id or with ON CONFLICT, UPDATE, DELETE, REPLACE, DROP, COMMIT
+// of a batch ...) may rewrite.
+WriteKind ClassifyWrite(const std::string &sql);
+
 class Database {
 public:
   virtual ~Database() = default;
@@ -15,19 +30,171 @@ public:
   virtual bool Execute(const std::string &query) = 0;
   virtual bool Execute(const std::string &query, const std::vector<std::string> &params) = 0;
 
-  // Search for items/products.
-  virtual std::string Search(const std::string &query, int limit, int offset) = 0;
-  virtual int Count(const std::string &query) = 0;
+  // Search for items/products whose titles satisfy a parsed boolean query
+  // (see query::Parse), optionally restricted by price (query::Restrict).
+  virtual std::string Search(const query::Node &query, int limit, int offset) = 0;
+  virtual int Count(const query::Node &query) = 0;
   struct PriceAggregates {
     double avg{0.0};
     double min{0.0};
     double max{0.0};
   };
-  virtual PriceAggregates PriceStats(const std::string &query) = 0;
+  virtual PriceAggregates PriceStats(const query::Node &query) = 0;
+
+  // Facets a search with stats can count over every match, OR-ed into a
+  // mask. Brands and categories count matches per value; the price
+  // histogram counts them per bucket of a fixed 1-2-5 series (see
+  // PriceBucketOf), so buckets need no first pass for the range.
+  enum Facet : unsigned {
+    kFacetBrand = 1u << 0,
+    kFacetCategory = 1u << 1,
+    kFacetPrice = 1u << 2,
+  };
+  // Values kept per facet, most matches first.
+  static constexpr size_t kFacetValues = 20;
+  struct FacetCount {
+    std::string value;
+    int count{0};
+  };
+  // Matches priced in [from, to); the first bucket also takes everything
+  // below 1, the last everything from its from on (to is infinite).
+  struct PriceBucket {
+    double from{0.0};
+    double to{0.0};
+    int count{0};
+  };
+  struct Facets {
+    std::vector<FacetCount> brand;
+    std::vector<FacetCount> category;
+    // Non-empty buckets, cheapest first.
+    std::vector<PriceBucket> price;
+  };
+
+  // Search, Count and PriceStats answered from a single pass over the
+  // matching rows, plus the requested facets from the same pass.
+  struct SearchResult {
+    std::string items;
+    int total{0};
+    PriceAggregates price;
+    Facets facets;
+    // Set by SearchAfter: id of the last item in items, 0 if none.
+    int64_t last_id{0};
+  };
+  virtual SearchResult SearchWithStats(const query::Node &query, int limit,
+                                       int offset, unsigned facets) = 0;
+
+  // The matches ranked by BM25 relevance to the query's terms (see
+  // ranking/bm25.h), best first and equal scores by id, from offset. Only
+  // the top offset + limit are ever collected, and matches that cannot
+  // reach them are skipped unread where the backend allows. A query with
+  // nothing to score, such as a pure negation, pages in id order. With
+  // with_stats, total, price and facets cover every match.
+  virtual SearchResult SearchRanked(const query::Node &query, int limit,
+                                    int offset, bool with_stats,
+                                    unsigned facets) = 0;
+
+  // Keyset pagination: the first limit matches with id > after_id, in id
+  // order, seeking past earlier matches instead of counting them off. With
+  // with_stats, total, price and facets cover every match, not just the
+  // page.
+  virtual SearchResult SearchAfter(const query::Node &query, int limit,
+                                   int64_t after_id, bool with_stats,
+                                   unsigned facets) = 0;
+
+  // The matches by price from offset, cheapest first, or dearest first when
+  // descending; equal prices go by id in the same direction. Matches are
+  // read in price order from a price index and reading stops after the
+  // page, so unless matches are sparse a page costs about offset + limit
+  // of them, not all. With with_stats, total, price and facets cover every
+  // match.
+  virtual SearchResult SearchByPrice(const query::Node &query, int limit,
+                                     int offset, bool descending,
+                                     bool with_stats, unsigned facets) = 0;
+
+  // Visits every item with id > after_id in ascending id order. Used by
+  // backends and tools that build their own structures over the catalog.
+  struct Item {
+    int64_t id{0};
+    std::string title;
+    double price{0.0};
+    std::string image_url;
+    // Stored dictionary-encoded; empty for none.
+    std::string brand;
+    std::string category;
+  };
+  virtual void ScanItems(int64_t after_id,
+                         const std::function<void(Item &&)> &visit) = 0;
+
+  // Loads many items at once. An item with an id replaces the row with
+  // that id; one without is appended unless its title already exists.
+  // Rows whose write is refused (e.g. a title held by another id) are
+  // skipped and counted. The default issues one Execute per item;
+  // backends batch rows into transactions of batch_size, so a load pays
+  // one commit per batch instead of one per row. Batches commit
+  // independently, so after a failure result still counts what earlier
+  // batches wrote.
+  struct BulkOptions {
+    size_t batch_size{10000};
+    // Load with PRAGMA synchronous=OFF: commits skip fsync, so a crash or
+    // power loss mid-load can lose or corrupt what the load wrote.
+    bool fast{false};
+  };
+  struct BulkResult {
+    size_t inserted{0};
+    size_t skipped{0};
+  };
+  virtual bool BulkInsert(const std::vector<Item> &items,
+                          const BulkOptions &options, BulkResult *result);
+
+  // Statements that bring an existing database up to the schema this
+  // backend needs beyond the items table (e.g. search indexes and the
+  // triggers maintaining them). Idempotent; run once at startup.
+  virtual std::vector<std::string> SchemaMigrations() const { return {}; }
+
+  // True for backends that refuse Execute, such as mapped segments; the
+  // server then skips schema setup and seeding.
+  virtual bool ReadOnly() const { return false; }
+
+  // Incremented after every successful write through Execute, so callers
+  // can tell whether results computed earlier may be stale.
+  uint64_t WriteGeneration() const {
+    return write_generation_.load(std::memory_order_acquire);
+  }
+  // Incremented after every write that may have changed or removed rows,
+  // not only appended them. While it holds still, ScanItems from the
+  // largest id seen picks up everything written since.
+  uint64_t RewriteGeneration() const {
+    return rewrite_generation_.load(std::memory_order_acquire);
+  }
 
   // Factory method to create a database instance.
   // connection_string example: "sqlite:test.db"
+  // Pool options may follow the filename, e.g.
+  // "sqlite:test.db?readers=8&wal=1" opens eight read-only connections that
+  // serve Search/Count/PriceStats while a single writer handles Execute.
+  // Adding "fts=1" matches titles through an FTS5 trigram index.
+  // "index:<spec>" serves reads from an in-memory n-gram index kept in sync
+  // with the store named by spec (e.g. "index:sqlite:test.db"); "mem:" does
+  // the same over an in-memory store. "segment:<file>" serves a segment
+  // written by Builder::BuildOffline from mmap, read-only; "?verify=1"
+  // checksums it at startup. "live:<file>?topic=<topic>" serves the same
+  // kind of segment, created empty if missing, plus the add/update/delete
+  // events read from topic (a file tailed like a log, or "unix:<socket>");
+  // "&merge_ms=N" sets how often they are merged into the file.
   static std::unique_ptr<Database> Create(const std::string &connection_string);
+
+protected:
+  // Rewrites are counted before the write generation moves, so a reader
+  // that sees the new write generation also sees the rewrite.
+  void BumpWriteGeneration(WriteKind kind = WriteKind::kRewrite) {
+    if (kind == WriteKind::kRewrite)
+      rewrite_generation_.fetch_add(1, std::memory_order_release);
+    write_generation_.fetch_add(1, std::memory_order_release);
+  }
+
+private:
+  std::atomic<uint64_t> write_generation_{0};
+  std::atomic<uint64_t> rewrite_generation_{0};
 };
 
 } // namespace database
@@ -0,0 +1,24 @@
+#include "epiphany/database/deadline.h"
+#include "epiphany/observability/trace.h"
+
+namespace epiphany {
+namespace database {
+
+namespace {
+thread_local int64_t current_deadline_ns = 0;
+} // namespace
+
+bool DeadlineExceeded() {
+  return current_deadline_ns != 0 &&
+         observability::NowNs() >= current_deadline_ns;
+}
+
+ScopedDeadline::ScopedDeadline(int64_t deadline_ns)
+    : previous_(current_deadline_ns) {
+  current_deadline_ns = deadline_ns;
+}
+
+ScopedDeadline::~ScopedDeadline() { current_deadline_ns = previous_; }
+
+} // namespace database
+} // namespace epiphany
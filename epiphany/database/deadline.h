@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+namespace epiphany {
+namespace database {
+
+// A request's deadline is the time, on the observability::NowNs clock, by
+// which it must be answered. Reads that can stop early check the calling
+// thread's: SQLite statements are interrupted once it passes (see
+// SqliteConnection). Their results are then incomplete, which the caller
+// tells by asking DeadlineExceeded afterwards.
+
+// True once the calling thread's deadline, if it has one, has passed.
+bool DeadlineExceeded();
+
+// Makes deadline_ns, 0 for none, the calling thread's deadline for the
+// lifetime of the scope.
+class ScopedDeadline {
+public:
+  explicit ScopedDeadline(int64_t deadline_ns);
+  ~ScopedDeadline();
+  ScopedDeadline(const ScopedDeadline &) = delete;
+  ScopedDeadline &operator=(const ScopedDeadline &) = delete;
+
+private:
+  int64_t previous_;
+};
+
+} // namespace database
+} // namespace epiphany
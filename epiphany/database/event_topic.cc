@@ -0,0 +1,161 @@
+#include "epiphany/database/event_topic.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace epiphany {
+namespace database {
+
+namespace {
+
+// How often a tailed file is checked for growth.
+constexpr int kFilePollMs = 5;
+
+} // namespace
+
+std::unique_ptr<EventTopic> EventTopic::Open(const std::string &topic) {
+  std::unique_ptr<EventTopic> t(new EventTopic());
+  t->wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (topic.rfind("unix:", 0) == 0) {
+    t->socket_path_ = topic.substr(5);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (t->socket_path_.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "Socket path too long: " << t->socket_path_ << std::endl;
+      return nullptr;
+    }
+    std::strcpy(addr.sun_path, t->socket_path_.c_str());
+    unlink(addr.sun_path);
+    t->listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (t->listen_fd_ < 0 ||
+        bind(t->listen_fd_, reinterpret_cast<sockaddr *>(&addr),
+             sizeof(addr)) < 0 ||
+        listen(t->listen_fd_, 16) < 0) {
+      std::cerr << "Cannot listen on " << t->socket_path_ << ": "
+                << std::strerror(errno) << std::endl;
+      return nullptr;
+    }
+  } else {
+    t->file_fd_ = open(topic.c_str(), O_RDONLY | O_CLOEXEC);
+    if (t->file_fd_ < 0) {
+      std::cerr << "Cannot open topic " << topic << ": "
+                << std::strerror(errno) << std::endl;
+      return nullptr;
+    }
+  }
+  return t;
+}
+
+EventTopic::~EventTopic() {
+  for (const auto &client : clients_)
+    close(client.fd);
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+  }
+  if (file_fd_ >= 0)
+    close(file_fd_);
+  if (wake_fd_ >= 0)
+    close(wake_fd_);
+}
+
+bool EventTopic::Next(std::string *line) {
+  while (!stopped_.load()) {
+    if (!ready_.empty()) {
+      *line = std::move(ready_.front());
+      ready_.pop_front();
+      return true;
+    }
+    Poll();
+  }
+  return false;
+}
+
+void EventTopic::Stop() {
+  stopped_.store(true);
+  uint64_t one = 1;
+  if (write(wake_fd_, &one, sizeof(one)) < 0) {
+    // The counter is already non-zero; Next wakes anyway.
+  }
+}
+
+void EventTopic::Poll() {
+  std::vector<pollfd> fds;
+  fds.push_back(pollfd{wake_fd_, POLLIN, 0});
+  if (file_fd_ >= 0) {
+    // Regular files always poll readable, so growth is checked on a timer.
+    if (ReadFile())
+      return;
+    poll(fds.data(), fds.size(), kFilePollMs);
+    return;
+  }
+  fds.push_back(pollfd{listen_fd_, POLLIN, 0});
+  for (const auto &client : clients_)
+    fds.push_back(pollfd{client.fd, POLLIN, 0});
+  if (poll(fds.data(), fds.size(), -1) <= 0)
+    return;
+  if (fds[1].revents & POLLIN) {
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd >= 0)
+      clients_.push_back(Client{fd, std::string()});
+  }
+  // Newly accepted clients have no pollfd yet and are read next round.
+  for (size_t i = fds.size() - 2; i-- > 0;) {
+    if (!(fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)))
+      continue;
+    if (!ReadSocket(clients_[i].fd, &clients_[i].buffer)) {
+      if (!clients_[i].buffer.empty())
+        ready_.push_back(std::move(clients_[i].buffer));
+      close(clients_[i].fd);
+      clients_.erase(clients_.begin() + i);
+    }
+  }
+}
+
+bool EventTopic::ReadFile() {
+  struct stat st;
+  if (fstat(file_fd_, &st) == 0 && st.st_size < file_offset_) {
+    // Truncated in place: start over.
+    file_offset_ = 0;
+    file_buffer_.clear();
+  }
+  char buf[65536];
+  ssize_t n = pread(file_fd_, buf, sizeof(buf), file_offset_);
+  if (n <= 0)
+    return false;
+  file_buffer_.append(buf, n);
+  file_offset_ += n;
+  SplitLines(&file_buffer_);
+  return true;
+}
+
+bool EventTopic::ReadSocket(int fd, std::string *buffer) {
+  char buf[65536];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n <= 0)
+    return false;
+  buffer->append(buf, n);
+  SplitLines(buffer);
+  return true;
+}
+
+void EventTopic::SplitLines(std::string *buffer) {
+  size_t start = 0;
+  size_t newline;
+  while ((newline = buffer->find('\n', start)) != std::string::npos) {
+    if (newline > start)
+      ready_.emplace_back(*buffer, start, newline - start);
+    start = newline + 1;
+  }
+  buffer->erase(0, start);
+}
+
+} // namespace database
+} // namespace epiphany
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace epiphany {
+namespace database {
+
+// Source of catalog change events, one JSON object per line (see
+// ParseItemEvent). There is no broker: a topic is either a file, tailed
+// from its start like a log, or "unix:<path>", a stream socket that any
+// number of producers connect to and write lines into.
+class EventTopic {
+public:
+  static std::unique_ptr<EventTopic> Open(const std::string &topic);
+  ~EventTopic();
+
+  // Blocks until a line arrives and stores it without its newline. Returns
+  // false once Stop has been called.
+  bool Next(std::string *line);
+  // Makes Next return false; callable from any thread.
+  void Stop();
+
+private:
+  EventTopic() = default;
+
+  // Waits for more input and splits what arrives into ready_.
+  void Poll();
+  // False when the file has not grown.
+  bool ReadFile();
+  // False when the peer closed the connection.
+  bool ReadSocket(int fd, std::string *buffer);
+  void SplitLines(std::string *buffer);
+
+  int wake_fd_{-1};
+  int file_fd_{-1};
+  off_t file_offset_{0};
+  std::string file_buffer_;
+  std::string socket_path_;
+  int listen_fd_{-1};
+  struct Client {
+    int fd;
+    std::string buffer;
+  };
+  std::vector<Client> clients_;
+  std::deque<std::string> ready_;
+  std::atomic<bool> stopped_{false};
+};
+
+} // namespace database
+} // namespace epiphany
@@ -0,0 +1,89 @@
+#include "epiphany/database/facet_counter.h"
+#include <limits>
+
+namespace epiphany {
+namespace database {
+
+namespace {
+
+// Moves counts into totals under their names and leaves counts zeroed.
+void Fold(unsigned facet, const FacetCounter::Namer &name,
+          std::vector<uint32_t> *counts,
+          std::unordered_map<std::string, int> *totals) {
+  for (uint32_t code = 1; code < counts->size(); ++code) {
+    uint32_t count = (*counts)[code];
+    if (count == 0)
+      continue;
+    (*counts)[code] = 0;
+    std::string_view value = name(facet, code);
+    if (!value.empty())
+      (*totals)[std::string(value)] += static_cast<int>(count);
+  }
+  if (!counts->empty())
+    (*counts)[0] = 0;
+}
+
+std::vector<Database::FacetCount>
+Top(const std::unordered_map<std::string, int> &totals) {
+  std::vector<Database::FacetCount> out;
+  out.reserve(totals.size());
+  for (const auto &kv : totals)
+    out.push_back(Database::FacetCount{kv.first, kv.second});
+  auto more = [](const Database::FacetCount &a, const Database::FacetCount &b) {
+    if (a.count != b.count)
+      return a.count > b.count;
+    return a.value < b.value;
+  };
+  size_t keep = std::min(out.size(), Database::kFacetValues);
+  std::partial_sort(out.begin(), out.begin() + static_cast<ptrdiff_t>(keep),
+                    out.end(), more);
+  out.resize(keep);
+  return out;
+}
+
+} // namespace
+
+FacetCounter::FacetCounter(unsigned facets) : facets_(facets) {
+  thread_local Counters shared;
+  counters_ = shared.busy ? &own_ : &shared;
+  counters_->busy = true;
+  brand_ = &counters_->brand;
+  category_ = &counters_->category;
+}
+
+FacetCounter::~FacetCounter() {
+  // Codes counted but never flushed must not leak into the next search.
+  std::fill(brand_->begin(), brand_->end(), 0);
+  std::fill(category_->begin(), category_->end(), 0);
+  counters_->busy = false;
+}
+
+void FacetCounter::Flush(const Namer &name) {
+  Fold(Database::kFacetBrand, name, brand_, &brand_totals_);
+  Fold(Database::kFacetCategory, name, category_, &category_totals_);
+}
+
+Database::Facets FacetCounter::Finish() const {
+  Database::Facets facets;
+  if (facets_ & Database::kFacetBrand)
+    facets.brand = Top(brand_totals_);
+  if (facets_ & Database::kFacetCategory)
+    facets.category = Top(category_totals_);
+  if (facets_ & Database::kFacetPrice) {
+    for (size_t b = 0; b < kPriceBuckets; ++b) {
+      if (prices_[b] == 0)
+        continue;
+      Database::PriceBucket bucket;
+      bucket.from = b == 0 ? 0.0 : kPriceEdges[b - 1];
+      bucket.to = b + 1 < kPriceBuckets
+                      ? kPriceEdges[b]
+                      : std::numeric_limits<double>::infinity();
+      bucket.count = static_cast<int>(prices_[b]);
+      facets.price.push_back(bucket);
+    }
+  }
+  return facets;
+}
+
+} // namespace database
+} // namespace epiphany
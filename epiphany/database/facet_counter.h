@@ -0,0 +1,89 @@
+#pragma once
+#include "epiphany/database/database.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace epiphany {
+namespace database {
+
+// Upper bounds of the price histogram buckets but the last: 1, 2, 5, 10,
+// 20, 50 ... 5e11.
+inline constexpr double kPriceEdges[] = {
+    1e0,  2e0,  5e0,  1e1,  2e1,  5e1,  1e2,  2e2,  5e2,  1e3,  2e3,  5e3,
+    1e4,  2e4,  5e4,  1e5,  2e5,  5e5,  1e6,  2e6,  5e6,  1e7,  2e7,  5e7,
+    1e8,  2e8,  5e8,  1e9,  2e9,  5e9,  1e10, 2e10, 5e10, 1e11, 2e11, 5e11};
+constexpr size_t kPriceBuckets = std::size(kPriceEdges) + 1;
+
+inline size_t PriceBucketOf(double price) {
+  return static_cast<size_t>(
+      std::upper_bound(std::begin(kPriceEdges), std::end(kPriceEdges), price) -
+      std::begin(kPriceEdges));
+}
+
+// Counts the facets of a match set in the pass that reads it. Brands and
+// categories arrive as dictionary codes, 0 for none, and are counted in
+// arrays indexed by code. The arrays belong to the thread and are reused
+// by its next search, so counting allocates nothing once they have grown
+// to the dictionaries, and workers never write to each other's counters.
+class FacetCounter {
+public:
+  // Names a code of kFacetBrand or kFacetCategory; empty drops it.
+  using Namer = std::function<std::string_view(unsigned facet, uint32_t code)>;
+
+  explicit FacetCounter(unsigned facets);
+  ~FacetCounter();
+  FacetCounter(const FacetCounter &) = delete;
+  FacetCounter &operator=(const FacetCounter &) = delete;
+
+  unsigned facets() const { return facets_; }
+
+  void Add(uint32_t brand, uint32_t category, double price) {
+    if (facets_ & Database::kFacetBrand)
+      Bump(brand_, brand);
+    if (facets_ & Database::kFacetCategory)
+      Bump(category_, category);
+    if (facets_ & Database::kFacetPrice)
+      ++prices_[PriceBucketOf(price)];
+  }
+
+  // Folds the codes counted so far into totals per value. Call it before
+  // counting codes from another dictionary, and before Finish.
+  void Flush(const Namer &name);
+
+  // The most frequent values of each facet and the non-empty buckets.
+  Database::Facets Finish() const;
+
+private:
+  struct Counters {
+    std::vector<uint32_t> brand;
+    std::vector<uint32_t> category;
+    bool busy{false};
+  };
+
+  static void Bump(std::vector<uint32_t> *counts, uint32_t code) {
+    if (code >= counts->size())
+      counts->resize(code + 1);
+    ++(*counts)[code];
+  }
+
+  const unsigned facets_;
+  // The thread's counters, or own_ while another counter on this thread
+  // holds them.
+  Counters *counters_;
+  Counters own_;
+  std::vector<uint32_t> *brand_;
+  std::vector<uint32_t> *category_;
+  uint32_t prices_[kPriceBuckets] = {};
+  std::unordered_map<std::string, int> brand_totals_;
+  std::unordered_map<std::string, int> category_totals_;
+};
+
+} // namespace database
+} // namespace epiphany
@@ -0,0 +1,1055 @@
+#include "epiphany/database/backends.h"
+#include "epiphany/database/event_topic.h"
+#include "epiphany/database/facet_counter.h"
+#include "epiphany/database/item_json.h"
+#include "epiphany/index/live_index.h"
+#include "epiphany/index/ngram_index.h"
+#include "epiphany/index/segment.h"
+#include "epiphany/observability/metrics.h"
+#include "epiphany/observability/trace.h"
+#include "epiphany/ranking/bm25.h"
+#include "epiphany/ranking/top_k.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace epiphany {
+namespace database {
+
+namespace {
+
+index::Document ToDocument(Database::Item &&item) {
+  index::Document doc;
+  doc.id = item.id;
+  doc.title = std::move(item.title);
+  doc.price = item.price;
+  doc.image_url = std::move(item.image_url);
+  doc.brand = std::move(item.brand);
+  doc.category = std::move(item.category);
+  return doc;
+}
+
+using observability::ScopedSpan;
+using observability::Stage;
+
+// The matches priced within range. Bisecting the price order gives the run
+// of ordinals in range; a run much shorter than the matches is sorted into
+// a bitmap and intersected with them, otherwise each match's price is
+// checked in the column. Sorting costs about kSortCost checks per ordinal.
+constexpr size_t kSortCost = 16;
+
+index::RoaringBitmap RestrictPrice(const index::IndexReader &reader,
+                                   const query::PriceRange &range,
+                                   const index::RoaringBitmap &matches) {
+  const double *prices = reader.Prices();
+  const index::PriceOrder &order = reader.ByPrice();
+  std::pair<size_t, size_t> run = order.Range(prices, range.min, range.max);
+  size_t length = run.second - run.first;
+  index::RoaringBitmap out;
+  if (length == 0)
+    return out;
+  if (length * kSortCost < matches.Cardinality()) {
+    std::vector<uint32_t> ordinals(order.data() + run.first,
+                                   order.data() + run.second);
+    std::sort(ordinals.begin(), ordinals.end());
+    for (uint32_t ordinal : ordinals)
+      out.Add(ordinal);
+    return index::RoaringBitmap::And(matches, out);
+  }
+  matches.ForEachBlock([&](const uint32_t *ordinals, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      double price = prices[ordinals[i]];
+      if (price >= range.min && price <= range.max)
+        out.Add(ordinals[i]);
+    }
+  });
+  return out;
+}
+
+// Callers keep the reader stable (see IndexReadDatabase::Snapshot).
+index::RoaringBitmap EvaluateNode(const index::IndexReader &reader,
+                                  const query::Node &node) {
+  using Kind = query::Node::Kind;
+  switch (node.kind) {
+  case Kind::kTerm:
+    return reader.Match(node.term);
+  case Kind::kPrice:
+    return RestrictPrice(reader, node.price, reader.All());
+  case Kind::kNot:
+    return index::RoaringBitmap::AndNot(reader.All(),
+                                        EvaluateNode(reader, node.children[0]));
+  case Kind::kOr: {
+    index::RoaringBitmap out;
+    for (const auto &child : node.children)
+      out = index::RoaringBitmap::Or(out, EvaluateNode(reader, child));
+    return out;
+  }
+  case Kind::kAnd:
+    break;
+  }
+  // Intersect the positive clauses smallest first, narrow that by price,
+  // then subtract the negated ones; only a query without positive clauses
+  // starts from every document.
+  std::vector<index::RoaringBitmap> positive;
+  std::vector<const query::Node *> negative;
+  std::vector<const query::PriceRange *> ranges;
+  for (const auto &child : node.children) {
+    if (child.kind == Kind::kNot)
+      negative.push_back(&child.children[0]);
+    else if (child.kind == Kind::kPrice)
+      ranges.push_back(&child.price);
+    else
+      positive.push_back(EvaluateNode(reader, child));
+  }
+  std::sort(positive.begin(), positive.end(),
+            [](const index::RoaringBitmap &a, const index::RoaringBitmap &b) {
+              return a.Cardinality() < b.Cardinality();
+            });
+  index::RoaringBitmap out =
+      positive.empty() ? reader.All() : std::move(positive[0]);
+  for (size_t i = 1; i < positive.size() && !out.empty(); ++i)
+    out = index::RoaringBitmap::And(out, positive[i]);
+  for (size_t i = 0; i < ranges.size() && !out.empty(); ++i)
+    out = RestrictPrice(reader, *ranges[i], out);
+  for (size_t i = 0; i < negative.size() && !out.empty(); ++i)
+    out = index::RoaringBitmap::AndNot(out, EvaluateNode(reader, *negative[i]));
+  return out;
+}
+
+index::RoaringBitmap Evaluate(const index::IndexReader &reader,
+                              const query::Node &query) {
+  ScopedSpan span(Stage::kSearch);
+  return EvaluateNode(reader, query);
+}
+
+size_t CountMatches(const index::RoaringBitmap &matches) {
+  ScopedSpan span(Stage::kCount);
+  return matches.Cardinality();
+}
+
+std::string PageJson(const std::vector<index::DocView> &page,
+                     std::chrono::high_resolution_clock::time_point start) {
+  ScopedSpan span(Stage::kSerialize);
+  std::string json;
+  StartItems(&json);
+  for (size_t i = 0; i < page.size(); ++i) {
+    if (i != 0)
+      json += ",";
+    AppendItemJson(&json, page[i].title, page[i].price, page[i].image_url);
+  }
+  FinishItems(&json, start);
+  return json;
+}
+
+std::string PageJson(const index::IndexReader &reader,
+                     const std::vector<uint32_t> &page,
+                     std::chrono::high_resolution_clock::time_point start) {
+  std::vector<index::DocView> docs;
+  docs.reserve(page.size());
+  for (uint32_t ordinal : page)
+    docs.push_back(reader.doc(ordinal));
+  return PageJson(docs, start);
+}
+
+Database::PriceAggregates ToAggregates(const index::PriceSummary &summary) {
+  Database::PriceAggregates agg{};
+  if (summary.count == 0)
+    return agg;
+  agg.avg = summary.sum / summary.count;
+  agg.min = summary.min;
+  agg.max = summary.max;
+  return agg;
+}
+
+Database::PriceAggregates Aggregate(const index::IndexReader &reader,
+                                    const index::RoaringBitmap &matches) {
+  ScopedSpan span(Stage::kAggregate);
+  return ToAggregates(reader.SummarizePrices(matches));
+}
+
+// Counts the facets of matches into counter in one pass over them, then
+// names the codes from the reader's dictionaries.
+void AddFacets(const index::IndexReader &reader,
+               const index::RoaringBitmap &matches, FacetCounter *counter) {
+  index::FacetView brand = reader.Facet(index::FacetField::kBrand);
+  index::FacetView category = reader.Facet(index::FacetField::kCategory);
+  const double *prices = reader.Prices();
+  matches.ForEachBlock([&](const uint32_t *ordinals, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      uint32_t o = ordinals[i];
+      counter->Add(brand.codes[o], category.codes[o], prices[o]);
+    }
+  });
+  counter->Flush([&](unsigned facet, uint32_t code) {
+    const index::FacetView &view =
+        facet == Database::kFacetBrand ? brand : category;
+    return code < view.value_count ? view.value(code) : std::string_view();
+  });
+}
+
+Database::Facets CountFacets(const index::IndexReader &reader,
+                             const index::RoaringBitmap &matches,
+                             unsigned facets) {
+  if (facets == 0)
+    return Database::Facets();
+  ScopedSpan span(Stage::kAggregate);
+  FacetCounter counter(facets);
+  AddFacets(reader, matches, &counter);
+  return counter.Finish();
+}
+
+// Matches of a query in one layer of a live index, shadowed versions
+// already removed.
+struct LayerMatches {
+  const index::LiveIndex::Layer *layer;
+  index::RoaringBitmap matches;
+};
+
+std::vector<LayerMatches> EvaluateLayers(const index::LiveIndex::View &view,
+                                         const query::Node &query) {
+  ScopedSpan span(Stage::kSearch);
+  std::vector<LayerMatches> out;
+  for (const auto &layer : view.layers) {
+    out.push_back(LayerMatches{
+        &layer, index::RoaringBitmap::AndNot(EvaluateNode(*layer.reader, query),
+                                             *layer.dead)});
+  }
+  return out;
+}
+
+size_t CountLayers(const std::vector<LayerMatches> &layers) {
+  ScopedSpan span(Stage::kCount);
+  size_t n = 0;
+  for (const auto &lm : layers)
+    n += lm.matches.Cardinality();
+  return n;
+}
+
+Database::PriceAggregates
+AggregateLayers(const std::vector<LayerMatches> &layers) {
+  ScopedSpan span(Stage::kAggregate);
+  index::PriceSummary total;
+  for (const auto &lm : layers) {
+    index::PriceSummary s = lm.layer->reader->SummarizePrices(lm.matches);
+    if (s.count == 0)
+      continue;
+    total.min = total.count == 0 ? s.min : std::min(total.min, s.min);
+    total.max = total.count == 0 ? s.max : std::max(total.max, s.max);
+    total.count += s.count;
+    total.sum += s.sum;
+  }
+  return ToAggregates(total);
+}
+
+// Layers number their dictionaries apart, so each is flushed by name.
+Database::Facets FacetLayers(const std::vector<LayerMatches> &layers,
+                             unsigned facets) {
+  if (facets == 0)
+    return Database::Facets();
+  ScopedSpan span(Stage::kAggregate);
+  FacetCounter counter(facets);
+  for (const auto &lm : layers)
+    AddFacets(*lm.layer->reader, lm.matches, &counter);
+  return counter.Finish();
+}
+
+// The matches ranked offset .. offset + limit among those with an id above
+// after_id, in id order across layers. Only the base is id-ordered; delta
+// matches are few enough to collect and sort.
+std::vector<index::DocView> PageLayers(const std::vector<LayerMatches> &layers,
+                                       int64_t after_id, size_t offset,
+                                       size_t limit) {
+  ScopedSpan span(Stage::kSearch);
+  std::vector<index::DocView> docs;
+  for (const auto &lm : layers) {
+    const index::IndexReader &reader = *lm.layer->reader;
+    if (lm.layer->id_ordered) {
+      for (uint32_t ordinal : lm.matches.SliceFrom(
+               reader.OrdinalAfter(after_id), offset + limit))
+        docs.push_back(reader.doc(ordinal));
+      continue;
+    }
+    lm.matches.ForEachBlock([&](const uint32_t *ordinals, size_t n) {
+      for (size_t i = 0; i < n; ++i) {
+        index::DocView doc = reader.doc(ordinals[i]);
+        if (doc.id > after_id)
+          docs.push_back(doc);
+      }
+    });
+  }
+  std::sort(docs.begin(), docs.end(),
+            [](const index::DocView &a, const index::DocView &b) {
+              return a.id < b.id;
+            });
+  if (docs.size() <= offset)
+    return {};
+  docs.erase(docs.begin(), docs.begin() + offset);
+  if (docs.size() > limit)
+    docs.resize(limit);
+  return docs;
+}
+
+// One layer's share of a ranked search: its matches with shadowed
+// versions removed, and the dead bitmap to apply to term matches.
+struct RankLayer {
+  const index::IndexReader *reader;
+  const index::RoaringBitmap *matches;
+  const index::RoaringBitmap *dead;
+  bool id_ordered;
+};
+
+// The matches ranked offset .. offset + limit by BM25. Length classes are
+// visited shortest first, and the walk ends once no title of the next
+// length could beat the k-th best score. A uniform query needs no term
+// weights: every match of a class scores the same, so an id-ordered layer
+// only decodes its first k. Titles in the last class score as if they
+// had its length.
+std::vector<index::DocView> RankPage(const std::vector<RankLayer> &layers,
+                                     const ranking::ScoringTerms &scoring,
+                                     size_t offset, size_t limit) {
+  ScopedSpan span(Stage::kSearch);
+  size_t k = offset + limit;
+  uint64_t docs = 0, length = 0, size = 0;
+  for (const auto &layer : layers) {
+    size += layer.reader->size();
+    docs += layer.reader->size() - (layer.dead ? layer.dead->Cardinality() : 0);
+    length += layer.reader->Lengths().total;
+  }
+  // The average counts shadowed versions too; they are few.
+  ranking::Bm25 bm25(docs, size ? static_cast<double>(length) / size : 0);
+
+  // term_matches[layer][term], and the weight of each term.
+  std::vector<std::vector<index::RoaringBitmap>> term_matches(layers.size());
+  std::vector<double> idf;
+  double weight = 1;
+  if (!scoring.uniform) {
+    weight = 0;
+    for (const auto &term : scoring.terms) {
+      uint64_t df = 0;
+      for (size_t l = 0; l < layers.size(); ++l) {
+        index::RoaringBitmap m = layers[l].reader->Match(term);
+        if (layers[l].dead)
+          m = index::RoaringBitmap::AndNot(m, *layers[l].dead);
+        df += m.Cardinality();
+        term_matches[l].push_back(std::move(m));
+      }
+      idf.push_back(bm25.Idf(df));
+      weight += idf.back();
+    }
+  }
+
+  size_t candidates = 0;
+  for (const auto &layer : layers)
+    candidates += layer.matches->Cardinality();
+  ranking::TopK<index::DocView> top(k, candidates);
+  std::vector<uint32_t> ordinals;
+  std::vector<double> sums;
+  for (size_t n = 0; n < index::TitleLengths::kClasses; ++n) {
+    double norm = bm25.LengthNorm(static_cast<double>(n));
+    if (top.full() && norm * weight < top.threshold())
+      break;
+    for (size_t l = 0; l < layers.size(); ++l) {
+      const RankLayer &layer = layers[l];
+      const auto &classes = layer.reader->Lengths().classes;
+      if (classes.empty() || classes[n].empty())
+        continue;
+      index::RoaringBitmap in_class =
+          index::RoaringBitmap::And(*layer.matches, classes[n]);
+      if (in_class.empty())
+        continue;
+      if (scoring.uniform && layer.id_ordered) {
+        ordinals = in_class.Slice(0, k);
+      } else {
+        ordinals.clear();
+        in_class.ForEachBlock([&](const uint32_t *ords, size_t count) {
+          ordinals.insert(ordinals.end(), ords, ords + count);
+        });
+      }
+      sums.assign(ordinals.size(), weight);
+      if (!scoring.uniform) {
+        // Sum the weights of the terms each document contains, merging
+        // the sorted ordinals with each term's matches in the class.
+        std::fill(sums.begin(), sums.end(), 0);
+        for (size_t t = 0; t < idf.size(); ++t) {
+          size_t i = 0;
+          index::RoaringBitmap::And(in_class, term_matches[l][t])
+              .ForEachBlock([&](const uint32_t *ords, size_t count) {
+                for (size_t j = 0; j < count; ++j) {
+                  while (ordinals[i] < ords[j])
+                    ++i;
+                  sums[i] += idf[t];
+                }
+              });
+        }
+      }
+      for (size_t i = 0; i < ordinals.size(); ++i) {
+        double score = norm * sums[i];
+        if (top.full() && score < top.threshold())
+          continue;
+        index::DocView doc = layer.reader->doc(ordinals[i]);
+        top.Push(score, doc.id, doc);
+      }
+    }
+  }
+  std::vector<index::DocView> page = top.Take();
+  if (page.size() <= offset)
+    return {};
+  page.erase(page.begin(), page.begin() + offset);
+  return page;
+}
+
+// The price range every match of the query lies in: the intersection of
+// its top-level price clauses.
+query::PriceRange PriceBounds(const query::Node &query) {
+  using Kind = query::Node::Kind;
+  query::PriceRange bounds;
+  if (query.kind == Kind::kPrice)
+    return query.price;
+  if (query.kind != Kind::kAnd)
+    return bounds;
+  for (const auto &child : query.children) {
+    if (child.kind != Kind::kPrice)
+      continue;
+    bounds.min = std::max(bounds.min, child.price.min);
+    bounds.max = std::min(bounds.max, child.price.max);
+  }
+  return bounds;
+}
+
+// The matches ranked offset .. offset + limit by price, cheapest first or,
+// descending, dearest first; equal prices go by id in the same direction.
+// Each layer walks the run of its price order within bounds from that end,
+// probing its matches, and stops at its k-th match once the rest of that
+// price is in. A layer whose matches are too sparse for the walk to end
+// early, at about k * run / matches probes, collects them and selects the
+// first k instead. An offset past every match returns at once.
+std::vector<index::DocView> PricePage(const std::vector<RankLayer> &layers,
+                                      const query::PriceRange &bounds,
+                                      bool descending, size_t offset,
+                                      size_t limit) {
+  ScopedSpan span(Stage::kSearch);
+  size_t k = offset + limit;
+  size_t total = 0;
+  for (const auto &layer : layers)
+    total += layer.matches->Cardinality();
+  if (total <= offset)
+    return {};
+  std::vector<index::DocView> docs;
+  std::vector<uint32_t> picked;
+  for (const auto &layer : layers) {
+    const index::IndexReader &reader = *layer.reader;
+    const double *prices = reader.Prices();
+    size_t matches = layer.matches->Cardinality();
+    if (matches == 0 || k == 0)
+      continue;
+    picked.clear();
+    const index::PriceOrder &order = reader.ByPrice();
+    std::pair<size_t, size_t> run = order.Range(prices, bounds.min, bounds.max);
+    size_t length = run.second - run.first;
+    if (k * length <= matches * matches) {
+      for (size_t i = 0; i < length; ++i) {
+        uint32_t ordinal =
+            order[descending ? run.second - 1 - i : run.first + i];
+        if (picked.size() >= k && prices[ordinal] != prices[picked.back()])
+          break;
+        if (layer.matches->Contains(ordinal))
+          picked.push_back(ordinal);
+      }
+    } else {
+      layer.matches->ForEachBlock([&](const uint32_t *ordinals, size_t n) {
+        picked.insert(picked.end(), ordinals, ordinals + n);
+      });
+      if (picked.size() > k) {
+        std::nth_element(picked.begin(), picked.begin() + (k - 1),
+                         picked.end(), [&](uint32_t a, uint32_t b) {
+                           return descending ? prices[a] > prices[b]
+                                             : prices[a] < prices[b];
+                         });
+        double last = prices[picked[k - 1]];
+        picked.erase(std::partition(picked.begin() + k, picked.end(),
+                                    [&](uint32_t o) { return prices[o] == last; }),
+                     picked.end());
+      }
+    }
+    for (uint32_t ordinal : picked)
+      docs.push_back(reader.doc(ordinal));
+  }
+  std::sort(docs.begin(), docs.end(),
+            [descending](const index::DocView &a, const index::DocView &b) {
+              if (a.price != b.price)
+                return descending ? a.price > b.price : a.price < b.price;
+              return descending ? a.id > b.id : a.id < b.id;
+            });
+  if (docs.size() <= offset)
+    return {};
+  docs.erase(docs.begin(), docs.begin() + offset);
+  if (docs.size() > limit)
+    docs.resize(limit);
+  return docs;
+}
+
+} // namespace
+
+// Answers searches by evaluating the query tree over an index; subclasses
+// say where the index comes from and how it is kept stable during a read.
+class IndexReadDatabase : public Database {
+public:
+  std::string Search(const query::Node &query, int limit, int offset) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    Snapshot snap = Read();
+    return PageJson(*snap.reader,
+                    Evaluate(*snap.reader, query).Slice(offset, limit), start);
+  }
+
+  int Count(const query::Node &query) override {
+    Snapshot snap = Read();
+    return static_cast<int>(CountMatches(Evaluate(*snap.reader, query)));
+  }
+
+  PriceAggregates PriceStats(const query::Node &query) override {
+    Snapshot snap = Read();
+    return Aggregate(*snap.reader, Evaluate(*snap.reader, query));
+  }
+
+  SearchResult SearchWithStats(const query::Node &query, int limit,
+                               int offset, unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    Snapshot snap = Read();
+    index::RoaringBitmap matches = Evaluate(*snap.reader, query);
+    SearchResult result;
+    result.total = static_cast<int>(CountMatches(matches));
+    result.price = Aggregate(*snap.reader, matches);
+    result.facets = CountFacets(*snap.reader, matches, facets);
+    result.items = PageJson(*snap.reader, matches.Slice(offset, limit), start);
+    return result;
+  }
+
+  SearchResult SearchRanked(const query::Node &query, int limit, int offset,
+                            bool with_stats, unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    Snapshot snap = Read();
+    index::RoaringBitmap matches = Evaluate(*snap.reader, query);
+    SearchResult result;
+    if (with_stats) {
+      result.total = static_cast<int>(CountMatches(matches));
+      result.price = Aggregate(*snap.reader, matches);
+      result.facets = CountFacets(*snap.reader, matches, facets);
+    }
+    ranking::ScoringTerms scoring = ranking::CollectScoringTerms(query);
+    if (scoring.terms.empty()) {
+      result.items =
+          PageJson(*snap.reader, matches.Slice(offset, limit), start);
+      return result;
+    }
+    result.items = PageJson(
+        RankPage({RankLayer{snap.reader, &matches, nullptr, true}}, scoring,
+                 offset, limit),
+        start);
+    return result;
+  }
+
+  SearchResult SearchAfter(const query::Node &query, int limit,
+                           int64_t after_id, bool with_stats,
+                           unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    int offset = 0;
+    ClampPage(&limit, &offset);
+    Snapshot snap = Read();
+    index::RoaringBitmap matches = Evaluate(*snap.reader, query);
+    SearchResult result;
+    if (with_stats) {
+      result.total = static_cast<int>(CountMatches(matches));
+      result.price = Aggregate(*snap.reader, matches);
+      result.facets = CountFacets(*snap.reader, matches, facets);
+    }
+    // Ordinals follow id order, so the cursor maps to an ordinal bound.
+    std::vector<uint32_t> page =
+        matches.SliceFrom(snap.reader->OrdinalAfter(after_id), limit);
+    if (!page.empty())
+      result.last_id = snap.reader->doc(page.back()).id;
+    result.items = PageJson(*snap.reader, page, start);
+    return result;
+  }
+
+  SearchResult SearchByPrice(const query::Node &query, int limit, int offset,
+                             bool descending, bool with_stats,
+                             unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    Snapshot snap = Read();
+    index::RoaringBitmap matches = Evaluate(*snap.reader, query);
+    SearchResult result;
+    if (with_stats) {
+      result.total = static_cast<int>(CountMatches(matches));
+      result.price = Aggregate(*snap.reader, matches);
+      result.facets = CountFacets(*snap.reader, matches, facets);
+    }
+    result.items = PageJson(
+        PricePage({RankLayer{snap.reader, &matches, nullptr, true}},
+                  PriceBounds(query), descending, offset, limit),
+        start);
+    return result;
+  }
+
+protected:
+  // The index to read and, for a mutable one, the lock that keeps it
+  // unchanged until the snapshot goes away.
+  struct Snapshot {
+    const index::IndexReader *reader;
+    std::shared_lock<std::shared_mutex> lock;
+  };
+  virtual Snapshot Read() = 0;
+};
+
+// Serves reads from an in-memory n-gram index over the items of a backing
+// store. Writes go to the store and mark the index stale; the next read
+// catches up, appending new rows or rebuilding off-lock and swapping.
+class IndexDatabase : public IndexReadDatabase {
+public:
+  explicit IndexDatabase(std::unique_ptr<Database> store)
+      : store_(std::move(store)),
+        index_(std::make_unique<index::NgramIndex>()) {}
+
+  bool Execute(const std::string &query) override {
+    bool ok = store_->Execute(query);
+    if (ok) {
+      WriteKind kind = ClassifyWrite(query);
+      MarkStale(kind);
+      BumpWriteGeneration(kind);
+    }
+    return ok;
+  }
+
+  bool Execute(const std::string &query,
+               const std::vector<std::string> &params) override {
+    bool ok = store_->Execute(query, params);
+    if (ok) {
+      WriteKind kind = ClassifyWrite(query);
+      MarkStale(kind);
+      BumpWriteGeneration(kind);
+    }
+    return ok;
+  }
+
+  bool BulkInsert(const std::vector<Item> &items, const BulkOptions &options,
+                  BulkResult *result) override {
+    bool ok = store_->BulkInsert(items, options, result);
+    // Items without an id get new, larger ones; any id may rewrite a row.
+    bool rewrites = std::any_of(items.begin(), items.end(),
+                                [](const Item &item) { return item.id > 0; });
+    WriteKind kind = rewrites ? WriteKind::kRewrite : WriteKind::kAppend;
+    MarkStale(kind);
+    BumpWriteGeneration(kind);
+    return ok;
+  }
+
+  void ScanItems(int64_t after_id,
+                 const std::function<void(Item &&)> &visit) override {
+    store_->ScanItems(after_id, visit);
+  }
+
+  std::vector<std::string> SchemaMigrations() const override {
+    return store_->SchemaMigrations();
+  }
+
+protected:
+  Snapshot Read() override {
+    Sync();
+    std::shared_lock<std::shared_mutex> lock(index_mu_);
+    const index::IndexReader *reader = index_.get();
+    return Snapshot{reader, std::move(lock)};
+  }
+
+private:
+  // staleness_ holds the widest WriteKind since the last Sync.
+  void MarkStale(WriteKind kind) {
+    int level = static_cast<int>(kind);
+    int current = staleness_.load();
+    while (current < level &&
+           !staleness_.compare_exchange_weak(current, level)) {
+    }
+  }
+
+  void Sync() {
+    if (staleness_.load(std::memory_order_acquire) ==
+        static_cast<int>(WriteKind::kNone))
+      return;
+    std::lock_guard<std::mutex> sync_lock(sync_mu_);
+    auto level =
+        static_cast<WriteKind>(staleness_.exchange(static_cast<int>(WriteKind::kNone)));
+    if (level == WriteKind::kRewrite) {
+      auto fresh = std::make_unique<index::NgramIndex>();
+      store_->ScanItems(
+          0, [&](Item &&item) { fresh->Add(ToDocument(std::move(item))); });
+      std::unique_lock<std::shared_mutex> lock(index_mu_);
+      index_ = std::move(fresh);
+    } else if (level == WriteKind::kAppend) {
+      // Only this thread mutates the index, so max_id() is stable here.
+      std::vector<index::Document> rows;
+      store_->ScanItems(index_->max_id(), [&](Item &&item) {
+        rows.push_back(ToDocument(std::move(item)));
+      });
+      std::unique_lock<std::shared_mutex> lock(index_mu_);
+      for (auto &doc : rows) {
+        index_->Add(std::move(doc));
+      }
+    }
+  }
+
+  std::unique_ptr<Database> store_;
+  std::mutex sync_mu_;
+  std::shared_mutex index_mu_;
+  std::unique_ptr<index::NgramIndex> index_;
+  std::atomic<int> staleness_{static_cast<int>(WriteKind::kRewrite)};
+};
+
+// Serves a prebuilt, immutable segment file straight from mmap (see
+// Builder::BuildOffline). Nothing is loaded up front; pages fault in as
+// queries touch them. Writes are refused.
+class SegmentDatabase : public IndexReadDatabase {
+public:
+  explicit SegmentDatabase(std::unique_ptr<index::SegmentReader> segment)
+      : segment_(std::move(segment)) {}
+
+  bool Execute(const std::string &) override { return ReadOnlyError(); }
+  bool Execute(const std::string &, const std::vector<std::string> &) override {
+    return ReadOnlyError();
+  }
+
+  void ScanItems(int64_t after_id,
+                 const std::function<void(Item &&)> &visit) override {
+    for (uint32_t i = segment_->OrdinalAfter(after_id); i < segment_->size();
+         ++i) {
+      index::DocView doc = segment_->doc(i);
+      visit(Item{doc.id, std::string(doc.title), doc.price,
+                 std::string(doc.image_url), std::string(doc.brand),
+                 std::string(doc.category)});
+    }
+  }
+
+  bool ReadOnly() const override { return true; }
+
+protected:
+  Snapshot Read() override { return Snapshot{segment_.get(), {}}; }
+
+private:
+  static bool ReadOnlyError() {
+    std::cerr << "SQL error: segment databases are read-only" << std::endl;
+    return false;
+  }
+
+  std::unique_ptr<index::SegmentReader> segment_;
+};
+
+// Serves a LiveIndex fed from an event topic (see Builder::BuildRealtime).
+// One thread applies events as they arrive, so they are searchable within
+// a poll interval; another merges the delta into the segment file every
+// merge_ms, and once more on shutdown. Execute is refused: the topic is the
+// only way in.
+class LiveDatabase : public Database {
+public:
+  LiveDatabase(std::unique_ptr<index::LiveIndex> live,
+               std::unique_ptr<EventTopic> topic, int merge_ms)
+      : live_(std::move(live)), topic_(std::move(topic)),
+        merge_ms_(merge_ms) {
+    ingest_thread_ = std::thread([this] { IngestLoop(); });
+    merge_thread_ = std::thread([this] { MergeLoop(); });
+  }
+
+  ~LiveDatabase() override {
+    topic_->Stop();
+    ingest_thread_.join();
+    {
+      std::lock_guard<std::mutex> lock(merge_mu_);
+      stopping_ = true;
+    }
+    merge_cv_.notify_all();
+    merge_thread_.join();
+    MergeOnce();
+  }
+
+  bool Execute(const std::string &) override { return ReadOnlyError(); }
+  bool Execute(const std::string &, const std::vector<std::string> &) override {
+    return ReadOnlyError();
+  }
+
+  std::string Search(const query::Node &query, int limit, int offset) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    index::LiveIndex::View view = live_->Read();
+    return PageJson(
+        PageLayers(EvaluateLayers(view, query), INT64_MIN, offset, limit),
+        start);
+  }
+
+  int Count(const query::Node &query) override {
+    index::LiveIndex::View view = live_->Read();
+    return static_cast<int>(CountLayers(EvaluateLayers(view, query)));
+  }
+
+  PriceAggregates PriceStats(const query::Node &query) override {
+    index::LiveIndex::View view = live_->Read();
+    return AggregateLayers(EvaluateLayers(view, query));
+  }
+
+  SearchResult SearchWithStats(const query::Node &query, int limit,
+                               int offset, unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    index::LiveIndex::View view = live_->Read();
+    std::vector<LayerMatches> layers = EvaluateLayers(view, query);
+    SearchResult result;
+    result.total = static_cast<int>(CountLayers(layers));
+    result.price = AggregateLayers(layers);
+    result.facets = FacetLayers(layers, facets);
+    result.items =
+        PageJson(PageLayers(layers, INT64_MIN, offset, limit), start);
+    return result;
+  }
+
+  SearchResult SearchRanked(const query::Node &query, int limit, int offset,
+                            bool with_stats, unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    index::LiveIndex::View view = live_->Read();
+    std::vector<LayerMatches> layers = EvaluateLayers(view, query);
+    SearchResult result;
+    if (with_stats) {
+      result.total = static_cast<int>(CountLayers(layers));
+      result.price = AggregateLayers(layers);
+      result.facets = FacetLayers(layers, facets);
+    }
+    ranking::ScoringTerms scoring = ranking::CollectScoringTerms(query);
+    if (scoring.terms.empty()) {
+      result.items =
+          PageJson(PageLayers(layers, INT64_MIN, offset, limit), start);
+      return result;
+    }
+    std::vector<RankLayer> rank_layers;
+    for (const auto &lm : layers) {
+      rank_layers.push_back(RankLayer{lm.layer->reader, &lm.matches,
+                                      lm.layer->dead, lm.layer->id_ordered});
+    }
+    result.items =
+        PageJson(RankPage(rank_layers, scoring, offset, limit), start);
+    return result;
+  }
+
+  SearchResult SearchAfter(const query::Node &query, int limit,
+                           int64_t after_id, bool with_stats,
+                           unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    int offset = 0;
+    ClampPage(&limit, &offset);
+    index::LiveIndex::View view = live_->Read();
+    std::vector<LayerMatches> layers = EvaluateLayers(view, query);
+    SearchResult result;
+    if (with_stats) {
+      result.total = static_cast<int>(CountLayers(layers));
+      result.price = AggregateLayers(layers);
+      result.facets = FacetLayers(layers, facets);
+    }
+    std::vector<index::DocView> page = PageLayers(layers, after_id, 0, limit);
+    if (!page.empty())
+      result.last_id = page.back().id;
+    result.items = PageJson(page, start);
+    return result;
+  }
+
+  SearchResult SearchByPrice(const query::Node &query, int limit, int offset,
+                             bool descending, bool with_stats,
+                             unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    index::LiveIndex::View view = live_->Read();
+    std::vector<LayerMatches> layers = EvaluateLayers(view, query);
+    SearchResult result;
+    if (with_stats) {
+      result.total = static_cast<int>(CountLayers(layers));
+      result.price = AggregateLayers(layers);
+      result.facets = FacetLayers(layers, facets);
+    }
+    std::vector<RankLayer> price_layers;
+    for (const auto &lm : layers) {
+      price_layers.push_back(RankLayer{lm.layer->reader, &lm.matches,
+                                       lm.layer->dead, lm.layer->id_ordered});
+    }
+    result.items = PageJson(PricePage(price_layers, PriceBounds(query),
+                                      descending, offset, limit),
+                            start);
+    return result;
+  }
+
+  void ScanItems(int64_t after_id,
+                 const std::function<void(Item &&)> &visit) override {
+    index::LiveIndex::View view = live_->Read();
+    std::vector<LayerMatches> layers = EvaluateLayers(view, query::Node());
+    for (const auto &doc :
+         PageLayers(layers, after_id, 0, CountLayers(layers))) {
+      visit(Item{doc.id, std::string(doc.title), doc.price,
+                 std::string(doc.image_url), std::string(doc.brand),
+                 std::string(doc.category)});
+    }
+  }
+
+  bool ReadOnly() const override { return true; }
+
+private:
+  static bool ReadOnlyError() {
+    std::cerr << "SQL error: live databases only change through their topic"
+              << std::endl;
+    return false;
+  }
+
+  void IngestLoop() {
+    using observability::Metrics;
+    std::string line;
+    ItemEvent event;
+    while (topic_->Next(&line)) {
+      if (!ParseItemEvent(line, &event)) {
+        Metrics::ingest_errors.fetch_add(1);
+        std::cerr << "Invalid ingest event: " << line << std::endl;
+        continue;
+      }
+      if (event.op == ItemEvent::Op::kDelete)
+        live_->Delete(event.item.id);
+      else
+        live_->Upsert(ToDocument(std::move(event.item)));
+      BumpWriteGeneration();
+      Metrics::ingest_events.fetch_add(1);
+      Metrics::delta_ids.store(static_cast<long>(live_->delta_size()));
+      if (event.ts_ms > 0) {
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+        Metrics::ingest_lag_ms.store(
+            static_cast<long>(std::max<int64_t>(0, now - event.ts_ms)));
+      }
+    }
+  }
+
+  void MergeLoop() {
+    std::unique_lock<std::mutex> lock(merge_mu_);
+    while (!merge_cv_.wait_for(lock, std::chrono::milliseconds(merge_ms_),
+                               [this] { return stopping_; })) {
+      lock.unlock();
+      MergeOnce();
+      lock.lock();
+    }
+  }
+
+  void MergeOnce() {
+    using observability::Metrics;
+    if (live_->delta_size() == 0)
+      return;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = live_->Merge();
+    long ms = static_cast<long>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+    if (!ok) {
+      Metrics::merge_failures.fetch_add(1);
+      return;
+    }
+    Metrics::merges.fetch_add(1);
+    Metrics::last_merge_ms.store(ms);
+    Metrics::total_merge_ms.fetch_add(ms);
+    Metrics::delta_ids.store(static_cast<long>(live_->delta_size()));
+  }
+
+  std::unique_ptr<index::LiveIndex> live_;
+  std::unique_ptr<EventTopic> topic_;
+  const int merge_ms_;
+  std::thread ingest_thread_;
+  std::thread merge_thread_;
+  std::mutex merge_mu_;
+  std::condition_variable merge_cv_;
+  bool stopping_{false};
+};
+
+std::unique_ptr<Database> CreateIndexDatabase(const std::string &spec) {
+  // A bare filename is shorthand for an SQLite store.
+  std::string store_spec =
+      spec.rfind("sqlite:", 0) == 0 ? spec : "sqlite:" + spec;
+  auto store = Database::Create(store_spec);
+  if (!store) {
+    return nullptr;
+  }
+  return std::make_unique<IndexDatabase>(std::move(store));
+}
+
+std::unique_ptr<Database> CreateSegmentDatabase(const std::string &spec) {
+  size_t qm = spec.find('?');
+  std::string path = spec.substr(0, qm);
+  bool verify = false;
+  if (qm != std::string::npos) {
+    std::string options = spec.substr(qm + 1);
+    if (options != "verify=1" && options != "verify=0") {
+      std::cerr << "Unknown segment option: " << options << std::endl;
+      return nullptr;
+    }
+    verify = options == "verify=1";
+  }
+  auto segment = index::SegmentReader::Open(path, verify);
+  if (!segment) {
+    return nullptr;
+  }
+  return std::make_unique<SegmentDatabase>(std::move(segment));
+}
+
+std::unique_ptr<Database> CreateLiveDatabase(const std::string &spec) {
+  size_t qm = spec.find('?');
+  std::string path = spec.substr(0, qm);
+  std::string topic;
+  int merge_ms = 10000;
+  if (qm != std::string::npos) {
+    size_t pos = qm + 1;
+    while (pos <= spec.size()) {
+      size_t amp = spec.find('&', pos);
+      if (amp == std::string::npos)
+        amp = spec.size();
+      std::string option = spec.substr(pos, amp - pos);
+      if (option.rfind("topic=", 0) == 0) {
+        topic = option.substr(6);
+      } else if (option.rfind("merge_ms=", 0) == 0) {
+        merge_ms = std::max(1, std::atoi(option.c_str() + 9));
+      } else {
+        std::cerr << "Unknown live option: " << option << std::endl;
+        return nullptr;
+      }
+      pos = amp + 1;
+    }
+  }
+  if (topic.empty()) {
+    std::cerr << "live: needs a topic, e.g. live:items.seg?topic=events.jsonl"
+              << std::endl;
+    return nullptr;
+  }
+  auto live = index::LiveIndex::Open(path);
+  if (!live) {
+    return nullptr;
+  }
+  auto events = EventTopic::Open(topic);
+  if (!events) {
+    return nullptr;
+  }
+  return std::make_unique<LiveDatabase>(std::move(live), std::move(events),
+                                        merge_ms);
+}
+
+} // namespace database
+} // namespace epiphany
@@ -0,0 +1,308 @@
+#include "epiphany/database/item_json.h"
+#include "epiphany/database/json_writer.h"
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace epiphany {
+namespace database {
+
+namespace {
+
+// Minimal reader for the flat objects ParseItemJson accepts.
+class JsonCursor {
+public:
+  explicit JsonCursor(std::string_view in) : in_(in) {}
+
+  void SkipSpace() {
+    while (pos_ < in_.size() && (in_[pos_] == ' ' || in_[pos_] == '\t' ||
+                                 in_[pos_] == '\r' || in_[pos_] == '\n'))
+      ++pos_;
+  }
+  bool Consume(char c) {
+    SkipSpace();
+    if (pos_ < in_.size() && in_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+  bool AtEnd() {
+    SkipSpace();
+    return pos_ == in_.size();
+  }
+  char Peek() {
+    SkipSpace();
+    return pos_ < in_.size() ? in_[pos_] : '\0';
+  }
+
+  bool String(std::string *out) {
+    if (!Consume('"'))
+      return false;
+    out->clear();
+    while (pos_ < in_.size()) {
+      char c = in_[pos_++];
+      if (c == '"')
+        return true;
+      if (c != '\\') {
+        out->push_back(c);
+        continue;
+      }
+      if (pos_ >= in_.size())
+        return false;
+      char e = in_[pos_++];
+      switch (e) {
+      case 'b':
+        out->push_back('\b');
+        break;
+      case 'f':
+        out->push_back('\f');
+        break;
+      case 'n':
+        out->push_back('\n');
+        break;
+      case 'r':
+        out->push_back('\r');
+        break;
+      case 't':
+        out->push_back('\t');
+        break;
+      case 'u': {
+        uint32_t cp;
+        if (!Hex4(&cp))
+          return false;
+        if (cp >= 0xD800 && cp < 0xDC00 && in_.substr(pos_, 2) == "\\u") {
+          pos_ += 2;
+          uint32_t low;
+          if (!Hex4(&low) || low < 0xDC00 || low >= 0xE000)
+            return false;
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        AppendUtf8(cp, out);
+        break;
+      }
+      default:
+        out->push_back(e);
+      }
+    }
+    return false;
+  }
+
+  // A finite number; 1e999 and the like are refused.
+  bool Number(double *out) {
+    SkipSpace();
+    size_t end = pos_;
+    while (end < in_.size() && std::strchr("+-0123456789.eE", in_[end]))
+      ++end;
+    if (end == pos_)
+      return false;
+    std::string text(in_.substr(pos_, end - pos_));
+    char *parsed = nullptr;
+    *out = std::strtod(text.c_str(), &parsed);
+    if (parsed != text.c_str() + text.size() || !std::isfinite(*out))
+      return false;
+    pos_ = end;
+    return true;
+  }
+
+  // A whole number within int64_t; fractions, exponents and out-of-range
+  // values are refused rather than rounded.
+  bool Integer(int64_t *out) {
+    SkipSpace();
+    const char *begin = in_.data() + pos_;
+    const char *end = in_.data() + in_.size();
+    auto [ptr, ec] = std::from_chars(begin, end, *out);
+    if (ec != std::errc() || (ptr != end && std::strchr(".eE", *ptr)))
+      return false;
+    pos_ += static_cast<size_t>(ptr - begin);
+    return true;
+  }
+
+  // Skips any value, nested objects and arrays included. Nesting deeper
+  // than kMaxDepth is refused rather than recursed into.
+  bool SkipValue(int depth = 0) {
+    char c = Peek();
+    std::string s;
+    double d;
+    if (c == '"')
+      return String(&s);
+    if (c == '{' || c == '[') {
+      if (depth >= kMaxDepth)
+        return false;
+      char close = c == '{' ? '}' : ']';
+      ++pos_;
+      if (Consume(close))
+        return true;
+      do {
+        if (c == '{' && (!String(&s) || !Consume(':')))
+          return false;
+        if (!SkipValue(depth + 1))
+          return false;
+      } while (Consume(','));
+      return Consume(close);
+    }
+    for (const char *word : {"true", "false", "null"}) {
+      if (in_.substr(pos_, std::strlen(word)) == word) {
+        pos_ += std::strlen(word);
+        return true;
+      }
+    }
+    return Number(&d);
+  }
+
+private:
+  static constexpr int kMaxDepth = 64;
+
+  bool Hex4(uint32_t *out) {
+    if (pos_ + 4 > in_.size())
+      return false;
+    *out = 0;
+    for (int i = 0; i < 4; ++i) {
+      char h = in_[pos_++];
+      *out <<= 4;
+      if (h >= '0' && h <= '9')
+        *out |= h - '0';
+      else if (h >= 'a' && h <= 'f')
+        *out |= h - 'a' + 10;
+      else if (h >= 'A' && h <= 'F')
+        *out |= h - 'A' + 10;
+      else
+        return false;
+    }
+    return true;
+  }
+
+  static void AppendUtf8(uint32_t cp, std::string *out) {
+    if (cp < 0x80) {
+      out->push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+      out->push_back(static_cast<char>(0xC0 | (cp >> 6)));
+      out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      out->push_back(static_cast<char>(0xE0 | (cp >> 12)));
+      out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+      out->push_back(static_cast<char>(0xF0 | (cp >> 18)));
+      out->push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+  }
+
+  std::string_view in_;
+  size_t pos_{0};
+};
+
+// Reads one flat object. Item members go to item; "op" and "ts" go to op
+// and ts when those are given and are skipped otherwise, like any other
+// member.
+bool ParseObject(std::string_view json, Database::Item *item, bool *has_title,
+                 std::string *op, double *ts) {
+  JsonCursor in(json);
+  *item = Database::Item();
+  *has_title = false;
+  if (!in.Consume('{'))
+    return false;
+  if (!in.Consume('}')) {
+    do {
+      std::string key;
+      if (!in.String(&key) || !in.Consume(':'))
+        return false;
+      double number;
+      bool ok;
+      if (key == "id") {
+        ok = in.Integer(&item->id);
+      } else if (key == "price") {
+        ok = in.Number(&number);
+        item->price = number;
+      } else if (key == "title") {
+        ok = in.String(&item->title);
+        *has_title = ok;
+      } else if (key == "image_url") {
+        ok = in.Peek() == 'n' ? in.SkipValue() : in.String(&item->image_url);
+      } else if (key == "brand") {
+        ok = in.Peek() == 'n' ? in.SkipValue() : in.String(&item->brand);
+      } else if (key == "category") {
+        ok = in.Peek() == 'n' ? in.SkipValue() : in.String(&item->category);
+      } else if (key == "op" && op) {
+        ok = in.String(op);
+      } else if (key == "ts" && ts) {
+        ok = in.Number(ts);
+      } else {
+        ok = in.SkipValue();
+      }
+      if (!ok)
+        return false;
+    } while (in.Consume(','));
+    if (!in.Consume('}'))
+      return false;
+  }
+  return in.AtEnd();
+}
+
+} // namespace
+
+void ClampPage(int *limit, int *offset) {
+  if (*limit <= 0)
+    *limit = 10;
+  if (*limit > 100)
+    *limit = 100;
+  if (*offset < 0)
+    *offset = 0;
+  if (*offset > kMaxOffset)
+    *offset = kMaxOffset;
+}
+
+void StartItems(std::string *out) { out->append("{\"items\": ["); }
+
+void AppendItemJson(std::string *out, std::string_view title, double price,
+                    std::string_view image_url) {
+  JsonWriter(out)
+      .Raw("{\"title\":")
+      .String(title)
+      .Raw(", \"price\":")
+      .Fixed(price, 6)
+      .Raw(", \"image_url\":")
+      .String(image_url)
+      .Raw("}");
+}
+
+void FinishItems(std::string *out,
+                 std::chrono::high_resolution_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::high_resolution_clock::now() - start;
+  JsonWriter(out)
+      .Raw("], \"latency_ms\": ")
+      .Fixed(elapsed.count(), 3)
+      .Raw("}");
+}
+
+bool ParseItemJson(std::string_view json, Database::Item *item) {
+  bool has_title;
+  return ParseObject(json, item, &has_title, nullptr, nullptr) && has_title;
+}
+
+bool ParseItemEvent(std::string_view json, ItemEvent *event) {
+  *event = ItemEvent();
+  bool has_title;
+  std::string op;
+  double ts = 0;
+  if (!ParseObject(json, &event->item, &has_title, &op, &ts) ||
+      event->item.id <= 0)
+    return false;
+  // Casting a double outside int64_t's range is undefined.
+  if (!(ts >= -0x1p63 && ts < 0x1p63))
+    return false;
+  event->ts_ms = static_cast<int64_t>(ts);
+  if (op == "delete") {
+    event->op = ItemEvent::Op::kDelete;
+    return true;
+  }
+  event->op = ItemEvent::Op::kUpsert;
+  return (op == "add" || op == "update" || op == "upsert") && has_title;
+}
+
+} // namespace database
+} // namespace epiphany
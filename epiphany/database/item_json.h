@@ -0,0 +1,52 @@
+#pragma once
+#include "epiphany/database/database.h"
+#include <chrono>
+#include <string>
+#include <string_view>
+
+namespace epiphany {
+namespace database {
+
+// JSON helpers shared by the backends so every one returns byte-identical
+// search payloads.
+
+// Deepest offset a search pages to. Ranked pages keep offset + limit
+// candidates, so it bounds what one request can make a backend hold.
+constexpr int kMaxOffset = 1000000;
+
+// Normalizes a requested page to 1..100 items at an offset in
+// 0..kMaxOffset.
+void ClampPage(int *limit, int *offset);
+
+// A search payload, {"items": [...], "latency_ms": N}, is written in
+// place: StartItems opens it, AppendItemJson adds one item object (callers
+// put the commas between them) and FinishItems closes it.
+void StartItems(std::string *out);
+void AppendItemJson(std::string *out, std::string_view title, double price,
+                    std::string_view image_url);
+void FinishItems(std::string *out,
+                 std::chrono::high_resolution_clock::time_point start);
+
+// Parses one flat JSON object with "id", "title", "price", "image_url",
+// "brand" and "category" members into item; other members are skipped, a
+// missing id is left 0.
+// Returns false on malformed JSON, a missing title or an id that is not a
+// whole number within int64_t.
+bool ParseItemJson(std::string_view json, Database::Item *item);
+
+// A catalog change read from an ingest topic (see EventTopic).
+struct ItemEvent {
+  enum class Op { kUpsert, kDelete };
+  Op op{Op::kUpsert};
+  Database::Item item;
+  // Producer timestamp in milliseconds since the epoch; 0 if absent.
+  int64_t ts_ms{0};
+};
+
+// Parses {"op": "add" | "update" | "delete", "id": N, ..., "ts": ms}. Adds
+// and updates are both upserts and carry the ParseItemJson members, title
+// included; deletes only need the id. Ids must be positive.
+bool ParseItemEvent(std::string_view json, ItemEvent *event);
+
+} // namespace database
+} // namespace epiphany
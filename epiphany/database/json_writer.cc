@@ -0,0 +1,125 @@
+#include "epiphany/database/json_writer.h"
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace epiphany {
+namespace database {
+
+namespace {
+
+// Fits any double in fixed notation with the precisions used here.
+constexpr size_t kNumberBuffer = 512;
+
+bool NeedsEscape(unsigned char c) { return c == '"' || c == '\\' || c < 0x20; }
+
+} // namespace
+
+size_t JsonSafePrefix(std::string_view s) {
+  const char *p = s.data();
+  size_t n = s.size();
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    // min(v, 0x1F) == v exactly for the unsigned bytes below 0x20.
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i < n; ++i) {
+    if (NeedsEscape(static_cast<unsigned char>(p[i])))
+      return i;
+  }
+  return n;
+}
+
+JsonWriter &JsonWriter::String(std::string_view s) {
+  out_->push_back('"');
+  while (!s.empty()) {
+    size_t clean = JsonSafePrefix(s);
+    out_->append(s.data(), clean);
+    if (clean == s.size())
+      break;
+    unsigned char c = static_cast<unsigned char>(s[clean]);
+    switch (c) {
+    case '"':
+      out_->append("\\\"");
+      break;
+    case '\\':
+      out_->append("\\\\");
+      break;
+    case '\b':
+      out_->append("\\b");
+      break;
+    case '\f':
+      out_->append("\\f");
+      break;
+    case '\n':
+      out_->append("\\n");
+      break;
+    case '\r':
+      out_->append("\\r");
+      break;
+    case '\t':
+      out_->append("\\t");
+      break;
+    default: {
+      char buf[7];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out_->append(buf, 6);
+    }
+    }
+    s.remove_prefix(clean + 1);
+  }
+  out_->push_back('"');
+  return *this;
+}
+
+JsonWriter &JsonWriter::Fixed(double value, int precision) {
+  if (!std::isfinite(value))
+    return Raw("null");
+  char buf[kNumberBuffer];
+  auto r = std::to_chars(buf, buf + sizeof(buf), value,
+                         std::chars_format::fixed, precision);
+  out_->append(buf, r.ptr);
+  return *this;
+}
+
+JsonWriter &JsonWriter::General(double value) {
+  if (!std::isfinite(value))
+    return Raw("null");
+  char buf[kNumberBuffer];
+  auto r = std::to_chars(buf, buf + sizeof(buf), value,
+                         std::chars_format::general, 6);
+  out_->append(buf, r.ptr);
+  return *this;
+}
+
+JsonWriter &JsonWriter::Int(int64_t value) {
+  char buf[24];
+  auto r = std::to_chars(buf, buf + sizeof(buf), value);
+  out_->append(buf, r.ptr);
+  return *this;
+}
+
+JsonWriter &JsonWriter::Hex(uint64_t value) {
+  char buf[17];
+  auto r = std::to_chars(buf, buf + sizeof(buf), value, 16);
+  out_->append(buf, r.ptr);
+  return *this;
+}
+
+} // namespace database
+} // namespace epiphany
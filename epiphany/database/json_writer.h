@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace epiphany {
+namespace database {
+
+// Appends JSON text straight to a caller-owned buffer, so a payload grows
+// in one string instead of being glued together from per-field
+// temporaries. Numbers are formatted with std::to_chars; strings are
+// scanned 16 bytes at a time (SSE2 where available) for the characters
+// that need escaping, and clean runs are copied in one append.
+class JsonWriter {
+public:
+  explicit JsonWriter(std::string *out) : out_(out) {}
+
+  JsonWriter &Raw(std::string_view text) {
+    out_->append(text.data(), text.size());
+    return *this;
+  }
+  // s quoted and escaped.
+  JsonWriter &String(std::string_view s);
+  // As printf("%.*f", precision, value). Infinities and NaN, which JSON
+  // cannot express, are written as null, here and by General.
+  JsonWriter &Fixed(double value, int precision);
+  // As an ostream with default flags, i.e. printf("%g").
+  JsonWriter &General(double value);
+  JsonWriter &Int(int64_t value);
+  JsonWriter &Hex(uint64_t value);
+
+private:
+  std::string *out_;
+};
+
+// Length of the longest prefix of s that JSON strings can hold verbatim.
+size_t JsonSafePrefix(std::string_view s);
+
+} // namespace database
+} // namespace epiphany
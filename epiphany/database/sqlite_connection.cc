@@ -0,0 +1,79 @@
+#include "epiphany/database/sqlite_connection.h"
+#include "epiphany/database/deadline.h"
+#include "epiphany/observability/metrics.h"
+#include <iterator>
+
+namespace epiphany {
+namespace database {
+
+SqliteConnection::Statement::~Statement() {
+  if (!stmt_)
+    return;
+  if (!in_use_) {
+    sqlite3_finalize(stmt_);
+    return;
+  }
+  sqlite3_reset(stmt_);
+  sqlite3_clear_bindings(stmt_);
+  *in_use_ = false;
+}
+
+SqliteConnection::SqliteConnection(sqlite3 *db) : db_(db) {
+  sqlite3_progress_handler(db_, kDeadlineCheckOps, &CheckDeadline, nullptr);
+}
+
+int SqliteConnection::CheckDeadline(void *) {
+  return DeadlineExceeded() ? 1 : 0;
+}
+
+SqliteConnection::~SqliteConnection() {
+  for (auto &entry : cache_) {
+    sqlite3_finalize(entry.second.stmt);
+  }
+  sqlite3_close(db_);
+}
+
+SqliteConnection::Statement SqliteConnection::Prepare(const std::string &sql) {
+  auto it = cache_.find(sql);
+  if (it != cache_.end() && !it->second.in_use) {
+    epiphany::observability::Metrics::stmt_cache_hits.fetch_add(
+        1, std::memory_order_relaxed);
+    it->second.in_use = true;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return Statement(it->second.stmt, &it->second.in_use);
+  }
+  epiphany::observability::Metrics::stmt_cache_misses.fetch_add(
+      1, std::memory_order_relaxed);
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v3(db_, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT,
+                         &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_finalize(stmt);
+    return Statement(nullptr, nullptr);
+  }
+  // A statement already checked out (re-entrant use), or a full cache with
+  // nothing to evict, gets a one-shot statement that is finalized after use.
+  if (it != cache_.end() ||
+      (cache_.size() >= kMaxCachedStatements && !EvictOne())) {
+    return Statement(stmt, nullptr);
+  }
+  lru_.push_front(sql);
+  auto inserted = cache_.emplace(sql, Entry{stmt, true, lru_.begin()}).first;
+  return Statement(stmt, &inserted->second.in_use);
+}
+
+bool SqliteConnection::EvictOne() {
+  // Entries checked out are skipped: their Statement points at in_use.
+  for (auto rit = lru_.rbegin(); rit != lru_.rend(); ++rit) {
+    auto it = cache_.find(*rit);
+    if (it->second.in_use)
+      continue;
+    sqlite3_finalize(it->second.stmt);
+    cache_.erase(it);
+    lru_.erase(std::next(rit).base());
+    return true;
+  }
+  return false;
+}
+
+} // namespace database
+} // namespace epiphany
@@ -0,0 +1,81 @@
+#pragma once
+#include <list>
+#include <sqlite3.h>
+#include <string>
+#include <unordered_map>
+
+namespace epiphany {
+namespace database {
+
+// Owns one sqlite3 handle and the prepared statements compiled on it. A
+// connection is used by one thread at a time, so the cache is unlocked.
+class SqliteConnection {
+public:
+  // A cached statement checked out for one execution. On destruction it is
+  // reset and its bindings cleared so the next caller starts fresh.
+  class Statement {
+  public:
+    // in_use points at the cache entry's flag, or is null for a one-shot
+    // statement that is finalized instead of reset.
+    Statement(sqlite3_stmt *stmt, bool *in_use)
+        : stmt_(stmt), in_use_(in_use) {}
+    Statement(Statement &&other) noexcept
+        : stmt_(other.stmt_), in_use_(other.in_use_) {
+      other.stmt_ = nullptr;
+    }
+    Statement(const Statement &) = delete;
+    Statement &operator=(const Statement &) = delete;
+    ~Statement();
+
+    sqlite3_stmt *get() const { return stmt_; }
+    explicit operator bool() const { return stmt_ != nullptr; }
+
+  private:
+    sqlite3_stmt *stmt_;
+    bool *in_use_;
+  };
+
+  // Installs a progress handler that interrupts any statement still running
+  // past the calling thread's deadline (see deadline.h); sqlite3_step then
+  // returns SQLITE_INTERRUPT.
+  explicit SqliteConnection(sqlite3 *db);
+  ~SqliteConnection();
+
+  SqliteConnection(const SqliteConnection &) = delete;
+  SqliteConnection &operator=(const SqliteConnection &) = delete;
+
+  sqlite3 *db() const { return db_; }
+
+  // Returns the compiled statement for sql, preparing it on first use.
+  // Once the cache is full a new statement displaces the least recently
+  // used one not checked out. Evaluates to false if the SQL fails to
+  // compile.
+  Statement Prepare(const std::string &sql);
+
+private:
+  struct Entry {
+    sqlite3_stmt *stmt{nullptr};
+    bool in_use{false};
+    // The entry's place in lru_.
+    std::list<std::string>::iterator lru;
+  };
+
+  static constexpr size_t kMaxCachedStatements = 64;
+  // Virtual machine instructions between deadline checks, a few
+  // microseconds of work; each check reads the clock only while a deadline
+  // is set.
+  static constexpr int kDeadlineCheckOps = 1000;
+
+  static int CheckDeadline(void *);
+  // Finalizes the least recently used statement not checked out; false if
+  // every cached statement is in use.
+  bool EvictOne();
+
+  sqlite3 *db_;
+  std::unordered_map<std::string, Entry> cache_;
+  // Cached SQL, most recently used first.
+  std::list<std::string> lru_;
+};
+
+} // namespace database
+} // namespace epiphany
@@ -1,29 +1,329 @@
-#include "epiphany/database/database.h"
+#include "epiphany/database/backends.h"
+#include "epiphany/database/facet_counter.h"
+#include "epiphany/database/item_json.h"
+#include "epiphany/database/sqlite_connection.h"
+#include "epiphany/observability/trace.h"
+#include "epiphany/ranking/bm25.h"
+#include "epiphany/ranking/top_k.h"
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <sqlite3.h>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace epiphany {
 namespace database {
 
+namespace {
+
+// Options parsed from
+// "sqlite:<file>?readers=N&wal=1&busy_timeout=MS&fts=1".
+struct SqliteOptions {
+  std::string filename;
+  // Number of read-only connections; 0 serves reads from the writer.
+  int readers{0};
+  bool wal{false};
+  int busy_timeout_ms{5000};
+  // Route title matching through the items_fts trigram index.
+  bool fts{false};
+};
+
+bool ParseOptions(const std::string &spec, SqliteOptions *options) {
+  size_t qm = spec.find('?');
+  options->filename = spec.substr(0, qm);
+  if (qm == std::string::npos)
+    return true;
+  std::istringstream qss(spec.substr(qm + 1));
+  std::string kv;
+  while (std::getline(qss, kv, '&')) {
+    size_t eq = kv.find('=');
+    std::string k = kv.substr(0, eq);
+    std::string v = eq == std::string::npos ? "1" : kv.substr(eq + 1);
+    try {
+      if (k == "readers")
+        options->readers = std::stoi(v);
+      else if (k == "wal")
+        options->wal = std::stoi(v) != 0;
+      else if (k == "busy_timeout")
+        options->busy_timeout_ms = std::stoi(v);
+      else if (k == "fts")
+        options->fts = std::stoi(v) != 0;
+      else {
+        std::cerr << "Unknown sqlite option: " << k << std::endl;
+        return false;
+      }
+    } catch (...) {
+      std::cerr << "Invalid value for sqlite option " << k << ": " << v
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+sqlite3 *OpenConnection(const std::string &filename, int flags,
+                        int busy_timeout_ms) {
+  sqlite3 *handle = nullptr;
+  int rc = sqlite3_open_v2(filename.c_str(), &handle,
+                           flags | SQLITE_OPEN_NOMUTEX, nullptr);
+  if (rc != SQLITE_OK) {
+    std::cerr << "Cannot open database: " << sqlite3_errmsg(handle)
+              << std::endl;
+    sqlite3_close(handle);
+    return nullptr;
+  }
+  sqlite3_busy_timeout(handle, busy_timeout_ms);
+  return handle;
+}
+
+// Text of a column without copying it; valid until the statement steps.
+std::string_view ColumnText(sqlite3_stmt *stmt, int col) {
+  const char *text =
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt, col));
+  if (!text)
+    return std::string_view();
+  return std::string_view(text, sqlite3_column_bytes(stmt, col));
+}
+
+// Appends one item object built from the (title, price, image_url) columns of
+// the current row.
+void AppendRowJson(std::string *out, sqlite3_stmt *stmt) {
+  AppendItemJson(out, ColumnText(stmt, 0), sqlite3_column_double(stmt, 1),
+                 ColumnText(stmt, 2));
+}
+
+// Lets relevance ranking read matches shortest title first, ties by id
+// (the rowid every index entry ends with), instead of sorting them. The
+// title rides along so LIKE filters run on the index and only matches
+// touch the table.
+constexpr const char *kTitleLengthIndex =
+    "CREATE INDEX IF NOT EXISTS idx_items_title_length ON "
+    "items(length(title), title);";
+
+// Lets price sorting read matches in price order, ties by id, and stop
+// after the page, and price ranges seek to their first row.
+constexpr const char *kPriceIndex =
+    "CREATE INDEX IF NOT EXISTS idx_items_price ON items(price);";
+
+// FTS5 external-content table over items.title using the trigram tokenizer,
+// kept in sync by triggers. The first run indexes pre-existing rows once and
+// records that in schema_migrations.
+const std::vector<std::string> kFtsMigrations = {
+    "CREATE TABLE IF NOT EXISTS schema_migrations (name TEXT PRIMARY KEY);",
+    "CREATE VIRTUAL TABLE IF NOT EXISTS items_fts USING fts5(title, "
+    "content='items', content_rowid='id', tokenize='trigram');",
+    "CREATE TRIGGER IF NOT EXISTS items_fts_ai AFTER INSERT ON items BEGIN "
+    "INSERT INTO items_fts(rowid, title) VALUES (new.id, new.title); END;",
+    "CREATE TRIGGER IF NOT EXISTS items_fts_ad AFTER DELETE ON items BEGIN "
+    "INSERT INTO items_fts(items_fts, rowid, title) "
+    "VALUES ('delete', old.id, old.title); END;",
+    "CREATE TRIGGER IF NOT EXISTS items_fts_au AFTER UPDATE ON items BEGIN "
+    "INSERT INTO items_fts(items_fts, rowid, title) "
+    "VALUES ('delete', old.id, old.title); "
+    "INSERT INTO items_fts(rowid, title) VALUES (new.id, new.title); END;",
+    "INSERT INTO items_fts(items_fts) SELECT 'rebuild' WHERE NOT EXISTS "
+    "(SELECT 1 FROM schema_migrations WHERE name = 'items_fts_trigram');",
+    "INSERT OR IGNORE INTO schema_migrations (name) "
+    "VALUES ('items_fts_trigram');",
+};
+
+// The trigram index can only narrow patterns of at least three characters;
+// shorter ones scan items directly.
+bool TrigramSearchable(const std::string &query) {
+  int chars = 0;
+  for (unsigned char c : query) {
+    if ((c & 0xC0) != 0x80)
+      ++chars;
+  }
+  return chars >= 3;
+}
+
+// Whether term holds a LIKE wildcard or the escape character, which
+// LikePattern escapes so the term matches literally, as in the index.
+bool NeedsLikeEscape(const std::string &term) {
+  return term.find_first_of("%_\\") != std::string::npos;
+}
+
+// A pattern matching titles that contain term, for "LIKE ? ESCAPE '\'".
+std::string LikePattern(const std::string &term) {
+  std::string pattern = "%";
+  for (char c : term) {
+    if (c == '%' || c == '_' || c == '\\')
+      pattern += '\\';
+    pattern += c;
+  }
+  pattern += '%';
+  return pattern;
+}
+
+// FTS5 only narrows by LIKE constraints that are top-level conjuncts, so
+// only such terms are worth routing through items_fts. It also ignores a
+// LIKE with an ESCAPE clause, so terms needing one are left out.
+bool IsFtsTerm(const query::Node &node) {
+  return node.kind == query::Node::Kind::kTerm &&
+         TrigramSearchable(node.term) && !NeedsLikeEscape(node.term);
+}
+
+bool HasFtsTerm(const query::Node &query) {
+  if (query.kind == query::Node::Kind::kAnd) {
+    return std::any_of(query.children.begin(), query.children.end(),
+                       IsFtsTerm);
+  }
+  return IsFtsTerm(query);
+}
+
+// A LIKE pattern or a price bound.
+using MatchParam = std::variant<std::string, double>;
+
+// Appends a boolean expression with one "LIKE ?" per term, escaped when the
+// term needs it, and a comparison per finite price bound, in the order
+// their parameters are pushed. With fts, top-level trigram terms test
+// f.title so FTS5 can use them; everything else tests i.title. Price
+// bounds compare i.price as is, so idx_items_price can serve them.
+void AppendPredicate(const query::Node &node, bool fts, bool top,
+                     std::string *sql, std::vector<MatchParam> *params) {
+  using Kind = query::Node::Kind;
+  switch (node.kind) {
+  case Kind::kTerm:
+    *sql += fts && top && IsFtsTerm(node) ? "f.title" : "i.title";
+    *sql += NeedsLikeEscape(node.term) ? " LIKE ? ESCAPE '\\'" : " LIKE ?";
+    params->push_back(LikePattern(node.term));
+    return;
+  case Kind::kPrice: {
+    bool low = node.price.min > -std::numeric_limits<double>::infinity();
+    bool high = node.price.max < std::numeric_limits<double>::infinity();
+    if (low && high)
+      *sql += "i.price BETWEEN ? AND ?";
+    else if (low || high)
+      *sql += low ? "i.price >= ?" : "i.price <= ?";
+    else
+      *sql += "1";
+    if (low)
+      params->push_back(node.price.min);
+    if (high)
+      params->push_back(node.price.max);
+    return;
+  }
+  case Kind::kNot:
+    *sql += "NOT ";
+    AppendPredicate(node.children[0], fts, false, sql, params);
+    return;
+  case Kind::kAnd:
+  case Kind::kOr:
+    if (node.children.empty()) {
+      *sql += node.kind == Kind::kAnd ? "1" : "0";
+      return;
+    }
+    *sql += "(";
+    for (size_t i = 0; i < node.children.size(); ++i) {
+      if (i != 0)
+        *sql += node.kind == Kind::kAnd ? " AND " : " OR ";
+      AppendPredicate(node.children[i], fts, top && node.kind == Kind::kAnd,
+                      sql, params);
+    }
+    *sql += ")";
+    return;
+  }
+}
+
+// "FROM ... WHERE <predicate>" selecting items aliased i, plus the column
+// that orders matches by id and the predicate's parameters to bind first.
+struct MatchSql {
+  std::string from;
+  const char *id_column;
+  std::vector<MatchParam> params;
+};
+
+MatchSql BuildMatch(const query::Node &query, bool fts) {
+  MatchSql match;
+  match.from = fts ? " FROM items_fts f JOIN items i ON i.id = f.rowid WHERE "
+                   : " FROM items i WHERE ";
+  match.id_column = fts ? "f.rowid" : "i.id";
+  AppendPredicate(query, fts, true, &match.from, &match.params);
+  return match;
+}
+
+// Binds params to parameters 1..n and returns n + 1.
+int BindParams(sqlite3_stmt *stmt, const std::vector<MatchParam> &params) {
+  int index = 1;
+  for (const auto &param : params) {
+    if (const auto *pattern = std::get_if<std::string>(&param))
+      sqlite3_bind_text(stmt, index++, pattern->c_str(), -1, SQLITE_TRANSIENT);
+    else
+      sqlite3_bind_double(stmt, index++, std::get<double>(param));
+  }
+  return index;
+}
+
+// sqlite3_exec with errors reported like Execute's.
+bool Exec(sqlite3 *db, const char *sql) {
+  char *err_msg = nullptr;
+  if (sqlite3_exec(db, sql, 0, 0, &err_msg) != SQLITE_OK) {
+    std::cerr << "SQL error: " << (err_msg ? err_msg : "Unknown error")
+              << std::endl;
+    sqlite3_free(err_msg);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+// Connections are opened with SQLITE_OPEN_NOMUTEX, so each one is used by a
+// single thread at a time: the writer under writer_mu_, readers while
+// checked out of the pool.
 class SqliteDatabase : public Database {
 public:
-  SqliteDatabase(sqlite3 *db) : db_(db) {}
+  // Exclusive use of one connection for the duration of a read.
+  class Lease {
+  public:
+    Lease(SqliteDatabase *owner, SqliteConnection *conn)
+        : owner_(owner), conn_(conn) {}
+    explicit Lease(SqliteDatabase *owner)
+        : owner_(owner), conn_(owner->writer_.get()),
+          writer_lock_(owner->writer_mu_) {}
+    Lease(Lease &&other) noexcept
+        : owner_(other.owner_), conn_(other.conn_),
+          writer_lock_(std::move(other.writer_lock_)) {
+      other.conn_ = nullptr;
+    }
+    ~Lease() {
+      if (conn_ && !writer_lock_.owns_lock())
+        owner_->Release(conn_);
+    }
+    SqliteConnection *operator->() const { return conn_; }
 
-  ~SqliteDatabase() override {
-    if (db_) {
-      sqlite3_close(db_);
+  private:
+    SqliteDatabase *owner_;
+    SqliteConnection *conn_;
+    std::unique_lock<std::mutex> writer_lock_;
+  };
+
+  SqliteDatabase(std::unique_ptr<SqliteConnection> writer,
+                 std::vector<std::unique_ptr<SqliteConnection>> readers,
+                 bool fts)
+      : writer_(std::move(writer)), readers_(std::move(readers)), fts_(fts) {
+    for (auto &r : readers_) {
+      idle_.push_back(r.get());
     }
   }
 
   bool Execute(const std::string &query) override {
+    std::lock_guard<std::mutex> lock(writer_mu_);
     char *err_msg = nullptr;
-    int rc = sqlite3_exec(db_, query.c_str(), 0, 0, &err_msg);
+    int rc = sqlite3_exec(writer_->db(), query.c_str(), 0, 0, &err_msg);
 
     if (rc != SQLITE_OK) {
       std::cerr << "SQL error: " << (err_msg ? err_msg : "Unknown error")
@@ -31,170 +331,741 @@ public:
       sqlite3_free(err_msg);
       return false;
     }
+    BumpWriteGeneration(ClassifyWrite(query));
     return true;
   }
 
   bool Execute(const std::string &query, const std::vector<std::string> &params) override {
-    sqlite3_stmt *stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, query.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+    std::lock_guard<std::mutex> lock(writer_mu_);
+    auto stmt = writer_->Prepare(query);
+    if (!stmt) {
       return false;
     }
     for (int i = 0; i < static_cast<int>(params.size()); ++i) {
-      sqlite3_bind_text(stmt, i + 1, params[i].c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_text(stmt.get(), i + 1, params[i].c_str(), -1,
+                        SQLITE_TRANSIENT);
     }
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    return rc == SQLITE_DONE;
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+      return false;
+    }
+    BumpWriteGeneration(ClassifyWrite(query));
+    return true;
   }
 
-  std::string Search(const std::string &query, int limit, int offset) override {
+  bool BulkInsert(const std::vector<Item> &items, const BulkOptions &options,
+                  BulkResult *result) override {
+    *result = BulkResult();
+    size_t batch_size = std::max<size_t>(1, options.batch_size);
+    // Items without an id get new, larger ones; any id may rewrite a row.
+    WriteKind kind = std::any_of(items.begin(), items.end(),
+                                 [](const Item &item) { return item.id > 0; })
+                         ? WriteKind::kRewrite
+                         : WriteKind::kAppend;
+    bool ok = true;
+    // The writer is released between batches so other writes, and reads
+    // without a reader pool, are not stalled behind the whole load. A fast
+    // load turns syncing off for each batch only, so whatever runs in
+    // between, another fast load included, finds the writer as it was.
+    for (size_t begin = 0; ok && begin < items.size(); begin += batch_size) {
+      std::lock_guard<std::mutex> lock(writer_mu_);
+      int synchronous = -1;
+      if (options.fast) {
+        auto stmt = writer_->Prepare("PRAGMA synchronous;");
+        if (stmt && sqlite3_step(stmt.get()) == SQLITE_ROW)
+          synchronous = sqlite3_column_int(stmt.get(), 0);
+        if (synchronous >= 0)
+          Exec(writer_->db(), "PRAGMA synchronous=OFF;");
+      }
+      ok = InsertBatch(items, begin, std::min(items.size(), begin + batch_size),
+                       result);
+      if (synchronous >= 0)
+        Exec(writer_->db(), ("PRAGMA synchronous=" +
+                             std::to_string(synchronous) + ";")
+                                .c_str());
+      BumpWriteGeneration(kind);
+    }
+    return ok;
+  }
+
+  std::string Search(const query::Node &query, int limit, int offset) override {
     auto start = std::chrono::high_resolution_clock::now();
+    observability::ScopedSpan span(observability::Stage::kSearch);
 
-    auto escape_json = [](const std::string &s) {
-      std::string out;
-      out.reserve(s.size());
-      for (char c : s) {
-        switch (c) {
-        case '\"':
-          out += "\\\"";
-          break;
-        case '\\':
-          out += "\\\\";
-          break;
-        case '\b':
-          out += "\\b";
-          break;
-        case '\f':
-          out += "\\f";
-          break;
-        case '\n':
-          out += "\\n";
-          break;
-        case '\r':
-          out += "\\r";
-          break;
-        case '\t':
-          out += "\\t";
-          break;
-        default:
-          if (static_cast<unsigned char>(c) < 0x20) {
-            char buf[7];
-            std::snprintf(buf, sizeof(buf), "\\u%04x",
-                          static_cast<unsigned char>(c));
-            out += buf;
-          } else {
-            out += c;
-          }
-        }
-      }
-      return out;
-    };
+    ClampPage(&limit, &offset);
 
-    if (limit <= 0)
-      limit = 10;
-    if (limit > 100)
-      limit = 100;
-    if (offset < 0)
-      offset = 0;
-
-    const char *sql = "SELECT title, price, image_url FROM items WHERE title "
-                      "LIKE ? LIMIT ? OFFSET ?;";
-    sqlite3_stmt *stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, 0) != SQLITE_OK) {
+    // Spelled out: a price range may have SQLite read idx_items_price, and
+    // rows would then come in price order.
+    MatchSql match = Match(query);
+    std::string sql = "SELECT i.title, i.price, i.image_url" + match.from +
+                      " ORDER BY " + match.id_column + " LIMIT ? OFFSET ?;";
+    auto conn = AcquireReader();
+    auto stmt = conn->Prepare(sql);
+    if (!stmt) {
       return "{\"items\": [], \"latency_ms\": 0}";
     }
 
-    std::string like_query = "%" + query + "%";
-    sqlite3_bind_text(stmt, 1, like_query.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 2, limit);
-    sqlite3_bind_int(stmt, 3, offset);
+    int next = BindParams(stmt.get(), match.params);
+    sqlite3_bind_int(stmt.get(), next, limit);
+    sqlite3_bind_int(stmt.get(), next + 1, offset);
 
-    std::string json_items = "[";
+    std::string json;
+    StartItems(&json);
     bool first = true;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
       if (!first)
-        json_items += ",";
+        json += ",";
       first = false;
-      const char *t = (const char *)sqlite3_column_text(stmt, 0);
-      std::string title = t ? t : "";
-      double price = sqlite3_column_double(stmt, 1);
-      const char *img_ptr = (const char *)sqlite3_column_text(stmt, 2);
-      std::string img = img_ptr ? img_ptr : "";
-
-      json_items += "{\"title\":\"" + escape_json(title) +
-                    "\", \"price\":" + std::to_string(price) +
-                    ", \"image_url\":\"" + escape_json(img) + "\"}";
+      AppendRowJson(&json, stmt.get());
     }
-    sqlite3_finalize(stmt);
-    json_items += "]";
+    FinishItems(&json, start);
+    return json;
+  }
 
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> elapsed = end - start;
+  SearchResult SearchWithStats(const query::Node &query, int limit,
+                               int offset, unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
 
-    std::stringstream ss;
-    ss << "{\"items\": " << json_items << ", \"latency_ms\": " << std::fixed
-       << std::setprecision(3) << elapsed.count() << "}";
-    return ss.str();
+    // One scan over every match: rows inside the page are serialized, all
+    // of them feed the total, the price aggregates and the facets. It is
+    // traced as a single search span.
+    observability::ScopedSpan span(observability::Stage::kSearch);
+    MatchSql match = Match(query);
+    std::string sql = "SELECT i.title, i.price, i.image_url" +
+                      std::string(facets ? ", i.brand_id, i.category_id" : "") +
+                      match.from + " ORDER BY " + match.id_column + ";";
+    SearchResult result;
+    auto conn = AcquireReader();
+    auto stmt = conn->Prepare(sql);
+    if (!stmt) {
+      result.items = "{\"items\": [], \"latency_ms\": 0}";
+      return result;
+    }
+    BindParams(stmt.get(), match.params);
+
+    std::string json;
+    StartItems(&json);
+    FacetCounter counter(facets);
+    double sum = 0.0;
+    int total = 0;
+    int64_t page_end = static_cast<int64_t>(offset) + limit;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      double price = sqlite3_column_double(stmt.get(), 1);
+      if (facets)
+        counter.Add(static_cast<uint32_t>(sqlite3_column_int64(stmt.get(), 3)),
+                    static_cast<uint32_t>(sqlite3_column_int64(stmt.get(), 4)),
+                    price);
+      if (total == 0) {
+        result.price.min = price;
+        result.price.max = price;
+      } else {
+        if (price < result.price.min)
+          result.price.min = price;
+        if (price > result.price.max)
+          result.price.max = price;
+      }
+      sum += price;
+      if (total >= offset && total < page_end) {
+        if (total != offset)
+          json += ",";
+        AppendRowJson(&json, stmt.get());
+      }
+      ++total;
+    }
+    FinishItems(&json, start);
+    result.total = total;
+    if (total > 0)
+      result.price.avg = sum / total;
+    if (facets)
+      result.facets = NameFacets(conn, &counter);
+    result.items = std::move(json);
+    return result;
   }
 
-  int Count(const std::string &query) override {
-    const char *sql = "SELECT COUNT(*) FROM items WHERE title LIKE ?;";
-    sqlite3_stmt *stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, 0) != SQLITE_OK) {
+  int Count(const query::Node &query) override {
+    observability::ScopedSpan span(observability::Stage::kCount);
+    MatchSql match = Match(query);
+    std::string sql = "SELECT COUNT(*)" + match.from + ";";
+    auto conn = AcquireReader();
+    auto stmt = conn->Prepare(sql);
+    if (!stmt) {
       return 0;
     }
-    std::string like = "%" + query + "%";
-    sqlite3_bind_text(stmt, 1, like.c_str(), -1, SQLITE_TRANSIENT);
+    BindParams(stmt.get(), match.params);
     int total = 0;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-      total = sqlite3_column_int(stmt, 0);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      total = sqlite3_column_int(stmt.get(), 0);
     }
-    sqlite3_finalize(stmt);
     return total;
   }
 
-  PriceAggregates PriceStats(const std::string &query) override {
-    const char *sql = "SELECT AVG(price), MIN(price), MAX(price) FROM items WHERE title LIKE ?;";
-    sqlite3_stmt *stmt = nullptr;
+  PriceAggregates PriceStats(const query::Node &query) override {
+    observability::ScopedSpan span(observability::Stage::kAggregate);
+    MatchSql match = Match(query);
+    std::string sql =
+        "SELECT AVG(i.price), MIN(i.price), MAX(i.price)" + match.from + ";";
+    auto conn = AcquireReader();
     PriceAggregates agg{};
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, 0) != SQLITE_OK) {
+    auto stmt = conn->Prepare(sql);
+    if (!stmt) {
       return agg;
     }
-    std::string like = "%" + query + "%";
-    sqlite3_bind_text(stmt, 1, like.c_str(), -1, SQLITE_TRANSIENT);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-      agg.avg = sqlite3_column_double(stmt, 0);
-      agg.min = sqlite3_column_double(stmt, 1);
-      agg.max = sqlite3_column_double(stmt, 2);
+    BindParams(stmt.get(), match.params);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      agg.avg = sqlite3_column_double(stmt.get(), 0);
+      agg.min = sqlite3_column_double(stmt.get(), 1);
+      agg.max = sqlite3_column_double(stmt.get(), 2);
     }
-    sqlite3_finalize(stmt);
     return agg;
   }
 
+  SearchResult SearchAfter(const query::Node &query, int limit,
+                           int64_t after_id, bool with_stats,
+                           unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    int offset = 0;
+    ClampPage(&limit, &offset);
+    MatchSql match = Match(query);
+    SearchResult result;
+    auto conn = AcquireReader();
+    if (with_stats)
+      QueryStats(conn, match, facets, &result);
+
+    // The id predicate lets SQLite seek the rowid b-tree straight to the
+    // cursor position.
+    observability::ScopedSpan span(observability::Stage::kSearch);
+    std::string id_column = match.id_column;
+    std::string sql = "SELECT i.title, i.price, i.image_url, i.id" +
+                      match.from + " AND " + id_column + " > ? ORDER BY " +
+                      id_column + " LIMIT ?;";
+    auto stmt = conn->Prepare(sql);
+    if (!stmt) {
+      result.items = "{\"items\": [], \"latency_ms\": 0}";
+      return result;
+    }
+    int next = BindParams(stmt.get(), match.params);
+    sqlite3_bind_int64(stmt.get(), next, after_id);
+    sqlite3_bind_int(stmt.get(), next + 1, limit);
+
+    std::string json;
+    StartItems(&json);
+    bool first = true;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      if (!first)
+        json += ",";
+      first = false;
+      AppendRowJson(&json, stmt.get());
+      result.last_id = sqlite3_column_int64(stmt.get(), 3);
+    }
+    FinishItems(&json, start);
+    result.items = std::move(json);
+    return result;
+  }
+
+  SearchResult SearchRanked(const query::Node &query, int limit, int offset,
+                            bool with_stats, unsigned facets) override {
+    ranking::ScoringTerms scoring = ranking::CollectScoringTerms(query);
+    if (scoring.terms.empty()) {
+      if (with_stats)
+        return SearchWithStats(query, limit, offset, facets);
+      SearchResult result;
+      result.items = Search(query, limit, offset);
+      return result;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    MatchSql match = Match(query);
+    SearchResult result;
+    auto conn = AcquireReader();
+    if (with_stats)
+      QueryStats(conn, match, facets, &result);
+
+    observability::ScopedSpan span(observability::Stage::kSearch);
+    std::string json;
+    StartItems(&json);
+    if (scoring.uniform) {
+      // Every match scores by its length alone, so shortest first, ties by
+      // id, is the ranking and SQLite can stop after the page.
+      std::string sql = "SELECT i.title, i.price, i.image_url" + match.from +
+                        " ORDER BY length(i.title), i.id LIMIT ? OFFSET ?;";
+      auto stmt = conn->Prepare(sql);
+      if (stmt) {
+        int next = BindParams(stmt.get(), match.params);
+        sqlite3_bind_int(stmt.get(), next, limit);
+        sqlite3_bind_int(stmt.get(), next + 1, offset);
+        bool first = true;
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+          if (!first)
+            json += ",";
+          first = false;
+          AppendRowJson(&json, stmt.get());
+        }
+      }
+    } else {
+      RankScored(conn, match, scoring.terms, static_cast<size_t>(offset),
+                 static_cast<size_t>(limit), &json);
+    }
+    FinishItems(&json, start);
+    result.items = std::move(json);
+    return result;
+  }
+
+  SearchResult SearchByPrice(const query::Node &query, int limit, int offset,
+                             bool descending, bool with_stats,
+                             unsigned facets) override {
+    auto start = std::chrono::high_resolution_clock::now();
+    ClampPage(&limit, &offset);
+    MatchSql match = Match(query);
+    SearchResult result;
+    auto conn = AcquireReader();
+    if (with_stats)
+      QueryStats(conn, match, facets, &result);
+
+    // idx_items_price ends in the rowid, so it yields this order as is and
+    // SQLite stops reading after the page instead of sorting every match.
+    observability::ScopedSpan span(observability::Stage::kSearch);
+    std::string sql = "SELECT i.title, i.price, i.image_url" + match.from +
+                      (descending ? " ORDER BY i.price DESC, i.id DESC"
+                                  : " ORDER BY i.price, i.id") +
+                      " LIMIT ? OFFSET ?;";
+    std::string json;
+    StartItems(&json);
+    auto stmt = conn->Prepare(sql);
+    if (stmt) {
+      int next = BindParams(stmt.get(), match.params);
+      sqlite3_bind_int(stmt.get(), next, limit);
+      sqlite3_bind_int(stmt.get(), next + 1, offset);
+      bool first = true;
+      while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        if (!first)
+          json += ",";
+        first = false;
+        AppendRowJson(&json, stmt.get());
+      }
+    }
+    FinishItems(&json, start);
+    result.items = std::move(json);
+    return result;
+  }
+
+  void ScanItems(int64_t after_id,
+                 const std::function<void(Item &&)> &visit) override {
+    const char *sql =
+        "SELECT i.id, i.title, i.price, i.image_url, b.name, c.name "
+        "FROM items i LEFT JOIN brands b ON b.id = i.brand_id "
+        "LEFT JOIN categories c ON c.id = i.category_id "
+        "WHERE i.id > ? ORDER BY i.id;";
+    auto conn = AcquireReader();
+    auto stmt = conn->Prepare(sql);
+    if (!stmt) {
+      return;
+    }
+    sqlite3_bind_int64(stmt.get(), 1, after_id);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      Item item;
+      item.id = sqlite3_column_int64(stmt.get(), 0);
+      const char *t = (const char *)sqlite3_column_text(stmt.get(), 1);
+      item.title = t ? t : "";
+      item.price = sqlite3_column_double(stmt.get(), 2);
+      const char *img = (const char *)sqlite3_column_text(stmt.get(), 3);
+      item.image_url = img ? img : "";
+      item.brand = std::string(ColumnText(stmt.get(), 4));
+      item.category = std::string(ColumnText(stmt.get(), 5));
+      visit(std::move(item));
+    }
+  }
+
+  std::vector<std::string> SchemaMigrations() const override {
+    std::vector<std::string> migrations;
+    // Catalogs from before facets lack the dictionary columns, and ALTER
+    // TABLE has no IF NOT EXISTS to run unconditionally.
+    std::vector<std::string> columns = ItemsColumns();
+    for (const auto &column : {std::make_pair("brand_id", "brands"),
+                               std::make_pair("category_id", "categories")}) {
+      if (!columns.empty() && std::find(columns.begin(), columns.end(),
+                                        column.first) == columns.end())
+        migrations.push_back(std::string("ALTER TABLE items ADD COLUMN ") +
+                             column.first + " INTEGER REFERENCES " +
+                             column.second + "(id);");
+    }
+    migrations.push_back(kTitleLengthIndex);
+    migrations.push_back(kPriceIndex);
+    if (fts_)
+      migrations.insert(migrations.end(), kFtsMigrations.begin(),
+                        kFtsMigrations.end());
+    return migrations;
+  }
+
 private:
-  sqlite3 *db_;
+  // Total, price stats and facets of every match, from one query.
+  void QueryStats(Lease &conn, const MatchSql &match, unsigned facets,
+                  SearchResult *result) {
+    observability::ScopedSpan span(observability::Stage::kAggregate);
+    if (facets) {
+      ScanStats(conn, match, facets, result);
+      return;
+    }
+    std::string sql =
+        "SELECT COUNT(*), AVG(i.price), MIN(i.price), MAX(i.price)" +
+        match.from + ";";
+    auto stmt = conn->Prepare(sql);
+    if (!stmt)
+      return;
+    BindParams(stmt.get(), match.params);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      result->total = sqlite3_column_int(stmt.get(), 0);
+      result->price.avg = sqlite3_column_double(stmt.get(), 1);
+      result->price.min = sqlite3_column_double(stmt.get(), 2);
+      result->price.max = sqlite3_column_double(stmt.get(), 3);
+    }
+  }
+
+  // QueryStats with facets: SQL cannot count them in the same query as the
+  // aggregates, so every match is read once and all of them are counted
+  // here.
+  void ScanStats(Lease &conn, const MatchSql &match, unsigned facets,
+                 SearchResult *result) {
+    std::string sql =
+        "SELECT i.price, i.brand_id, i.category_id" + match.from + ";";
+    auto stmt = conn->Prepare(sql);
+    if (!stmt)
+      return;
+    BindParams(stmt.get(), match.params);
+    FacetCounter counter(facets);
+    PriceAggregates &price = result->price;
+    double sum = 0.0;
+    int total = 0;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      double p = sqlite3_column_double(stmt.get(), 0);
+      price.min = total == 0 ? p : std::min(price.min, p);
+      price.max = total == 0 ? p : std::max(price.max, p);
+      sum += p;
+      ++total;
+      counter.Add(static_cast<uint32_t>(sqlite3_column_int64(stmt.get(), 1)),
+                  static_cast<uint32_t>(sqlite3_column_int64(stmt.get(), 2)),
+                  p);
+    }
+    result->total = total;
+    if (total > 0)
+      price.avg = sum / total;
+    result->facets = NameFacets(conn, &counter);
+  }
+
+  // Names the counted dictionary ids and returns the facets.
+  Facets NameFacets(Lease &conn, FacetCounter *counter) {
+    auto brands = conn->Prepare("SELECT name FROM brands WHERE id = ?;");
+    auto categories =
+        conn->Prepare("SELECT name FROM categories WHERE id = ?;");
+    std::string name;
+    counter->Flush([&](unsigned facet, uint32_t code) -> std::string_view {
+      sqlite3_stmt *stmt =
+          facet == kFacetBrand ? brands.get() : categories.get();
+      name.clear();
+      if (stmt) {
+        sqlite3_bind_int64(stmt, 1, code);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+          name = std::string(ColumnText(stmt, 0));
+        sqlite3_reset(stmt);
+      }
+      return name;
+    });
+    return counter->Finish();
+  }
+
+  // Column names of the items table, none if it does not exist yet.
+  std::vector<std::string> ItemsColumns() const {
+    std::lock_guard<std::mutex> lock(writer_mu_);
+    std::vector<std::string> columns;
+    auto stmt = writer_->Prepare("SELECT name FROM pragma_table_info('items');");
+    while (stmt && sqlite3_step(stmt.get()) == SQLITE_ROW)
+      columns.emplace_back(ColumnText(stmt.get(), 0));
+    return columns;
+  }
+
+  // Appends the items ranked offset .. offset + limit when scores depend on
+  // which terms a title contains. Matches arrive shortest first from
+  // idx_items_title_length alone; each is scored as it is read, and reading
+  // stops once a title of the current length could not beat the k-th best
+  // even with every term. Price and image are fetched for the winners only.
+  void RankScored(Lease &conn, const MatchSql &match,
+                  const std::vector<std::string> &terms, size_t offset,
+                  size_t limit, std::string *json) {
+    std::vector<double> idf;
+    ranking::Bm25 bm25 = Weights(conn, terms, &idf);
+    double weight = 0;
+    for (double w : idf)
+      weight += w;
+    // TopK breaks ties by id, so the scan need not order within a length.
+    std::string sql = "SELECT i.title, i.id, length(i.title)" + match.from +
+                      " ORDER BY length(i.title);";
+    auto stmt = conn->Prepare(sql);
+    if (!stmt)
+      return;
+    BindParams(stmt.get(), match.params);
+    struct Row {
+      int64_t id;
+      std::string title;
+    };
+    ranking::TopK<Row> top(offset + limit, bm25.docs());
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      double norm = bm25.LengthNorm(sqlite3_column_int(stmt.get(), 2));
+      if (top.full() && norm * weight < top.threshold())
+        break;
+      std::string_view title = ColumnText(stmt.get(), 0);
+      double sum = 0;
+      for (size_t t = 0; t < terms.size(); ++t) {
+        if (ranking::ContainsTerm(title, terms[t]))
+          sum += idf[t];
+      }
+      int64_t id = sqlite3_column_int64(stmt.get(), 1);
+      if (!top.Accepts(norm * sum, id))
+        continue;
+      top.Push(norm * sum, id, Row{id, std::string(title)});
+    }
+    std::vector<Row> rows = top.Take();
+    if (rows.size() <= offset)
+      return;
+    auto item =
+        conn->Prepare("SELECT price, image_url FROM items WHERE id = ?;");
+    if (!item)
+      return;
+    bool first = true;
+    for (size_t i = offset; i < rows.size(); ++i) {
+      sqlite3_bind_int64(item.get(), 1, rows[i].id);
+      if (sqlite3_step(item.get()) == SQLITE_ROW) {
+        if (!first)
+          *json += ",";
+        first = false;
+        AppendItemJson(json, rows[i].title, sqlite3_column_double(item.get(), 0),
+                       ColumnText(item.get(), 1));
+      }
+      sqlite3_reset(item.get());
+    }
+  }
+
+  // BM25 weights for terms. The document count, average title length and
+  // per-term document frequencies are cached until the next write; they
+  // are computed without holding the cache lock.
+  ranking::Bm25 Weights(Lease &conn, const std::vector<std::string> &terms,
+                        std::vector<double> *idf) {
+    uint64_t generation = WriteGeneration();
+    Corpus known;
+    {
+      std::lock_guard<std::mutex> lock(corpus_mu_);
+      if (corpus_.generation != generation) {
+        corpus_ = Corpus();
+        corpus_.generation = generation;
+      }
+      known = corpus_;
+    }
+    Corpus fresh;
+    fresh.generation = generation;
+    if (!known.counted) {
+      auto stmt =
+          conn->Prepare("SELECT COUNT(*), AVG(length(title)) FROM items;");
+      if (stmt && sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        fresh.docs = static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 0));
+        fresh.avg_length = sqlite3_column_double(stmt.get(), 1);
+        fresh.counted = true;
+      }
+    } else {
+      fresh.docs = known.docs;
+      fresh.avg_length = known.avg_length;
+      fresh.counted = true;
+    }
+    std::vector<uint64_t> df;
+    for (const auto &term : terms) {
+      auto it = known.df.find(term);
+      if (it != known.df.end()) {
+        df.push_back(it->second);
+        continue;
+      }
+      uint64_t count = 0;
+      auto stmt = conn->Prepare(
+          "SELECT COUNT(*) FROM items WHERE title LIKE ? ESCAPE '\\';");
+      if (stmt) {
+        std::string pattern = LikePattern(term);
+        sqlite3_bind_text(stmt.get(), 1, pattern.c_str(), -1,
+                          SQLITE_TRANSIENT);
+        // A count cut short by the deadline is not cached.
+        if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+          count = static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 0));
+          fresh.df.emplace(term, count);
+        }
+      }
+      df.push_back(count);
+    }
+    {
+      std::lock_guard<std::mutex> lock(corpus_mu_);
+      if (corpus_.generation == generation) {
+        if (!corpus_.counted && fresh.counted) {
+          corpus_.docs = fresh.docs;
+          corpus_.avg_length = fresh.avg_length;
+          corpus_.counted = true;
+        }
+        if (corpus_.df.size() + fresh.df.size() > kMaxCachedTerms)
+          corpus_.df.clear();
+        corpus_.df.insert(fresh.df.begin(), fresh.df.end());
+      }
+    }
+    ranking::Bm25 bm25(fresh.docs, fresh.avg_length);
+    for (uint64_t n : df)
+      idf->push_back(bm25.Idf(n));
+    return bm25;
+  }
+
+  // Writes items[begin, end) in one transaction; the caller holds
+  // writer_mu_. A refused row is skipped; any other error rolls the batch
+  // back.
+  bool InsertBatch(const std::vector<Item> &items, size_t begin, size_t end,
+                   BulkResult *result) {
+    sqlite3 *db = writer_->db();
+    if (!Exec(db, "BEGIN IMMEDIATE;"))
+      return false;
+    auto upsert = writer_->Prepare(kBulkUpsertSql);
+    auto append = writer_->Prepare(kBulkAppendSql);
+    auto brand = writer_->Prepare(kBulkBrandSql);
+    auto category = writer_->Prepare(kBulkCategorySql);
+    if (!upsert || !append || !brand || !category) {
+      Exec(db, "ROLLBACK;");
+      return false;
+    }
+    BulkResult batch;
+    for (size_t i = begin; i < end; ++i) {
+      const Item &item = items[i];
+      if (!AddName(brand.get(), item.brand) ||
+          !AddName(category.get(), item.category)) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+        Exec(db, "ROLLBACK;");
+        return false;
+      }
+      sqlite3_stmt *stmt = item.id > 0 ? upsert.get() : append.get();
+      int col = 1;
+      if (item.id > 0)
+        sqlite3_bind_int64(stmt, col++, item.id);
+      sqlite3_bind_text(stmt, col++, item.title.data(),
+                        static_cast<int>(item.title.size()), SQLITE_STATIC);
+      sqlite3_bind_double(stmt, col++, item.price);
+      sqlite3_bind_text(stmt, col++, item.image_url.data(),
+                        static_cast<int>(item.image_url.size()),
+                        SQLITE_STATIC);
+      sqlite3_bind_text(stmt, col++, item.brand.data(),
+                        static_cast<int>(item.brand.size()), SQLITE_STATIC);
+      sqlite3_bind_text(stmt, col++, item.category.data(),
+                        static_cast<int>(item.category.size()),
+                        SQLITE_STATIC);
+      int rc = sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+      if (rc == SQLITE_DONE) {
+        ++(sqlite3_changes(db) > 0 ? batch.inserted : batch.skipped);
+      } else if ((rc & 0xFF) == SQLITE_CONSTRAINT) {
+        ++batch.skipped;
+      } else {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+        Exec(db, "ROLLBACK;");
+        return false;
+      }
+    }
+    if (!Exec(db, "COMMIT;")) {
+      Exec(db, "ROLLBACK;");
+      return false;
+    }
+    result->inserted += batch.inserted;
+    result->skipped += batch.skipped;
+    return true;
+  }
+
+  // Adds name to the dictionary stmt inserts into, unless it is empty.
+  static bool AddName(sqlite3_stmt *stmt, const std::string &name) {
+    if (name.empty())
+      return true;
+    sqlite3_bind_text(stmt, 1, name.data(), static_cast<int>(name.size()),
+                      SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE;
+  }
+
+  MatchSql Match(const query::Node &query) const {
+    return BuildMatch(query, fts_ && HasFtsTerm(query));
+  }
+
+  // Checks out an idle reader, blocking while all are busy. Without a
+  // reader pool, reads share the writer connection.
+  Lease AcquireReader() {
+    if (readers_.empty())
+      return Lease(this);
+    std::unique_lock<std::mutex> lock(pool_mu_);
+    pool_cv_.wait(lock, [this] { return !idle_.empty(); });
+    SqliteConnection *conn = idle_.back();
+    idle_.pop_back();
+    return Lease(this, conn);
+  }
+
+  void Release(SqliteConnection *conn) {
+    {
+      std::lock_guard<std::mutex> lock(pool_mu_);
+      idle_.push_back(conn);
+    }
+    pool_cv_.notify_one();
+  }
+
+  std::unique_ptr<SqliteConnection> writer_;
+  mutable std::mutex writer_mu_;
+  const std::vector<std::unique_ptr<SqliteConnection>> readers_;
+  std::mutex pool_mu_;
+  std::condition_variable pool_cv_;
+  std::vector<SqliteConnection *> idle_;
+  const bool fts_;
+
+  struct Corpus {
+    uint64_t generation{UINT64_MAX};
+    bool counted{false};
+    uint64_t docs{0};
+    double avg_length{0};
+    std::unordered_map<std::string, uint64_t> df;
+  };
+  static constexpr size_t kMaxCachedTerms = 4096;
+  std::mutex corpus_mu_;
+  Corpus corpus_;
 };
 
-std::unique_ptr<Database>
-Database::Create(const std::string &connection_string) {
-  if (connection_string.rfind("sqlite:", 0) != 0) {
-    std::cerr << "Invalid connection string. Must start with 'sqlite:'"
-              << std::endl;
+std::unique_ptr<Database> CreateSqliteDatabase(const std::string &spec) {
+  SqliteOptions options;
+  if (!ParseOptions(spec, &options)) {
     return nullptr;
   }
+  bool in_memory = options.filename.empty() || options.filename == ":memory:";
+  if (in_memory && options.readers > 0) {
+    // Every connection to ":memory:" is a separate database.
+    std::cerr << "Ignoring readers for in-memory database." << std::endl;
+    options.readers = 0;
+  }
 
-  std::string filename = connection_string.substr(7);
-  sqlite3 *handle;
-  int rc = sqlite3_open(filename.c_str(), &handle);
-
-  if (rc != SQLITE_OK) {
-    std::cerr << "Cannot open database: " << sqlite3_errmsg(handle)
-              << std::endl;
-    sqlite3_close(handle);
+  sqlite3 *writer = OpenConnection(
+      options.filename, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+      options.busy_timeout_ms);
+  if (!writer) {
     return nullptr;
   }
+  if (options.wal && !in_memory) {
+    sqlite3_exec(writer, "PRAGMA journal_mode=WAL;", 0, 0, nullptr);
+    sqlite3_exec(writer, "PRAGMA synchronous=NORMAL;", 0, 0, nullptr);
+  }
+
+  auto writer_conn = std::make_unique<SqliteConnection>(writer);
+  std::vector<std::unique_ptr<SqliteConnection>> readers;
+  for (int i = 0; i < options.readers; ++i) {
+    sqlite3 *reader = OpenConnection(options.filename, SQLITE_OPEN_READONLY,
+                                     options.busy_timeout_ms);
+    if (!reader) {
+      return nullptr;
+    }
+    readers.push_back(std::make_unique<SqliteConnection>(reader));
+  }
 
-  return std::make_unique<SqliteDatabase>(handle);
+  return std::make_unique<SqliteDatabase>(std::move(writer_conn),
+                                          std::move(readers), options.fts);
 }
 
 } // namespace database
@@ -0,0 +1,22 @@
+#include "epiphany/index/facet_column.h"
+
+namespace epiphany {
+namespace index {
+
+void FacetColumn::Append(std::string_view value) {
+  if (value.empty()) {
+    codes_.push_back(0);
+    return;
+  }
+  auto it = lookup_.find(std::string(value));
+  if (it == lookup_.end()) {
+    auto code = static_cast<uint32_t>(offsets_.size() - 1);
+    values_.append(value.data(), value.size());
+    offsets_.push_back(values_.size());
+    it = lookup_.emplace(std::string(value), code).first;
+  }
+  codes_.push_back(it->second);
+}
+
+} // namespace index
+} // namespace epiphany
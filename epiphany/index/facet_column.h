@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace epiphany {
+namespace index {
+
+// Fields stored dictionary-encoded for facet counting.
+enum class FacetField { kBrand = 0, kCategory = 1 };
+constexpr size_t kFacetFields = 2;
+
+// Read side of a dictionary-encoded column: a code per ordinal and the
+// distinct values by code. Code 0 is the empty value, i.e. none. Counting
+// a match set touches four bytes per match and a counter per code; names
+// are only looked up for the codes that were counted.
+struct FacetView {
+  const uint32_t *codes{nullptr};
+  // value_count + 1 offsets into values; value code spans
+  // [offsets[code], offsets[code + 1]).
+  const uint64_t *offsets{nullptr};
+  const char *values{nullptr};
+  size_t value_count{0};
+
+  std::string_view value(uint32_t code) const {
+    return std::string_view(values + offsets[code],
+                            offsets[code + 1] - offsets[code]);
+  }
+};
+
+// Growable dictionary-encoded column, laid out as FacetView reads it so a
+// segment can write it out as is.
+class FacetColumn {
+public:
+  FacetColumn() : offsets_{0, 0} {}
+
+  void Append(std::string_view value);
+
+  size_t size() const { return codes_.size(); }
+  uint32_t code(uint32_t ordinal) const { return codes_[ordinal]; }
+  FacetView view() const {
+    return FacetView{codes_.data(), offsets_.data(), values_.data(),
+                     offsets_.size() - 1};
+  }
+
+private:
+  std::vector<uint32_t> codes_;
+  std::vector<uint64_t> offsets_;
+  std::string values_;
+  std::unordered_map<std::string, uint32_t> lookup_;
+};
+
+} // namespace index
+} // namespace epiphany
@@ -0,0 +1,75 @@
+#include "epiphany/index/index_reader.h"
+#include "epiphany/index/utf8.h"
+#include <algorithm>
+#include <vector>
+
+namespace epiphany {
+namespace index {
+
+namespace {
+
+bool ContainsAt(const std::vector<uint32_t> &hay,
+                const std::vector<uint32_t> &needle) {
+  return std::search(hay.begin(), hay.end(), needle.begin(), needle.end()) !=
+         hay.end();
+}
+
+} // namespace
+
+void TitleLengths::Add(uint32_t ordinal, size_t length) {
+  if (classes.empty())
+    classes.resize(kClasses);
+  classes[std::min(length, kClasses - 1)].Add(ordinal);
+  total += length;
+}
+
+uint64_t IndexReader::GramKey(const uint32_t *cps, size_t n) {
+  uint64_t key = 0;
+  for (size_t i = 0; i < n; ++i) {
+    key = (key << 21) | cps[i];
+  }
+  return key;
+}
+
+RoaringBitmap IndexReader::Match(const std::string &term) const {
+  std::vector<uint32_t> cps = DecodeFolded(term);
+  if (cps.empty())
+    return All();
+  RoaringBitmap postings;
+  if (cps.size() <= kMaxGram) {
+    Postings(GramKey(cps.data(), cps.size()), &postings);
+    return postings;
+  }
+
+  std::vector<RoaringBitmap> lists;
+  for (size_t i = 0; i + kMaxGram <= cps.size(); ++i) {
+    if (!Postings(GramKey(cps.data() + i, kMaxGram), &postings))
+      return RoaringBitmap();
+    lists.push_back(std::move(postings));
+  }
+  std::sort(lists.begin(), lists.end(),
+            [](const RoaringBitmap &a, const RoaringBitmap &b) {
+              return a.Cardinality() < b.Cardinality();
+            });
+  RoaringBitmap candidates = std::move(lists[0]);
+  for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+    candidates = RoaringBitmap::And(candidates, lists[i]);
+  }
+
+  // Trigram co-occurrence does not imply adjacency; confirm the substring.
+  RoaringBitmap matches;
+  candidates.ForEachBlock([&](const uint32_t *ords, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      if (ContainsAt(DecodeFolded(doc(ords[i]).title), cps))
+        matches.Add(ords[i]);
+    }
+  });
+  return matches;
+}
+
+RoaringBitmap IndexReader::All() const {
+  return RoaringBitmap::Range(static_cast<uint32_t>(size()));
+}
+
+} // namespace index
+} // namespace epiphany
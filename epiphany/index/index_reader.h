@@ -0,0 +1,80 @@
+#pragma once
+#include "epiphany/index/facet_column.h"
+#include "epiphany/index/price_column.h"
+#include "epiphany/index/roaring.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace epiphany {
+namespace index {
+
+// A document as stored by some index; the views stay valid as long as the
+// index does.
+struct DocView {
+  int64_t id{0};
+  std::string_view title;
+  double price{0.0};
+  std::string_view image_url;
+  // Empty when the document has none.
+  std::string_view brand;
+  std::string_view category;
+};
+
+// Documents grouped by title length in code points, shortest first, so
+// ranking can visit them in order of their best possible score.
+struct TitleLengths {
+  // classes[n] holds the ordinals whose title has n code points; the last
+  // class also takes every longer title.
+  static constexpr size_t kClasses = 256;
+
+  std::vector<RoaringBitmap> classes;
+  // Sum of all title lengths, for the average.
+  uint64_t total{0};
+
+  // Ordinals must arrive in increasing order.
+  void Add(uint32_t ordinal, size_t length);
+};
+
+// Read side shared by the in-memory NgramIndex and mmapped segments. Every
+// 1-, 2- and 3-gram of code points maps to a roaring bitmap of document
+// ordinals, so a substring query of up to three characters is a single
+// lookup and longer queries intersect their trigram bitmaps and verify the
+// survivors. Matching is ASCII case-insensitive, like SQLite LIKE.
+// Ordinals follow increasing document id.
+class IndexReader {
+public:
+  static constexpr size_t kMaxGram = 3;
+
+  virtual ~IndexReader() = default;
+
+  virtual size_t size() const = 0;
+  virtual DocView doc(uint32_t ordinal) const = 0;
+  // First ordinal whose document id is greater than id; size() if none.
+  virtual uint32_t OrdinalAfter(int64_t id) const = 0;
+  virtual PriceSummary SummarizePrices(const RoaringBitmap &matches) const = 0;
+  // Price of every ordinal, for passes that read it beside other columns.
+  virtual const double *Prices() const = 0;
+  virtual FacetView Facet(FacetField field) const = 0;
+  virtual const TitleLengths &Lengths() const = 0;
+  // Every ordinal in price order, for price filters and price sorting.
+  virtual const PriceOrder &ByPrice() const = 0;
+
+  // Ordinals of the documents whose title contains term.
+  RoaringBitmap Match(const std::string &term) const;
+  // Every ordinal.
+  RoaringBitmap All() const;
+
+  // Code points fit in 21 bits and are never 0 in titles, so packing up to
+  // three of them keeps grams of different lengths distinct.
+  static uint64_t GramKey(const uint32_t *cps, size_t n);
+
+protected:
+  // Stores the bitmap of a gram key in *out; false if no title has it.
+  virtual bool Postings(uint64_t key, RoaringBitmap *out) const = 0;
+};
+
+} // namespace index
+} // namespace epiphany
@@ -0,0 +1,154 @@
+#include "epiphany/index/live_index.h"
+#include <algorithm>
+#include <mutex>
+#include <sys/stat.h>
+#include <utility>
+
+namespace epiphany {
+namespace index {
+
+std::unique_ptr<LiveIndex> LiveIndex::Open(const std::string &path) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0 && !WriteSegment(NgramIndex(), path)) {
+    return nullptr;
+  }
+  auto base = SegmentReader::Open(path, false);
+  if (!base) {
+    return nullptr;
+  }
+  return std::unique_ptr<LiveIndex>(new LiveIndex(path, std::move(base)));
+}
+
+void LiveIndex::Upsert(Document doc) {
+  std::unique_lock<std::shared_mutex> lock(mu_);
+  Shadow(doc.id);
+  active_->latest[doc.id] = static_cast<uint32_t>(active_->docs.size());
+  active_->docs.Add(std::move(doc));
+}
+
+void LiveIndex::Delete(int64_t id) {
+  std::unique_lock<std::shared_mutex> lock(mu_);
+  Shadow(id);
+  active_->latest[id] = kDeleted;
+}
+
+void LiveIndex::Shadow(int64_t id) {
+  auto it = active_->latest.find(id);
+  if (it != active_->latest.end()) {
+    if (it->second != kDeleted)
+      active_->dead.Insert(it->second);
+    return;
+  }
+  // First event for id since the last freeze; an older layer may show it.
+  if (frozen_) {
+    auto f = frozen_->latest.find(id);
+    if (f != frozen_->latest.end()) {
+      // The frozen delta already shadows any base version.
+      if (f->second != kDeleted)
+        frozen_->dead.Insert(f->second);
+      return;
+    }
+  }
+  uint32_t ordinal = BaseOrdinal(id);
+  if (ordinal != kDeleted)
+    base_dead_.Insert(ordinal);
+}
+
+uint32_t LiveIndex::BaseOrdinal(int64_t id) const {
+  uint32_t ordinal = base_->OrdinalAfter(id - 1);
+  if (ordinal < base_->size() && base_->doc(ordinal).id == id)
+    return ordinal;
+  return kDeleted;
+}
+
+bool LiveIndex::Merge() {
+  const Delta *frozen;
+  const SegmentReader *base;
+  {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    if (!frozen_) {
+      if (active_->latest.empty())
+        return true;
+      frozen_ = std::move(active_);
+      active_ = std::make_unique<Delta>();
+    }
+    frozen = frozen_.get();
+    base = base_.get();
+  }
+
+  // Off-lock: the base is immutable and the frozen delta's documents and
+  // latest map no longer change; only dead bitmaps do, and they are not
+  // read here.
+  std::vector<std::pair<int64_t, uint32_t>> updates;
+  for (const auto &entry : frozen->latest) {
+    if (entry.second != kDeleted)
+      updates.push_back(entry);
+  }
+  std::sort(updates.begin(), updates.end());
+  NgramIndex merged;
+  auto add = [&merged](const DocView &doc) {
+    merged.Add(Document{doc.id, std::string(doc.title), doc.price,
+                        std::string(doc.image_url), std::string(doc.brand),
+                        std::string(doc.category)});
+  };
+  size_t u = 0;
+  for (uint32_t i = 0; i < base->size(); ++i) {
+    DocView doc = base->doc(i);
+    while (u < updates.size() && updates[u].first < doc.id)
+      add(frozen->docs.doc(updates[u++].second));
+    if (frozen->latest.count(doc.id) == 0)
+      add(doc);
+  }
+  for (; u < updates.size(); ++u)
+    add(frozen->docs.doc(updates[u].second));
+
+  if (!WriteSegment(merged, path_)) {
+    return false;
+  }
+  auto fresh = SegmentReader::Open(path_, false);
+  if (!fresh) {
+    return false;
+  }
+
+  // Unmapping the old base and freeing the frozen delta happen after the
+  // lock is released.
+  std::unique_ptr<SegmentReader> old_base;
+  std::unique_ptr<Delta> old_delta;
+  {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    old_base = std::move(base_);
+    old_delta = std::move(frozen_);
+    base_ = std::move(fresh);
+    base_dead_ = RoaringBitmap();
+    for (const auto &entry : active_->latest) {
+      uint32_t ordinal = BaseOrdinal(entry.first);
+      if (ordinal != kDeleted)
+        base_dead_.Insert(ordinal);
+    }
+  }
+  return true;
+}
+
+size_t LiveIndex::delta_size() const {
+  std::shared_lock<std::shared_mutex> lock(mu_);
+  size_t n = active_->latest.size();
+  if (frozen_) {
+    for (const auto &entry : frozen_->latest)
+      n += active_->latest.count(entry.first) == 0;
+  }
+  return n;
+}
+
+LiveIndex::View LiveIndex::Read() const {
+  std::shared_lock<std::shared_mutex> lock(mu_);
+  View view;
+  view.layers.push_back(Layer{base_.get(), &base_dead_, true});
+  if (frozen_)
+    view.layers.push_back(Layer{&frozen_->docs, &frozen_->dead, false});
+  view.layers.push_back(Layer{&active_->docs, &active_->dead, false});
+  view.lock = std::move(lock);
+  return view;
+}
+
+} // namespace index
+} // namespace epiphany
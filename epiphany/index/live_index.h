@@ -0,0 +1,85 @@
+#pragma once
+#include "epiphany/index/index_reader.h"
+#include "epiphany/index/ngram_index.h"
+#include "epiphany/index/roaring.h"
+#include "epiphany/index/segment.h"
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace epiphany {
+namespace index {
+
+// A segment that takes upserts and deletes. Changes land in an in-memory
+// delta that is searchable as soon as Upsert/Delete return; Merge folds the
+// delta into a new base segment written over the original file.
+//
+// Readers see up to three layers: the mapped base, a delta frozen while a
+// merge is writing it out, and the active delta. A document lives in the
+// newest layer that mentions its id; each layer carries a dead bitmap of
+// the ordinals a newer layer (or a newer version in the same delta)
+// shadows. Deltas are appended in arrival order, so unlike the base their
+// ordinals do not follow id order.
+class LiveIndex {
+public:
+  // Opens path as the base, first writing an empty segment if it is
+  // missing. nullptr if the file is not a valid segment.
+  static std::unique_ptr<LiveIndex> Open(const std::string &path);
+
+  void Upsert(Document doc);
+  void Delete(int64_t id);
+
+  // Writes base plus delta to a new segment and swaps it in. Readers and
+  // writers only wait for the freeze and the swap, not the write. Calls
+  // must not overlap; false if the segment could not be written, in which
+  // case the frozen delta stays served and the next call retries it.
+  bool Merge();
+
+  // Ids added, updated or deleted since the base was written.
+  size_t delta_size() const;
+
+  struct Layer {
+    const IndexReader *reader;
+    const RoaringBitmap *dead;
+    bool id_ordered;
+  };
+  // The layers to search, stable until the view goes away.
+  struct View {
+    std::vector<Layer> layers;
+    std::shared_lock<std::shared_mutex> lock;
+  };
+  View Read() const;
+
+private:
+  // Marks no document.
+  static constexpr uint32_t kDeleted = UINT32_MAX;
+
+  struct Delta {
+    NgramIndex docs;
+    RoaringBitmap dead;
+    // Newest ordinal for every id this delta touched, kDeleted for deletes.
+    std::unordered_map<int64_t, uint32_t> latest;
+  };
+
+  LiveIndex(std::string path, std::unique_ptr<SegmentReader> base)
+      : path_(std::move(path)), base_(std::move(base)),
+        active_(std::make_unique<Delta>()) {}
+
+  // Marks every current version of id dead ahead of a new event for it.
+  void Shadow(int64_t id);
+  // Base ordinal holding id, or kDeleted.
+  uint32_t BaseOrdinal(int64_t id) const;
+
+  const std::string path_;
+  mutable std::shared_mutex mu_;
+  std::unique_ptr<SegmentReader> base_;
+  RoaringBitmap base_dead_;
+  std::unique_ptr<Delta> frozen_;
+  std::unique_ptr<Delta> active_;
+};
+
+} // namespace index
+} // namespace epiphany
@@ -0,0 +1,50 @@
+#include "epiphany/index/ngram_index.h"
+#include "epiphany/index/utf8.h"
+#include <algorithm>
+
+namespace epiphany {
+namespace index {
+
+void NgramIndex::Add(Document doc) {
+  uint32_t ordinal = static_cast<uint32_t>(docs_.size());
+  std::vector<uint32_t> cps = DecodeFolded(doc.title);
+  for (size_t n = 1; n <= kMaxGram; ++n) {
+    for (size_t i = 0; i + n <= cps.size(); ++i) {
+      postings_[GramKey(cps.data() + i, n)].Add(ordinal);
+    }
+  }
+  prices_.Append(doc.price);
+  facets_[static_cast<size_t>(FacetField::kBrand)].Append(doc.brand);
+  facets_[static_cast<size_t>(FacetField::kCategory)].Append(doc.category);
+  lengths_.Add(ordinal, CodePointCount(doc.title));
+  docs_.push_back(std::move(doc));
+}
+
+DocView NgramIndex::doc(uint32_t ordinal) const {
+  const Document &d = docs_[ordinal];
+  return DocView{d.id, d.title, d.price, d.image_url, d.brand, d.category};
+}
+
+const PriceOrder &NgramIndex::ByPrice() const {
+  std::lock_guard<std::mutex> lock(price_order_mu_);
+  price_order_.Extend(prices_.data(), prices_.size());
+  return price_order_;
+}
+
+uint32_t NgramIndex::OrdinalAfter(int64_t id) const {
+  auto it = std::upper_bound(
+      docs_.begin(), docs_.end(), id,
+      [](int64_t value, const Document &doc) { return value < doc.id; });
+  return static_cast<uint32_t>(it - docs_.begin());
+}
+
+bool NgramIndex::Postings(uint64_t key, RoaringBitmap *out) const {
+  auto it = postings_.find(key);
+  if (it == postings_.end())
+    return false;
+  *out = it->second;
+  return true;
+}
+
+} // namespace index
+} // namespace epiphany
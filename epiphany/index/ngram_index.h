@@ -0,0 +1,66 @@
+#pragma once
+#include "epiphany/index/facet_column.h"
+#include "epiphany/index/index_reader.h"
+#include "epiphany/index/price_column.h"
+#include "epiphany/index/roaring.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace epiphany {
+namespace index {
+
+struct Document {
+  int64_t id{0};
+  std::string title;
+  double price{0.0};
+  std::string image_url;
+  std::string brand;
+  std::string category;
+};
+
+// In-memory, growable n-gram index over item titles.
+class NgramIndex : public IndexReader {
+public:
+  // Ordinals follow insertion order. OrdinalAfter and max_id assume ids
+  // were added in increasing order, which only LiveIndex deltas skip.
+  void Add(Document doc);
+
+  size_t size() const override { return docs_.size(); }
+  DocView doc(uint32_t ordinal) const override;
+  uint32_t OrdinalAfter(int64_t id) const override;
+  PriceSummary SummarizePrices(const RoaringBitmap &matches) const override {
+    return prices_.Summarize(matches);
+  }
+  const double *Prices() const override { return prices_.data(); }
+  FacetView Facet(FacetField field) const override {
+    return facets_[static_cast<size_t>(field)].view();
+  }
+  const TitleLengths &Lengths() const override { return lengths_; }
+  // Catches up with documents added since the last call first, so a batch
+  // of Adds is sorted and merged in once. Readers may call it concurrently,
+  // as long as nothing is being added.
+  const PriceOrder &ByPrice() const override;
+
+  int64_t max_id() const { return docs_.empty() ? 0 : docs_.back().id; }
+  const std::unordered_map<uint64_t, RoaringBitmap> &postings() const {
+    return postings_;
+  }
+
+protected:
+  bool Postings(uint64_t key, RoaringBitmap *out) const override;
+
+private:
+  std::vector<Document> docs_;
+  PriceColumn prices_;
+  FacetColumn facets_[kFacetFields];
+  TitleLengths lengths_;
+  std::unordered_map<uint64_t, RoaringBitmap> postings_;
+  mutable std::mutex price_order_mu_;
+  mutable PriceOrder price_order_;
+};
+
+} // namespace index
+} // namespace epiphany
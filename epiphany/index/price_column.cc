@@ -0,0 +1,264 @@
+#include "epiphany/index/price_column.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EP_PRICE_X86 1
+#endif
+
+namespace epiphany {
+namespace index {
+
+namespace {
+
+// Every kernel sees n > 0 and returns min/max over the values it visits.
+using RangeKernel = PriceSummary (*)(const double *values, size_t n);
+using GatherKernel = PriceSummary (*)(const double *values,
+                                      const uint32_t *ordinals, size_t n);
+
+PriceSummary RangeScalar(const double *values, size_t n) {
+  PriceSummary s;
+  s.count = n;
+  s.min = s.max = values[0];
+  for (size_t i = 0; i < n; ++i) {
+    s.sum += values[i];
+    s.min = std::min(s.min, values[i]);
+    s.max = std::max(s.max, values[i]);
+  }
+  return s;
+}
+
+PriceSummary GatherScalar(const double *values, const uint32_t *ordinals,
+                          size_t n) {
+  PriceSummary s;
+  s.count = n;
+  s.min = s.max = values[ordinals[0]];
+  for (size_t i = 0; i < n; ++i) {
+    double v = values[ordinals[i]];
+    s.sum += v;
+    s.min = std::min(s.min, v);
+    s.max = std::max(s.max, v);
+  }
+  return s;
+}
+
+#ifdef EP_PRICE_X86
+
+// SSE2 is part of the x86-64 baseline, so these need no target attribute.
+PriceSummary FinishSse2(__m128d sum, __m128d lo, __m128d hi, size_t n) {
+  PriceSummary s;
+  s.count = n;
+  s.sum = _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+  s.min = _mm_cvtsd_f64(_mm_min_sd(lo, _mm_unpackhi_pd(lo, lo)));
+  s.max = _mm_cvtsd_f64(_mm_max_sd(hi, _mm_unpackhi_pd(hi, hi)));
+  return s;
+}
+
+PriceSummary RangeSse2(const double *values, size_t n) {
+  if (n < 2)
+    return RangeScalar(values, n);
+  __m128d sum = _mm_setzero_pd();
+  __m128d lo = _mm_set1_pd(values[0]);
+  __m128d hi = lo;
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d v = _mm_loadu_pd(values + i);
+    sum = _mm_add_pd(sum, v);
+    lo = _mm_min_pd(lo, v);
+    hi = _mm_max_pd(hi, v);
+  }
+  PriceSummary s = FinishSse2(sum, lo, hi, n);
+  for (; i < n; ++i) {
+    s.sum += values[i];
+    s.min = std::min(s.min, values[i]);
+    s.max = std::max(s.max, values[i]);
+  }
+  return s;
+}
+
+PriceSummary GatherSse2(const double *values, const uint32_t *ordinals,
+                        size_t n) {
+  if (n < 2)
+    return GatherScalar(values, ordinals, n);
+  __m128d sum = _mm_setzero_pd();
+  __m128d lo = _mm_set1_pd(values[ordinals[0]]);
+  __m128d hi = lo;
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d v = _mm_set_pd(values[ordinals[i + 1]], values[ordinals[i]]);
+    sum = _mm_add_pd(sum, v);
+    lo = _mm_min_pd(lo, v);
+    hi = _mm_max_pd(hi, v);
+  }
+  PriceSummary s = FinishSse2(sum, lo, hi, n);
+  for (; i < n; ++i) {
+    double v = values[ordinals[i]];
+    s.sum += v;
+    s.min = std::min(s.min, v);
+    s.max = std::max(s.max, v);
+  }
+  return s;
+}
+
+__attribute__((target("avx2"))) PriceSummary
+FinishAvx2(__m256d sum, __m256d lo, __m256d hi, size_t n) {
+  return FinishSse2(
+      _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1)),
+      _mm_min_pd(_mm256_castpd256_pd128(lo), _mm256_extractf128_pd(lo, 1)),
+      _mm_max_pd(_mm256_castpd256_pd128(hi), _mm256_extractf128_pd(hi, 1)), n);
+}
+
+__attribute__((target("avx2"))) PriceSummary RangeAvx2(const double *values,
+                                                       size_t n) {
+  if (n < 4)
+    return RangeScalar(values, n);
+  // Two independent accumulators hide the add latency.
+  __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+  __m256d lo = _mm256_set1_pd(values[0]), hi = lo;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256d a = _mm256_loadu_pd(values + i);
+    __m256d b = _mm256_loadu_pd(values + i + 4);
+    sum0 = _mm256_add_pd(sum0, a);
+    sum1 = _mm256_add_pd(sum1, b);
+    lo = _mm256_min_pd(lo, _mm256_min_pd(a, b));
+    hi = _mm256_max_pd(hi, _mm256_max_pd(a, b));
+  }
+  for (; i + 4 <= n; i += 4) {
+    __m256d a = _mm256_loadu_pd(values + i);
+    sum0 = _mm256_add_pd(sum0, a);
+    lo = _mm256_min_pd(lo, a);
+    hi = _mm256_max_pd(hi, a);
+  }
+  PriceSummary s = FinishAvx2(_mm256_add_pd(sum0, sum1), lo, hi, n);
+  for (; i < n; ++i) {
+    s.sum += values[i];
+    s.min = std::min(s.min, values[i]);
+    s.max = std::max(s.max, values[i]);
+  }
+  return s;
+}
+
+// Ordinals are gathered as signed 32-bit offsets, which holds for any index
+// that fits in memory.
+__attribute__((target("avx2"))) PriceSummary
+GatherAvx2(const double *values, const uint32_t *ordinals, size_t n) {
+  if (n < 4)
+    return GatherScalar(values, ordinals, n);
+  __m256d sum = _mm256_setzero_pd();
+  __m256d lo = _mm256_set1_pd(values[ordinals[0]]), hi = lo;
+  // The masked form with every lane set is the same gather; GCC 12 warns
+  // that the unmasked one reads an uninitialized source at -O2.
+  const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i idx =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(ordinals + i));
+    __m256d v =
+        _mm256_mask_i32gather_pd(_mm256_setzero_pd(), values, idx, all, 8);
+    sum = _mm256_add_pd(sum, v);
+    lo = _mm256_min_pd(lo, v);
+    hi = _mm256_max_pd(hi, v);
+  }
+  PriceSummary s = FinishAvx2(sum, lo, hi, n);
+  for (; i < n; ++i) {
+    double v = values[ordinals[i]];
+    s.sum += v;
+    s.min = std::min(s.min, v);
+    s.max = std::max(s.max, v);
+  }
+  return s;
+}
+
+#endif // EP_PRICE_X86
+
+struct Kernels {
+  const char *name;
+  RangeKernel range;
+  GatherKernel gather;
+};
+
+const Kernels &SelectKernels() {
+  static const Kernels kernels = [] {
+#ifdef EP_PRICE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      return Kernels{"avx2", RangeAvx2, GatherAvx2};
+    return Kernels{"sse2", RangeSse2, GatherSse2};
+#else
+    return Kernels{"scalar", RangeScalar, GatherScalar};
+#endif
+  }();
+  return kernels;
+}
+
+} // namespace
+
+PriceSummary SummarizeColumn(const double *values,
+                             const RoaringBitmap &matches) {
+  const Kernels &kernels = SelectKernels();
+  PriceSummary total;
+  matches.ForEachBlock([&](const uint32_t *ordinals, size_t n) {
+    if (n == 0)
+      return;
+    // Ordinals are ascending and unique, so a block whose span equals its
+    // size is a contiguous run of the column.
+    PriceSummary s =
+        ordinals[n - 1] - ordinals[0] + 1 == n
+            ? kernels.range(values + ordinals[0], n)
+            : kernels.gather(values, ordinals, n);
+    if (total.count == 0) {
+      total = s;
+      return;
+    }
+    total.count += s.count;
+    total.sum += s.sum;
+    total.min = std::min(total.min, s.min);
+    total.max = std::max(total.max, s.max);
+  });
+  return total;
+}
+
+PriceSummary PriceColumn::Summarize() const {
+  if (values_.empty())
+    return PriceSummary{};
+  return SelectKernels().range(values_.data(), values_.size());
+}
+
+PriceSummary PriceColumn::Summarize(const RoaringBitmap &matches) const {
+  return SummarizeColumn(values_.data(), matches);
+}
+
+const char *PriceColumn::KernelName() { return SelectKernels().name; }
+
+void PriceOrder::Extend(const double *values, size_t count) {
+  size_t old = ordinals_.size();
+  if (count <= old)
+    return;
+  auto by_price = [values](uint32_t a, uint32_t b) {
+    return values[a] < values[b] || (values[a] == values[b] && a < b);
+  };
+  ordinals_.resize(count);
+  for (size_t i = old; i < count; ++i)
+    ordinals_[i] = static_cast<uint32_t>(i);
+  std::sort(ordinals_.begin() + old, ordinals_.end(), by_price);
+  std::inplace_merge(ordinals_.begin(), ordinals_.begin() + old,
+                     ordinals_.end(), by_price);
+}
+
+std::pair<size_t, size_t> PriceOrder::Range(const double *values, double min,
+                                            double max) const {
+  if (!(min <= max))
+    return {0, 0};
+  auto first = std::partition_point(
+      ordinals_.begin(), ordinals_.end(),
+      [values, min](uint32_t o) { return values[o] < min; });
+  auto last = std::partition_point(
+      first, ordinals_.end(),
+      [values, max](uint32_t o) { return values[o] <= max; });
+  return {static_cast<size_t>(first - ordinals_.begin()),
+          static_cast<size_t>(last - ordinals_.begin())};
+}
+
+} // namespace index
+} // namespace epiphany
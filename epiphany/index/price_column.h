@@ -0,0 +1,72 @@
+#pragma once
+#include "epiphany/index/roaring.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace epiphany {
+namespace index {
+
+struct PriceSummary {
+  size_t count{0};
+  double sum{0.0};
+  double min{0.0};
+  double max{0.0};
+};
+
+// Summary over values[i] for every i in matches. values must cover every
+// ordinal in matches; it may point into a mapped segment.
+PriceSummary SummarizeColumn(const double *values, const RoaringBitmap &matches);
+
+// Prices stored contiguously by document ordinal, so aggregates touch only
+// eight bytes per match instead of whole documents. Summaries run on AVX2 or
+// SSE2 kernels picked once at startup from the CPU, with a scalar fallback
+// elsewhere.
+class PriceColumn {
+public:
+  void Append(double price) { values_.push_back(price); }
+
+  size_t size() const { return values_.size(); }
+  double operator[](uint32_t ordinal) const { return values_[ordinal]; }
+  const double *data() const { return values_.data(); }
+
+  // Summary over every stored price.
+  PriceSummary Summarize() const;
+
+  // Summary over the prices at the ordinals in matches. Dense runs of
+  // ordinals take the contiguous path, the rest are gathered.
+  PriceSummary Summarize(const RoaringBitmap &matches) const;
+
+  // Name of the kernel set in use: "avx2", "sse2" or "scalar".
+  static const char *KernelName();
+
+private:
+  std::vector<double> values_;
+};
+
+// Ordinals sorted by price, equal prices by ordinal: a secondary index over
+// a price column. A price range is a contiguous run of it found by
+// bisection, and walking it from either end visits documents cheapest or
+// dearest first without sorting any matches.
+class PriceOrder {
+public:
+  // Brings the order up to the first count values, which must extend the
+  // values it already covers: the new ordinals are sorted on their own and
+  // merged in.
+  void Extend(const double *values, size_t count);
+
+  size_t size() const { return ordinals_.size(); }
+  uint32_t operator[](size_t position) const { return ordinals_[position]; }
+  const uint32_t *data() const { return ordinals_.data(); }
+
+  // Positions [first, last) of the ordinals priced in [min, max].
+  std::pair<size_t, size_t> Range(const double *values, double min,
+                                  double max) const;
+
+private:
+  std::vector<uint32_t> ordinals_;
+};
+
+} // namespace index
+} // namespace epiphany
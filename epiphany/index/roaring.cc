@@ -0,0 +1,425 @@
+#include "epiphany/index/roaring.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+namespace epiphany {
+namespace index {
+
+namespace {
+
+constexpr size_t kWords = 1024;
+
+bool TestBit(const std::vector<uint64_t> &bits, uint16_t low) {
+  return (bits[low >> 6] >> (low & 63)) & 1;
+}
+
+uint32_t PopCount(const std::vector<uint64_t> &bits) {
+  uint32_t n = 0;
+  for (uint64_t w : bits)
+    n += static_cast<uint32_t>(__builtin_popcountll(w));
+  return n;
+}
+
+struct ContainerHeader {
+  uint16_t key;
+  uint16_t is_bitmap;
+  uint32_t cardinality;
+};
+
+} // namespace
+
+void RoaringBitmap::Serialize(std::string *out) const {
+  uint32_t count = static_cast<uint32_t>(containers_.size());
+  out->append(reinterpret_cast<const char *>(&count), sizeof(count));
+  for (const auto &c : containers_) {
+    ContainerHeader h{c.key, static_cast<uint16_t>(c.is_bitmap()),
+                      c.cardinality};
+    out->append(reinterpret_cast<const char *>(&h), sizeof(h));
+  }
+  for (const auto &c : containers_) {
+    if (c.is_bitmap()) {
+      out->append(reinterpret_cast<const char *>(c.bits.data()),
+                  kWords * sizeof(uint64_t));
+    } else {
+      out->append(reinterpret_cast<const char *>(c.array.data()),
+                  c.array.size() * sizeof(uint16_t));
+    }
+  }
+}
+
+bool RoaringBitmap::Deserialize(const char *data, size_t len,
+                                RoaringBitmap *out) {
+  uint32_t count = 0;
+  if (len < sizeof(count))
+    return false;
+  std::memcpy(&count, data, sizeof(count));
+  size_t pos = sizeof(count);
+  if ((len - pos) / sizeof(ContainerHeader) < count)
+    return false;
+  size_t payload = pos + count * sizeof(ContainerHeader);
+  out->containers_.clear();
+  out->containers_.resize(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    ContainerHeader h;
+    std::memcpy(&h, data + pos + i * sizeof(h), sizeof(h));
+    Container &c = out->containers_[i];
+    c.key = h.key;
+    c.cardinality = h.cardinality;
+    size_t bytes = h.is_bitmap ? kWords * sizeof(uint64_t)
+                               : h.cardinality * sizeof(uint16_t);
+    if (len - payload < bytes || (!h.is_bitmap && h.cardinality > kArrayMax))
+      return false;
+    if (h.is_bitmap) {
+      c.bits.resize(kWords);
+      std::memcpy(c.bits.data(), data + payload, bytes);
+    } else {
+      c.array.resize(h.cardinality);
+      std::memcpy(c.array.data(), data + payload, bytes);
+    }
+    payload += bytes;
+  }
+  return true;
+}
+
+RoaringBitmap RoaringBitmap::Range(uint32_t n) {
+  RoaringBitmap out;
+  for (uint32_t key = 0; static_cast<uint64_t>(key) << 16 < n; ++key) {
+    uint32_t count = std::min<uint32_t>(n - (key << 16), 1u << 16);
+    Container c;
+    c.key = static_cast<uint16_t>(key);
+    c.cardinality = count;
+    c.bits.assign(kWords, 0);
+    for (size_t w = 0; w < count / 64; ++w)
+      c.bits[w] = ~0ULL;
+    if (count % 64)
+      c.bits[count / 64] = (1ULL << (count % 64)) - 1;
+    Normalize(&c);
+    out.containers_.push_back(std::move(c));
+  }
+  return out;
+}
+
+void RoaringBitmap::Add(uint32_t value) {
+  uint16_t key = static_cast<uint16_t>(value >> 16);
+  uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+  if (containers_.empty() || containers_.back().key != key) {
+    Container c;
+    c.key = key;
+    containers_.push_back(std::move(c));
+  }
+  Container &c = containers_.back();
+  if (c.is_bitmap()) {
+    uint64_t mask = 1ULL << (low & 63);
+    if (!(c.bits[low >> 6] & mask)) {
+      c.bits[low >> 6] |= mask;
+      ++c.cardinality;
+    }
+    return;
+  }
+  if (!c.array.empty() && c.array.back() == low)
+    return;
+  if (c.array.size() == kArrayMax) {
+    ToBitmap(&c);
+    c.bits[low >> 6] |= 1ULL << (low & 63);
+    ++c.cardinality;
+    return;
+  }
+  c.array.push_back(low);
+  ++c.cardinality;
+}
+
+void RoaringBitmap::Insert(uint32_t value) {
+  uint16_t key = static_cast<uint16_t>(value >> 16);
+  uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+  auto it = std::lower_bound(
+      containers_.begin(), containers_.end(), key,
+      [](const Container &c, uint16_t k) { return c.key < k; });
+  if (it == containers_.end() || it->key != key) {
+    Container c;
+    c.key = key;
+    it = containers_.insert(it, std::move(c));
+  }
+  Container &c = *it;
+  if (!c.is_bitmap()) {
+    auto pos = std::lower_bound(c.array.begin(), c.array.end(), low);
+    if (pos != c.array.end() && *pos == low)
+      return;
+    if (c.array.size() < kArrayMax) {
+      c.array.insert(pos, low);
+      ++c.cardinality;
+      return;
+    }
+    ToBitmap(&c);
+  }
+  uint64_t mask = 1ULL << (low & 63);
+  if (!(c.bits[low >> 6] & mask)) {
+    c.bits[low >> 6] |= mask;
+    ++c.cardinality;
+  }
+}
+
+size_t RoaringBitmap::Cardinality() const {
+  size_t n = 0;
+  for (const auto &c : containers_)
+    n += c.cardinality;
+  return n;
+}
+
+bool RoaringBitmap::Contains(uint32_t value) const {
+  uint16_t key = static_cast<uint16_t>(value >> 16);
+  uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+  auto it = std::lower_bound(
+      containers_.begin(), containers_.end(), key,
+      [](const Container &c, uint16_t k) { return c.key < k; });
+  if (it == containers_.end() || it->key != key)
+    return false;
+  if (it->is_bitmap())
+    return (it->bits[low >> 6] >> (low & 63)) & 1;
+  return std::binary_search(it->array.begin(), it->array.end(), low);
+}
+
+std::vector<uint32_t> RoaringBitmap::Slice(size_t offset,
+                                           size_t limit) const {
+  std::vector<uint32_t> out;
+  std::vector<uint32_t> buffer;
+  for (const auto &c : containers_) {
+    if (out.size() >= limit)
+      break;
+    if (offset >= c.cardinality) {
+      offset -= c.cardinality;
+      continue;
+    }
+    Decode(c, &buffer);
+    size_t take = std::min(limit - out.size(), buffer.size() - offset);
+    out.insert(out.end(), buffer.begin() + offset,
+               buffer.begin() + offset + take);
+    offset = 0;
+  }
+  return out;
+}
+
+std::vector<uint32_t> RoaringBitmap::SliceFrom(uint32_t min_value,
+                                               size_t limit) const {
+  std::vector<uint32_t> out;
+  std::vector<uint32_t> buffer;
+  uint16_t min_key = static_cast<uint16_t>(min_value >> 16);
+  auto it = std::lower_bound(
+      containers_.begin(), containers_.end(), min_key,
+      [](const Container &c, uint16_t key) { return c.key < key; });
+  for (; it != containers_.end() && out.size() < limit; ++it) {
+    Decode(*it, &buffer);
+    auto from = std::lower_bound(buffer.begin(), buffer.end(), min_value);
+    size_t take = std::min(limit - out.size(),
+                           static_cast<size_t>(buffer.end() - from));
+    out.insert(out.end(), from, from + take);
+  }
+  return out;
+}
+
+void RoaringBitmap::Decode(const Container &c, std::vector<uint32_t> *out) {
+  out->clear();
+  uint32_t base = static_cast<uint32_t>(c.key) << 16;
+  if (!c.is_bitmap()) {
+    out->reserve(c.array.size());
+    for (uint16_t low : c.array)
+      out->push_back(base | low);
+    return;
+  }
+  out->reserve(c.cardinality);
+  for (size_t w = 0; w < kWords; ++w) {
+    uint64_t word = c.bits[w];
+    while (word) {
+      uint32_t bit = static_cast<uint32_t>(__builtin_ctzll(word));
+      out->push_back(base | static_cast<uint32_t>(w * 64 + bit));
+      word &= word - 1;
+    }
+  }
+}
+
+void RoaringBitmap::ToBitmap(Container *c) {
+  c->bits.assign(kWords, 0);
+  for (uint16_t low : c->array)
+    c->bits[low >> 6] |= 1ULL << (low & 63);
+  c->array.clear();
+  c->array.shrink_to_fit();
+}
+
+void RoaringBitmap::Normalize(Container *c) {
+  if (!c->is_bitmap() || c->cardinality > kArrayMax)
+    return;
+  std::vector<uint16_t> array;
+  array.reserve(c->cardinality);
+  for (size_t w = 0; w < kWords; ++w) {
+    uint64_t word = c->bits[w];
+    while (word) {
+      array.push_back(
+          static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+      word &= word - 1;
+    }
+  }
+  c->array = std::move(array);
+  c->bits.clear();
+  c->bits.shrink_to_fit();
+}
+
+RoaringBitmap::Container RoaringBitmap::AndContainers(const Container &a,
+                                                      const Container &b) {
+  Container out;
+  out.key = a.key;
+  if (a.is_bitmap() && b.is_bitmap()) {
+    out.bits.resize(kWords);
+    for (size_t w = 0; w < kWords; ++w)
+      out.bits[w] = a.bits[w] & b.bits[w];
+    out.cardinality = PopCount(out.bits);
+    Normalize(&out);
+    return out;
+  }
+  if (a.is_bitmap() || b.is_bitmap()) {
+    const Container &arr = a.is_bitmap() ? b : a;
+    const Container &bmp = a.is_bitmap() ? a : b;
+    for (uint16_t low : arr.array) {
+      if (TestBit(bmp.bits, low))
+        out.array.push_back(low);
+    }
+  } else {
+    // Gallop through the longer array when the sizes are lopsided.
+    const auto &small = a.array.size() <= b.array.size() ? a.array : b.array;
+    const auto &large = a.array.size() <= b.array.size() ? b.array : a.array;
+    if (small.size() * 32 < large.size()) {
+      auto it = large.begin();
+      for (uint16_t low : small) {
+        it = std::lower_bound(it, large.end(), low);
+        if (it == large.end())
+          break;
+        if (*it == low)
+          out.array.push_back(low);
+      }
+    } else {
+      std::set_intersection(small.begin(), small.end(), large.begin(),
+                            large.end(), std::back_inserter(out.array));
+    }
+  }
+  out.cardinality = static_cast<uint32_t>(out.array.size());
+  return out;
+}
+
+RoaringBitmap::Container RoaringBitmap::OrContainers(const Container &a,
+                                                     const Container &b) {
+  Container out;
+  out.key = a.key;
+  if (!a.is_bitmap() && !b.is_bitmap() &&
+      a.array.size() + b.array.size() <= kArrayMax) {
+    std::set_union(a.array.begin(), a.array.end(), b.array.begin(),
+                   b.array.end(), std::back_inserter(out.array));
+    out.cardinality = static_cast<uint32_t>(out.array.size());
+    return out;
+  }
+  out.bits.assign(kWords, 0);
+  for (const Container *c : {&a, &b}) {
+    if (c->is_bitmap()) {
+      for (size_t w = 0; w < kWords; ++w)
+        out.bits[w] |= c->bits[w];
+    } else {
+      for (uint16_t low : c->array)
+        out.bits[low >> 6] |= 1ULL << (low & 63);
+    }
+  }
+  out.cardinality = PopCount(out.bits);
+  Normalize(&out);
+  return out;
+}
+
+RoaringBitmap::Container RoaringBitmap::AndNotContainers(const Container &a,
+                                                         const Container &b) {
+  Container out;
+  out.key = a.key;
+  if (a.is_bitmap()) {
+    out.bits = a.bits;
+    if (b.is_bitmap()) {
+      for (size_t w = 0; w < kWords; ++w)
+        out.bits[w] &= ~b.bits[w];
+    } else {
+      for (uint16_t low : b.array)
+        out.bits[low >> 6] &= ~(1ULL << (low & 63));
+    }
+    out.cardinality = PopCount(out.bits);
+    Normalize(&out);
+    return out;
+  }
+  if (b.is_bitmap()) {
+    for (uint16_t low : a.array) {
+      if (!TestBit(b.bits, low))
+        out.array.push_back(low);
+    }
+  } else {
+    std::set_difference(a.array.begin(), a.array.end(), b.array.begin(),
+                        b.array.end(), std::back_inserter(out.array));
+  }
+  out.cardinality = static_cast<uint32_t>(out.array.size());
+  return out;
+}
+
+RoaringBitmap RoaringBitmap::And(const RoaringBitmap &a,
+                                 const RoaringBitmap &b) {
+  RoaringBitmap out;
+  size_t i = 0, j = 0;
+  while (i < a.containers_.size() && j < b.containers_.size()) {
+    const Container &ca = a.containers_[i];
+    const Container &cb = b.containers_[j];
+    if (ca.key < cb.key) {
+      ++i;
+    } else if (cb.key < ca.key) {
+      ++j;
+    } else {
+      Container c = AndContainers(ca, cb);
+      if (c.cardinality > 0)
+        out.containers_.push_back(std::move(c));
+      ++i;
+      ++j;
+    }
+  }
+  return out;
+}
+
+RoaringBitmap RoaringBitmap::Or(const RoaringBitmap &a,
+                                const RoaringBitmap &b) {
+  RoaringBitmap out;
+  size_t i = 0, j = 0;
+  while (i < a.containers_.size() || j < b.containers_.size()) {
+    if (j == b.containers_.size() ||
+        (i < a.containers_.size() &&
+         a.containers_[i].key < b.containers_[j].key)) {
+      out.containers_.push_back(a.containers_[i++]);
+    } else if (i == a.containers_.size() ||
+               b.containers_[j].key < a.containers_[i].key) {
+      out.containers_.push_back(b.containers_[j++]);
+    } else {
+      out.containers_.push_back(
+          OrContainers(a.containers_[i++], b.containers_[j++]));
+    }
+  }
+  return out;
+}
+
+RoaringBitmap RoaringBitmap::AndNot(const RoaringBitmap &a,
+                                    const RoaringBitmap &b) {
+  RoaringBitmap out;
+  size_t j = 0;
+  for (const Container &ca : a.containers_) {
+    while (j < b.containers_.size() && b.containers_[j].key < ca.key)
+      ++j;
+    if (j == b.containers_.size() || b.containers_[j].key != ca.key) {
+      out.containers_.push_back(ca);
+      continue;
+    }
+    Container c = AndNotContainers(ca, b.containers_[j]);
+    if (c.cardinality > 0)
+      out.containers_.push_back(std::move(c));
+  }
+  return out;
+}
+
+} // namespace index
+} // namespace epiphany
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace epiphany {
+namespace index {
+
+// Compressed set of 32-bit ordinals in the roaring layout: values are
+// grouped by their high 16 bits into containers that hold the low halves
+// either as a sorted array (up to kArrayMax values) or as a 65536-bit
+// bitmap. Set operations work container by container, picking the merge,
+// probe or word-wise kernel that suits each pair.
+class RoaringBitmap {
+public:
+  static constexpr size_t kArrayMax = 4096;
+
+  // The ordinals [0, n).
+  static RoaringBitmap Range(uint32_t n);
+
+  static RoaringBitmap And(const RoaringBitmap &a, const RoaringBitmap &b);
+  static RoaringBitmap Or(const RoaringBitmap &a, const RoaringBitmap &b);
+  static RoaringBitmap AndNot(const RoaringBitmap &a, const RoaringBitmap &b);
+
+  // Values must arrive in increasing order; repeats are ignored.
+  void Add(uint32_t value);
+  // Adds a value in any order, at the cost of a container search.
+  void Insert(uint32_t value);
+
+  bool empty() const { return containers_.empty(); }
+  size_t Cardinality() const;
+  // A container search, then a bit test or an array search.
+  bool Contains(uint32_t value) const;
+
+  // Appends the bitmap in segment format: a container count, then a
+  // (key, is_bitmap, cardinality) header per container, then the payloads.
+  // Integers are in host byte order.
+  void Serialize(std::string *out) const;
+  // Reads what Serialize wrote; false if data is truncated or inconsistent.
+  static bool Deserialize(const char *data, size_t len, RoaringBitmap *out);
+
+  // Up to limit values starting at the offset-th smallest, skipping whole
+  // containers by their cardinality.
+  std::vector<uint32_t> Slice(size_t offset, size_t limit) const;
+  // Up to limit values that are >= min_value.
+  std::vector<uint32_t> SliceFrom(uint32_t min_value, size_t limit) const;
+  // Calls fn(values, n) for each container with its values decoded in
+  // ascending order; values is only valid during the call.
+  template <typename Fn> void ForEachBlock(Fn fn) const {
+    std::vector<uint32_t> buffer;
+    for (const auto &c : containers_) {
+      Decode(c, &buffer);
+      fn(buffer.data(), buffer.size());
+    }
+  }
+
+private:
+  struct Container {
+    uint16_t key{0};
+    uint32_t cardinality{0};
+    // Exactly one of these is in use: bits when it holds 1024 words.
+    std::vector<uint16_t> array;
+    std::vector<uint64_t> bits;
+
+    bool is_bitmap() const { return !bits.empty(); }
+  };
+
+  static void Decode(const Container &c, std::vector<uint32_t> *out);
+  static void ToBitmap(Container *c);
+  // Drops to an array when the cardinality allows it.
+  static void Normalize(Container *c);
+  static Container AndContainers(const Container &a, const Container &b);
+  static Container OrContainers(const Container &a, const Container &b);
+  static Container AndNotContainers(const Container &a, const Container &b);
+
+  std::vector<Container> containers_;
+};
+
+} // namespace index
+} // namespace epiphany
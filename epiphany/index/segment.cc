@@ -0,0 +1,435 @@
+#include "epiphany/index/segment.h"
+#include "epiphany/index/utf8.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace epiphany {
+namespace index {
+
+namespace {
+
+struct Section {
+  uint64_t offset;
+  uint64_t length;
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t doc_count;
+  uint64_t term_count;
+  uint64_t file_size;
+  uint64_t checksum;
+  Section ids;
+  Section prices;
+  Section doc_offsets;
+  Section doc_data;
+  Section postings;
+  Section dictionary;
+  uint64_t facet_value_counts[kFacetFields];
+  Section facet_codes[kFacetFields];
+  Section facet_values[kFacetFields];
+};
+
+// FNV-1a over 64-bit words (the zero-padded tail included), fed in pieces.
+class Checksum {
+public:
+  void Update(const char *data, size_t len) {
+    while (len > 0) {
+      size_t take = std::min(len, sizeof(carry_) - carried_);
+      std::memcpy(carry_ + carried_, data, take);
+      carried_ += take;
+      data += take;
+      len -= take;
+      if (carried_ == sizeof(carry_))
+        Flush();
+    }
+  }
+  uint64_t Finish() {
+    if (carried_ > 0) {
+      std::memset(carry_ + carried_, 0, sizeof(carry_) - carried_);
+      Flush();
+    }
+    return hash_;
+  }
+
+private:
+  void Flush() {
+    uint64_t word;
+    std::memcpy(&word, carry_, sizeof(word));
+    hash_ = (hash_ ^ word) * 1099511628211ULL;
+    carried_ = 0;
+  }
+
+  uint64_t hash_{14695981039346656037ULL};
+  char carry_[8];
+  size_t carried_{0};
+};
+
+// Buffered sequential writer that tracks the offset and checksums what
+// follows the header.
+class SegmentFile {
+public:
+  explicit SegmentFile(int fd) : fd_(fd) {}
+
+  bool Write(const void *data, size_t len) {
+    const char *p = static_cast<const char *>(data);
+    checksum_.Update(p, len);
+    pos_ += len;
+    buffer_.append(p, len);
+    return buffer_.size() < kFlushBytes || Flush();
+  }
+  bool Flush() {
+    const char *p = buffer_.data();
+    size_t len = buffer_.size();
+    while (len > 0) {
+      ssize_t n = ::write(fd_, p, len);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      p += n;
+      len -= static_cast<size_t>(n);
+    }
+    buffer_.clear();
+    return true;
+  }
+  bool Align() {
+    static const char kZeros[8] = {};
+    size_t pad = (8 - pos_ % 8) % 8;
+    return pad == 0 || Write(kZeros, pad);
+  }
+  // Aligns and records where the next section starts.
+  bool Begin(Section *section) {
+    if (!Align())
+      return false;
+    section->offset = pos_;
+    return true;
+  }
+  void End(Section *section) { section->length = pos_ - section->offset; }
+
+  uint64_t pos() const { return pos_; }
+  uint64_t checksum() { return checksum_.Finish(); }
+
+private:
+  static constexpr size_t kFlushBytes = 1 << 20;
+
+  int fd_;
+  uint64_t pos_{sizeof(Header)};
+  std::string buffer_;
+  Checksum checksum_;
+};
+
+bool WriteSections(const NgramIndex &index, SegmentFile *file,
+                   Header *header) {
+  size_t n = index.size();
+  header->doc_count = n;
+
+  if (!file->Begin(&header->ids))
+    return false;
+  for (uint32_t i = 0; i < n; ++i) {
+    int64_t id = index.doc(i).id;
+    if (!file->Write(&id, sizeof(id)))
+      return false;
+  }
+  file->End(&header->ids);
+
+  if (!file->Begin(&header->prices))
+    return false;
+  for (uint32_t i = 0; i < n; ++i) {
+    double price = index.doc(i).price;
+    if (!file->Write(&price, sizeof(price)))
+      return false;
+  }
+  file->End(&header->prices);
+
+  if (!file->Begin(&header->doc_offsets))
+    return false;
+  uint64_t offset = 0;
+  for (uint32_t i = 0; i <= n; ++i) {
+    if (!file->Write(&offset, sizeof(offset)))
+      return false;
+    if (i < n) {
+      DocView doc = index.doc(i);
+      offset += 2 * sizeof(uint32_t) + doc.title.size() + doc.image_url.size();
+    }
+  }
+  file->End(&header->doc_offsets);
+
+  if (!file->Begin(&header->doc_data))
+    return false;
+  for (uint32_t i = 0; i < n; ++i) {
+    DocView doc = index.doc(i);
+    uint32_t title_len = static_cast<uint32_t>(doc.title.size());
+    uint32_t url_len = static_cast<uint32_t>(doc.image_url.size());
+    if (!file->Write(&title_len, sizeof(title_len)) ||
+        !file->Write(doc.title.data(), title_len) ||
+        !file->Write(&url_len, sizeof(url_len)) ||
+        !file->Write(doc.image_url.data(), url_len))
+      return false;
+  }
+  file->End(&header->doc_data);
+
+  std::vector<uint64_t> keys;
+  keys.reserve(index.postings().size());
+  for (const auto &entry : index.postings())
+    keys.push_back(entry.first);
+  std::sort(keys.begin(), keys.end());
+  header->term_count = keys.size();
+
+  std::vector<uint64_t> dictionary;
+  dictionary.reserve(keys.size() * 3);
+  if (!file->Begin(&header->postings))
+    return false;
+  std::string buffer;
+  for (uint64_t key : keys) {
+    buffer.clear();
+    index.postings().at(key).Serialize(&buffer);
+    dictionary.push_back(key);
+    dictionary.push_back(file->pos() - header->postings.offset);
+    dictionary.push_back(buffer.size());
+    if (!file->Write(buffer.data(), buffer.size()))
+      return false;
+  }
+  file->End(&header->postings);
+
+  if (!file->Begin(&header->dictionary) ||
+      !file->Write(dictionary.data(), dictionary.size() * sizeof(uint64_t)))
+    return false;
+  file->End(&header->dictionary);
+
+  for (size_t f = 0; f < kFacetFields; ++f) {
+    FacetView facet = index.Facet(static_cast<FacetField>(f));
+    header->facet_value_counts[f] = facet.value_count;
+    if (!file->Begin(&header->facet_codes[f]) ||
+        !file->Write(facet.codes, n * sizeof(uint32_t)))
+      return false;
+    file->End(&header->facet_codes[f]);
+    uint64_t bytes = facet.offsets[facet.value_count];
+    if (!file->Begin(&header->facet_values[f]) ||
+        !file->Write(facet.offsets,
+                     (facet.value_count + 1) * sizeof(uint64_t)) ||
+        !file->Write(facet.values, bytes))
+      return false;
+    file->End(&header->facet_values[f]);
+  }
+  header->file_size = file->pos();
+  return file->Flush();
+}
+
+bool InBounds(const Section &s, const Header &h) {
+  return s.offset % 8 == 0 && s.offset >= h.header_size &&
+         s.offset <= h.file_size && s.length <= h.file_size - s.offset;
+}
+
+} // namespace
+
+bool WriteSegment(const NgramIndex &index, const std::string &path) {
+  std::string tmp = path + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Cannot create " << tmp << ": " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  Header header{};
+  std::memcpy(header.magic, kSegmentMagic, sizeof(header.magic));
+  header.version = kSegmentVersion;
+  header.header_size = sizeof(Header);
+
+  SegmentFile file(fd);
+  bool ok = ::lseek(fd, sizeof(Header), SEEK_SET) >= 0 &&
+            WriteSections(index, &file, &header);
+  if (ok) {
+    header.checksum = file.checksum();
+    ok = ::pwrite(fd, &header, sizeof(header), 0) ==
+             static_cast<ssize_t>(sizeof(header)) &&
+         ::fsync(fd) == 0;
+  }
+  if (!ok)
+    std::cerr << "Cannot write " << tmp << ": " << std::strerror(errno)
+              << std::endl;
+  ::close(fd);
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    if (ok)
+      std::cerr << "Cannot rename " << tmp << " to " << path << ": "
+                << std::strerror(errno) << std::endl;
+    ::unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<SegmentReader> SegmentReader::Open(const std::string &path,
+                                                   bool verify) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Cannot open segment " << path << ": "
+              << std::strerror(errno) << std::endl;
+    return nullptr;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    std::cerr << "Invalid segment " << path << ": too short" << std::endl;
+    ::close(fd);
+    return nullptr;
+  }
+  size_t length = static_cast<size_t>(st.st_size);
+  void *map = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    std::cerr << "Cannot map segment " << path << ": " << std::strerror(errno)
+              << std::endl;
+    return nullptr;
+  }
+  std::unique_ptr<SegmentReader> reader(new SegmentReader());
+  reader->base_ = static_cast<const char *>(map);
+  reader->length_ = length;
+
+  Header h;
+  std::memcpy(&h, reader->base_, sizeof(h));
+  const char *problem = nullptr;
+  if (std::memcmp(h.magic, kSegmentMagic, sizeof(h.magic)) != 0)
+    problem = "bad magic";
+  else if (h.version != kSegmentVersion)
+    problem = "unsupported version";
+  else if (h.header_size != sizeof(Header) || h.file_size != length)
+    problem = "size mismatch";
+  else if (!InBounds(h.ids, h) || !InBounds(h.prices, h) ||
+           !InBounds(h.doc_offsets, h) || !InBounds(h.doc_data, h) ||
+           !InBounds(h.postings, h) || !InBounds(h.dictionary, h))
+    problem = "section out of bounds";
+  else if (h.ids.length != h.doc_count * sizeof(int64_t) ||
+           h.prices.length != h.doc_count * sizeof(double) ||
+           h.doc_offsets.length != (h.doc_count + 1) * sizeof(uint64_t) ||
+           h.dictionary.length != h.term_count * 3 * sizeof(uint64_t) ||
+           h.doc_count > UINT32_MAX)
+    problem = "section size mismatch";
+  for (size_t f = 0; !problem && f < kFacetFields; ++f) {
+    const Section &codes = h.facet_codes[f];
+    const Section &values = h.facet_values[f];
+    uint64_t count = h.facet_value_counts[f];
+    if (!InBounds(codes, h) || !InBounds(values, h))
+      problem = "section out of bounds";
+    else if (codes.length != h.doc_count * sizeof(uint32_t) || count == 0 ||
+             count >= values.length / sizeof(uint64_t) ||
+             reinterpret_cast<const uint64_t *>(
+                 reader->base_ + values.offset)[count] !=
+                 values.length - (count + 1) * sizeof(uint64_t))
+      problem = "facet size mismatch";
+  }
+  if (!problem && verify) {
+    Checksum checksum;
+    checksum.Update(reader->base_ + sizeof(Header), length - sizeof(Header));
+    if (checksum.Finish() != h.checksum)
+      problem = "checksum mismatch";
+  }
+  if (problem) {
+    std::cerr << "Invalid segment " << path << ": " << problem << std::endl;
+    return nullptr;
+  }
+
+  reader->doc_count_ = h.doc_count;
+  reader->ids_ = reinterpret_cast<const int64_t *>(reader->base_ + h.ids.offset);
+  reader->prices_ =
+      reinterpret_cast<const double *>(reader->base_ + h.prices.offset);
+  reader->doc_offsets_ =
+      reinterpret_cast<const uint64_t *>(reader->base_ + h.doc_offsets.offset);
+  reader->doc_data_ = reader->base_ + h.doc_data.offset;
+  reader->postings_ = reader->base_ + h.postings.offset;
+  reader->postings_length_ = h.postings.length;
+  reader->dict_ =
+      reinterpret_cast<const uint64_t *>(reader->base_ + h.dictionary.offset);
+  reader->dict_count_ = h.term_count;
+  for (size_t f = 0; f < kFacetFields; ++f) {
+    FacetView &facet = reader->facets_[f];
+    const char *values = reader->base_ + h.facet_values[f].offset;
+    facet.codes = reinterpret_cast<const uint32_t *>(reader->base_ +
+                                                     h.facet_codes[f].offset);
+    facet.offsets = reinterpret_cast<const uint64_t *>(values);
+    facet.value_count = h.facet_value_counts[f];
+    facet.values = values + (facet.value_count + 1) * sizeof(uint64_t);
+  }
+  if (reader->doc_offsets_[h.doc_count] != h.doc_data.length) {
+    std::cerr << "Invalid segment " << path << ": document store mismatch"
+              << std::endl;
+    return nullptr;
+  }
+  return reader;
+}
+
+SegmentReader::~SegmentReader() {
+  if (base_)
+    ::munmap(const_cast<char *>(base_), length_);
+}
+
+DocView SegmentReader::doc(uint32_t ordinal) const {
+  const char *p = doc_data_ + doc_offsets_[ordinal];
+  uint32_t title_len, url_len;
+  std::memcpy(&title_len, p, sizeof(title_len));
+  p += sizeof(title_len);
+  std::string_view title(p, title_len);
+  p += title_len;
+  std::memcpy(&url_len, p, sizeof(url_len));
+  p += sizeof(url_len);
+  const FacetView &brand = facets_[static_cast<size_t>(FacetField::kBrand)];
+  const FacetView &category =
+      facets_[static_cast<size_t>(FacetField::kCategory)];
+  return DocView{ids_[ordinal],
+                 title,
+                 prices_[ordinal],
+                 std::string_view(p, url_len),
+                 brand.value(brand.codes[ordinal]),
+                 category.value(category.codes[ordinal])};
+}
+
+const TitleLengths &SegmentReader::Lengths() const {
+  std::call_once(lengths_once_, [this] {
+    for (uint32_t i = 0; i < doc_count_; ++i)
+      lengths_.Add(i, CodePointCount(doc(i).title));
+  });
+  return lengths_;
+}
+
+const PriceOrder &SegmentReader::ByPrice() const {
+  std::call_once(price_order_once_,
+                 [this] { price_order_.Extend(prices_, doc_count_); });
+  return price_order_;
+}
+
+uint32_t SegmentReader::OrdinalAfter(int64_t id) const {
+  return static_cast<uint32_t>(std::upper_bound(ids_, ids_ + doc_count_, id) -
+                               ids_);
+}
+
+bool SegmentReader::Postings(uint64_t key, RoaringBitmap *out) const {
+  size_t lo = 0, hi = dict_count_;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (dict_[3 * mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == dict_count_ || dict_[3 * lo] != key)
+    return false;
+  uint64_t offset = dict_[3 * lo + 1];
+  uint64_t length = dict_[3 * lo + 2];
+  if (offset > postings_length_ || length > postings_length_ - offset)
+    return false;
+  return RoaringBitmap::Deserialize(postings_ + offset, length, out);
+}
+
+} // namespace index
+} // namespace epiphany
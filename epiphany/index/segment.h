@@ -0,0 +1,86 @@
+#pragma once
+#include "epiphany/index/index_reader.h"
+#include "epiphany/index/ngram_index.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace epiphany {
+namespace index {
+
+// Immutable on-disk form of an NgramIndex, laid out to be served straight
+// from mmap:
+//
+//   header      magic, version, counts, checksum, section table
+//   ids         int64 per document, ascending
+//   prices      double per document (the price column)
+//   doc_offsets uint64 per document + 1, into doc_data
+//   doc_data    per document: u32 title length, title, u32 url length, url
+//   postings    serialized roaring bitmaps
+//   dictionary  (gram key, offset, length) per gram, sorted by key
+//   per facet field (brand, category):
+//     codes     uint32 per document, 0 for none
+//     values    uint64 offset per value + 1, then the values' bytes
+//
+// Sections start 8-byte aligned. Integers are in host byte order, so a
+// segment is built and served on the same architecture. The checksum covers
+// every byte after the header.
+constexpr char kSegmentMagic[8] = {'E', 'P', 'S', 'E', 'G', 'M', 'N', 'T'};
+constexpr uint32_t kSegmentVersion = 2;
+
+// Writes index to path through a temporary file renamed into place, so
+// readers never see a partial segment. Errors are reported on stderr.
+bool WriteSegment(const NgramIndex &index, const std::string &path);
+
+// Read-only view of a mapped segment. Opening checks the header and section
+// bounds; with verify it also checksums the file, which faults in every
+// page up front.
+class SegmentReader : public IndexReader {
+public:
+  static std::unique_ptr<SegmentReader> Open(const std::string &path,
+                                             bool verify);
+  ~SegmentReader() override;
+
+  size_t size() const override { return doc_count_; }
+  DocView doc(uint32_t ordinal) const override;
+  uint32_t OrdinalAfter(int64_t id) const override;
+  PriceSummary SummarizePrices(const RoaringBitmap &matches) const override {
+    return SummarizeColumn(prices_, matches);
+  }
+  const double *Prices() const override { return prices_; }
+  FacetView Facet(FacetField field) const override {
+    return facets_[static_cast<size_t>(field)];
+  }
+  // Built from the titles on first use, which reads every document once.
+  const TitleLengths &Lengths() const override;
+  // Sorted from the price column on first use.
+  const PriceOrder &ByPrice() const override;
+
+protected:
+  bool Postings(uint64_t key, RoaringBitmap *out) const override;
+
+private:
+  SegmentReader() = default;
+
+  const char *base_{nullptr};
+  size_t length_{0};
+  size_t doc_count_{0};
+  const int64_t *ids_{nullptr};
+  const double *prices_{nullptr};
+  const uint64_t *doc_offsets_{nullptr};
+  const char *doc_data_{nullptr};
+  const char *postings_{nullptr};
+  size_t postings_length_{0};
+  // Sorted (key, offset, length) triples of uint64.
+  const uint64_t *dict_{nullptr};
+  size_t dict_count_{0};
+  FacetView facets_[kFacetFields];
+  mutable std::once_flag lengths_once_;
+  mutable TitleLengths lengths_;
+  mutable std::once_flag price_order_once_;
+  mutable PriceOrder price_order_;
+};
+
+} // namespace index
+} // namespace epiphany
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace epiphany {
+namespace index {
+
+// Decodes UTF-8 into code points, folding ASCII letters to lower case so
+// matching follows SQLite LIKE semantics. Invalid sequences decode byte by
+// byte as Latin-1 so arbitrary input never fails.
+inline std::vector<uint32_t> DecodeFolded(std::string_view s) {
+  std::vector<uint32_t> out;
+  out.reserve(s.size());
+  size_t i = 0;
+  while (i < s.size()) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    uint32_t cp = c;
+    size_t len = 1;
+    if (c >= 0xC0 && c < 0xE0)
+      len = 2;
+    else if (c >= 0xE0 && c < 0xF0)
+      len = 3;
+    else if (c >= 0xF0 && c < 0xF8)
+      len = 4;
+    if (len > 1 && i + len <= s.size()) {
+      cp = c & (0xFF >> (len + 1));
+      bool valid = true;
+      for (size_t k = 1; k < len; ++k) {
+        unsigned char cc = static_cast<unsigned char>(s[i + k]);
+        if ((cc & 0xC0) != 0x80) {
+          valid = false;
+          break;
+        }
+        cp = (cp << 6) | (cc & 0x3F);
+      }
+      if (!valid) {
+        cp = c;
+        len = 1;
+      }
+    } else {
+      len = 1;
+    }
+    if (cp >= 'A' && cp <= 'Z')
+      cp += 'a' - 'A';
+    out.push_back(cp);
+    i += len;
+  }
+  return out;
+}
+
+// Bytes in the sequence a lead byte announces; 1 for ASCII and stray
+// continuation bytes.
+inline size_t SequenceLength(char lead) {
+  unsigned char c = static_cast<unsigned char>(lead);
+  return c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+}
+
+// Length of s less a final sequence cut short of what its lead byte
+// announces.
+inline size_t WholeSequencesLength(std::string_view s) {
+  size_t n = 0;
+  while (n < s.size() && n + SequenceLength(s[n]) <= s.size())
+    n += SequenceLength(s[n]);
+  return n;
+}
+
+// Code points in valid UTF-8, i.e. bytes that do not continue a sequence;
+// what SQLite's length() reports for the same text.
+inline size_t CodePointCount(std::string_view s) {
+  size_t n = 0;
+  for (unsigned char c : s)
+    n += (c & 0xC0) != 0x80;
+  return n;
+}
+
+} // namespace index
+} // namespace epiphany
@@ -0,0 +1,677 @@
+#include "epiphany/loadgen/loadgen.h"
+#include "epiphany/database/json_writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <sstream>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <thread>
+#include <unistd.h>
+
+namespace epiphany {
+namespace loadgen {
+
+namespace {
+
+constexpr int64_t kNsPerSec = 1000000000;
+
+// CLOCK_MONOTONIC, the clock the wake-up timer runs on.
+int64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * kNsPerSec + ts.tv_nsec;
+}
+
+std::string PathOf(const std::string &target) {
+  return target.substr(0, target.find('?'));
+}
+
+struct Address {
+  sockaddr_storage addr{};
+  socklen_t len{0};
+  int family{AF_INET};
+};
+
+bool Resolve(const std::string &host, int port, Address *out) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                       &res);
+  if (rc != 0 || !res) {
+    std::cerr << "Cannot resolve " << host << ": " << gai_strerror(rc)
+              << std::endl;
+    return false;
+  }
+  std::memcpy(&out->addr, res->ai_addr, res->ai_addrlen);
+  out->len = res->ai_addrlen;
+  out->family = res->ai_family;
+  freeaddrinfo(res);
+  return true;
+}
+
+// A blocking connect to check the server is there before any load is sent.
+bool Probe(const Address &address) {
+  int fd = socket(address.family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  bool ok = fd >= 0 &&
+            connect(fd, reinterpret_cast<const sockaddr *>(&address.addr),
+                    address.len) == 0;
+  if (!ok)
+    std::cerr << "Cannot connect: " << std::strerror(errno) << std::endl;
+  if (fd >= 0)
+    close(fd);
+  return ok;
+}
+
+enum class Parsed { kNeedMore, kComplete, kMalformed };
+
+// Frames one response at the front of in. Bodies are delimited by
+// Content-Length, or by the connection closing when there is none;
+// chunked responses are not supported (epiphany_search never sends them).
+Parsed ParseResponse(const std::string &in, bool eof, int *status,
+                     size_t *length, bool *close) {
+  size_t head_end = in.find("\r\n\r\n");
+  if (head_end == std::string::npos)
+    return eof && !in.empty() ? Parsed::kMalformed : Parsed::kNeedMore;
+  if (in.compare(0, 7, "HTTP/1.") != 0 || in.size() < 12)
+    return Parsed::kMalformed;
+  *status = std::atoi(in.c_str() + 9);
+  *close = in.compare(0, 8, "HTTP/1.0") == 0;
+  long content_length = -1;
+  size_t pos = in.find("\r\n") + 2;
+  while (pos < head_end) {
+    size_t eol = in.find("\r\n", pos);
+    size_t colon = in.find(':', pos);
+    if (colon != std::string::npos && colon < eol) {
+      size_t v = colon + 1;
+      while (v < eol && in[v] == ' ')
+        ++v;
+      std::string name = in.substr(pos, colon - pos);
+      std::string value = in.substr(v, eol - v);
+      if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+        content_length = std::atol(value.c_str());
+      } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+        *close = strcasecmp(value.c_str(), "close") == 0;
+      } else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+        return Parsed::kMalformed;
+      }
+    }
+    pos = eol + 2;
+  }
+  size_t body = head_end + 4;
+  if (*status == 204 || *status == 304 || *status < 200)
+    content_length = 0;
+  if (content_length < 0) {
+    if (!eof)
+      return Parsed::kNeedMore;
+    *length = in.size();
+    *close = true;
+    return Parsed::kComplete;
+  }
+  if (in.size() < body + static_cast<size_t>(content_length))
+    return eof ? Parsed::kMalformed : Parsed::kNeedMore;
+  *length = body + static_cast<size_t>(content_length);
+  return Parsed::kComplete;
+}
+
+struct Pending {
+  int64_t due_ns{0};
+  size_t entry{0};
+  bool record{false};
+};
+
+enum class Failure { kIo, kTimeout };
+
+// One thread's share of the load: its own epoll set, connections,
+// schedule and histograms.
+class Worker {
+public:
+  Worker(const Options &options, const std::vector<MixEntry> &mix,
+         const std::vector<size_t> &endpoint_of, size_t endpoints,
+         const Address &address, int index, int connections,
+         int64_t start_ns)
+      : options_(options), endpoint_of_(endpoint_of),
+        address_(address), conns_(std::max(1, connections)),
+        rng_(options.seed + static_cast<uint64_t>(index)) {
+    // Thread i of n takes arrivals i, i + n, i + 2n, ... of the global
+    // schedule, so the threads together keep the exact rate.
+    double interval = kNsPerSec / options.rate;
+    interval_ns_ = interval * options.threads;
+    next_due_ = start_ns + interval * index;
+    warm_ns_ = start_ns + static_cast<int64_t>(options.warmup_s * kNsPerSec);
+    end_ns_ = start_ns + static_cast<int64_t>(options.duration_s * kNsPerSec);
+    double total = 0;
+    for (const auto &entry : mix) {
+      total += entry.weight;
+      cumulative_.push_back(total);
+      requests_.push_back("GET " + entry.target + " HTTP/1.1\r\nHost: " +
+                          options.host +
+                          "\r\nUser-Agent: epiphany_load\r\n\r\n");
+    }
+    for (size_t i = 0; i < endpoints; ++i) {
+      stats_.emplace_back();
+      latency_.push_back(std::make_unique<observability::LatencyHistogram>());
+      service_.push_back(std::make_unique<observability::LatencyHistogram>());
+    }
+  }
+
+  void Run();
+
+  // Moves the results into stats, one per endpoint.
+  void Collect(std::vector<EndpointStats> *stats, size_t *max_backlog) {
+    for (size_t i = 0; i < stats_.size(); ++i) {
+      latency_[i]->MergeInto(stats_[i].latency.get());
+      service_[i]->MergeInto(stats_[i].service.get());
+      (*stats)[i].Merge(stats_[i]);
+    }
+    *max_backlog = std::max(*max_backlog, max_backlog_);
+  }
+
+private:
+  struct Conn {
+    int fd{-1};
+    bool connecting{false};
+    bool busy{false};
+    Pending request;
+    int64_t sent_ns{0};
+    int64_t deadline_ns{0};
+    std::string out;
+    size_t out_offset{0};
+    std::string in;
+  };
+
+  size_t Pick() {
+    double r = std::uniform_real_distribution<double>(
+        0, cumulative_.back())(rng_);
+    auto it = std::upper_bound(cumulative_.begin(), cumulative_.end(), r);
+    return std::min(static_cast<size_t>(it - cumulative_.begin()),
+                    cumulative_.size() - 1);
+  }
+
+  void Close(Conn *c) {
+    if (c->fd >= 0)
+      close(c->fd);
+    c->fd = -1;
+    c->connecting = false;
+    c->out.clear();
+    c->out_offset = 0;
+    c->in.clear();
+  }
+
+  void Fail(Conn *c, Failure failure) {
+    if (c->busy && c->request.record) {
+      EndpointStats &s = stats_[endpoint_of_[c->request.entry]];
+      ++s.requests;
+      ++(failure == Failure::kTimeout ? s.timeouts : s.io_errors);
+    }
+    c->busy = false;
+    Close(c);
+  }
+
+  void Complete(Conn *c, int status, int64_t now) {
+    if (c->request.record) {
+      size_t e = endpoint_of_[c->request.entry];
+      EndpointStats &s = stats_[e];
+      ++s.requests;
+      if (status >= 500)
+        ++s.status_5xx;
+      else if (status >= 400)
+        ++s.status_4xx;
+      else
+        ++s.ok;
+      latency_[e]->Record(static_cast<uint64_t>(now - c->request.due_ns) /
+                          1000);
+      service_[e]->Record(static_cast<uint64_t>(now - c->sent_ns) / 1000);
+    }
+    c->busy = false;
+  }
+
+  bool Connect(Conn *c, size_t index) {
+    c->fd = socket(address_.family,
+                   SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0)
+      return false;
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(c->fd, reinterpret_cast<const sockaddr *>(&address_.addr),
+                address_.len) != 0) {
+      if (errno != EINPROGRESS) {
+        Close(c);
+        return false;
+      }
+      c->connecting = true;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = index;
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, c->fd, &ev) != 0) {
+      Close(c);
+      return false;
+    }
+    return true;
+  }
+
+  // Writes what the connection has pending; false on error.
+  bool Flush(Conn *c) {
+    while (c->out_offset < c->out.size()) {
+      ssize_t n = send(c->fd, c->out.data() + c->out_offset,
+                       c->out.size() - c->out_offset, MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      c->out_offset += static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  void Send(Conn *c, int64_t now) {
+    c->out = requests_[c->request.entry];
+    c->out_offset = 0;
+    c->sent_ns = now;
+    if (!Flush(c))
+      Fail(c, Failure::kIo);
+  }
+
+  // Hands backlog requests to free connections, oldest first.
+  void Dispatch(int64_t now) {
+    for (size_t i = 0; i < conns_.size() && !backlog_.empty(); ++i) {
+      Conn &c = conns_[i];
+      if (c.busy)
+        continue;
+      c.busy = true;
+      c.request = backlog_.front();
+      backlog_.pop_front();
+      c.deadline_ns = now + static_cast<int64_t>(options_.timeout_ms) * 1000000;
+      if (c.fd < 0 && !Connect(&c, i)) {
+        Fail(&c, Failure::kIo);
+        continue;
+      }
+      if (!c.connecting)
+        Send(&c, now);
+    }
+  }
+
+  void OnEvent(size_t index, uint32_t events, int64_t now) {
+    Conn &c = conns_[index];
+    if (c.fd < 0)
+      return;
+    if (c.connecting && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) {
+        Fail(&c, Failure::kIo);
+        return;
+      }
+      c.connecting = false;
+      if (c.busy)
+        Send(&c, now);
+    } else if ((events & EPOLLOUT) && !Flush(&c)) {
+      Fail(&c, Failure::kIo);
+      return;
+    }
+    if (c.fd < 0 || c.connecting)
+      return;
+
+    bool eof = false;
+    char buf[16384];
+    for (;;) {
+      ssize_t n = read(c.fd, buf, sizeof(buf));
+      if (n > 0) {
+        c.in.append(buf, static_cast<size_t>(n));
+        continue;
+      }
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
+      eof = true; // Closed or reset.
+      break;
+    }
+    if (!c.busy) {
+      // The server closed an idle keep-alive connection; reopen on demand.
+      if (eof || !c.in.empty())
+        Close(&c);
+      return;
+    }
+    int status = 0;
+    size_t length = 0;
+    bool close_after = false;
+    switch (ParseResponse(c.in, eof, &status, &length, &close_after)) {
+    case Parsed::kNeedMore:
+      if (eof)
+        Fail(&c, Failure::kIo);
+      return;
+    case Parsed::kMalformed:
+      Fail(&c, Failure::kIo);
+      return;
+    case Parsed::kComplete:
+      Complete(&c, status, now);
+      c.in.erase(0, length);
+      if (close_after || eof)
+        Close(&c);
+      return;
+    }
+  }
+
+  const Options &options_;
+  const std::vector<size_t> &endpoint_of_;
+  const Address &address_;
+  std::vector<Conn> conns_;
+  std::mt19937_64 rng_;
+  std::vector<double> cumulative_;
+  std::vector<std::string> requests_;
+  double interval_ns_{0};
+  double next_due_{0};
+  int64_t warm_ns_{0};
+  int64_t end_ns_{0};
+  std::deque<Pending> backlog_;
+  size_t max_backlog_{0};
+  int epfd_{-1};
+  std::vector<EndpointStats> stats_;
+  std::vector<std::unique_ptr<observability::LatencyHistogram>> latency_;
+  std::vector<std::unique_ptr<observability::LatencyHistogram>> service_;
+};
+
+void Worker::Run() {
+  epfd_ = epoll_create1(EPOLL_CLOEXEC);
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  const uint64_t kTimer = conns_.size();
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.u64 = kTimer;
+  epoll_ctl(epfd_, EPOLL_CTL_ADD, timer, &ev);
+  // After the last arrival, in-flight requests get one timeout to finish.
+  const int64_t drain_ns =
+      end_ns_ + static_cast<int64_t>(options_.timeout_ms) * 1000000;
+
+  epoll_event events[64];
+  for (;;) {
+    int64_t now = NowNs();
+    while (next_due_ < end_ns_ && next_due_ <= now) {
+      int64_t due = static_cast<int64_t>(next_due_);
+      backlog_.push_back({due, Pick(), due >= warm_ns_});
+      next_due_ += interval_ns_;
+    }
+    max_backlog_ = std::max(max_backlog_, backlog_.size());
+
+    int64_t wake = next_due_ < end_ns_ ? static_cast<int64_t>(next_due_)
+                                       : drain_ns;
+    for (auto &c : conns_) {
+      if (!c.busy)
+        continue;
+      if (c.deadline_ns <= now) {
+        Fail(&c, Failure::kTimeout);
+        continue;
+      }
+      wake = std::min(wake, c.deadline_ns);
+    }
+    Dispatch(now);
+    bool in_flight = std::any_of(conns_.begin(), conns_.end(),
+                                 [](const Conn &c) { return c.busy; });
+    if (next_due_ >= end_ns_ && backlog_.empty() && !in_flight)
+      break;
+    if (now >= drain_ns) {
+      for (auto &p : backlog_) {
+        if (p.record) {
+          EndpointStats &s = stats_[endpoint_of_[p.entry]];
+          ++s.requests;
+          ++s.timeouts;
+        }
+      }
+      backlog_.clear();
+      for (auto &c : conns_)
+        Fail(&c, Failure::kTimeout);
+      break;
+    }
+
+    itimerspec spec{};
+    spec.it_value.tv_sec = wake / kNsPerSec;
+    spec.it_value.tv_nsec = std::max<int64_t>(1, wake % kNsPerSec);
+    timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+    int n = epoll_wait(epfd_, events, 64, -1);
+    now = NowNs();
+    for (int i = 0; i < n; ++i) {
+      if (events[i].data.u64 == kTimer) {
+        uint64_t expirations;
+        while (read(timer, &expirations, sizeof(expirations)) > 0) {
+        }
+        continue;
+      }
+      OnEvent(static_cast<size_t>(events[i].data.u64), events[i].events, now);
+    }
+  }
+  for (auto &c : conns_)
+    Close(&c);
+  close(timer);
+  close(epfd_);
+}
+
+void WriteHistogram(database::JsonWriter &w,
+                    const observability::HistogramSnapshot &h) {
+  w.Raw("{\"p50\":").Int(static_cast<int64_t>(h.PercentileUs(0.50)));
+  w.Raw(",\"p90\":").Int(static_cast<int64_t>(h.PercentileUs(0.90)));
+  w.Raw(",\"p99\":").Int(static_cast<int64_t>(h.PercentileUs(0.99)));
+  w.Raw(",\"p999\":").Int(static_cast<int64_t>(h.PercentileUs(0.999)));
+  w.Raw(",\"max\":").Int(static_cast<int64_t>(h.max_us));
+  w.Raw(",\"mean\":")
+      .Fixed(h.count ? static_cast<double>(h.sum_us) / h.count : 0, 1);
+  w.Raw("}");
+}
+
+void WriteStats(database::JsonWriter &w, const EndpointStats &s,
+                double measured_s) {
+  w.Raw("{\"requests\":").Int(static_cast<int64_t>(s.requests));
+  w.Raw(",\"rate\":").Fixed(measured_s > 0 ? s.requests / measured_s : 0, 1);
+  w.Raw(",\"ok\":").Int(static_cast<int64_t>(s.ok));
+  w.Raw(",\"status_4xx\":").Int(static_cast<int64_t>(s.status_4xx));
+  w.Raw(",\"status_5xx\":").Int(static_cast<int64_t>(s.status_5xx));
+  w.Raw(",\"io_errors\":").Int(static_cast<int64_t>(s.io_errors));
+  w.Raw(",\"timeouts\":").Int(static_cast<int64_t>(s.timeouts));
+  w.Raw(",\"latency_us\":");
+  WriteHistogram(w, *s.latency);
+  w.Raw(",\"service_us\":");
+  WriteHistogram(w, *s.service);
+  w.Raw("}");
+}
+
+void FormatRow(std::ostringstream &out, const char *label,
+               const observability::HistogramSnapshot &h) {
+  auto ms = [](uint64_t us) { return static_cast<double>(us) / 1000; };
+  char line[160];
+  std::snprintf(line, sizeof(line),
+                "  %-10s %9.2f %9.2f %9.2f %9.2f %9.2f\n", label,
+                ms(h.PercentileUs(0.50)), ms(h.PercentileUs(0.90)),
+                ms(h.PercentileUs(0.99)), ms(h.PercentileUs(0.999)),
+                ms(h.max_us));
+  out << line;
+}
+
+void FormatStats(std::ostringstream &out, const std::string &name,
+                 const EndpointStats &s, double measured_s) {
+  char line[200];
+  std::snprintf(line, sizeof(line),
+                "%s: %llu requests, %.1f/s, %llu ok, %llu errors "
+                "(4xx %llu, 5xx %llu, io %llu, timeout %llu)\n",
+                name.c_str(), static_cast<unsigned long long>(s.requests),
+                measured_s > 0 ? s.requests / measured_s : 0,
+                static_cast<unsigned long long>(s.ok),
+                static_cast<unsigned long long>(s.errors()),
+                static_cast<unsigned long long>(s.status_4xx),
+                static_cast<unsigned long long>(s.status_5xx),
+                static_cast<unsigned long long>(s.io_errors),
+                static_cast<unsigned long long>(s.timeouts));
+  out << line;
+  std::snprintf(line, sizeof(line), "  %-10s %9s %9s %9s %9s %9s\n", "ms",
+                "p50", "p90", "p99", "p99.9", "max");
+  out << line;
+  FormatRow(out, "latency", *s.latency);
+  FormatRow(out, "service", *s.service);
+}
+
+} // namespace
+
+EndpointStats::EndpointStats()
+    : latency(std::make_unique<observability::HistogramSnapshot>()),
+      service(std::make_unique<observability::HistogramSnapshot>()) {}
+
+void EndpointStats::Merge(const EndpointStats &other) {
+  requests += other.requests;
+  ok += other.ok;
+  status_4xx += other.status_4xx;
+  status_5xx += other.status_5xx;
+  io_errors += other.io_errors;
+  timeouts += other.timeouts;
+  std::pair<observability::HistogramSnapshot *,
+            const observability::HistogramSnapshot *>
+      hists[] = {{latency.get(), other.latency.get()},
+                 {service.get(), other.service.get()}};
+  for (auto &h : hists) {
+    for (size_t i = 0; i < h.first->counts.size(); ++i)
+      h.first->counts[i] += h.second->counts[i];
+    h.first->count += h.second->count;
+    h.first->sum_us += h.second->sum_us;
+    h.first->max_us = std::max(h.first->max_us, h.second->max_us);
+  }
+}
+
+bool LoadMix(const std::string &path, std::vector<MixEntry> *mix) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot read query mix " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  int line_no = 0;
+  while (std::getline(in, line)) {
+    ++line_no;
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#')
+      continue;
+    std::istringstream fields(line.substr(start));
+    MixEntry entry;
+    if (!(fields >> entry.weight >> entry.target) || entry.weight <= 0 ||
+        entry.target.empty() || entry.target[0] != '/') {
+      std::cerr << path << ":" << line_no
+                << ": expected \"<weight> /<target>\"" << std::endl;
+      return false;
+    }
+    mix->push_back(std::move(entry));
+  }
+  if (mix->empty()) {
+    std::cerr << "Query mix " << path << " is empty" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool Run(const Options &options, const std::vector<MixEntry> &mix,
+         Report *report) {
+  Address address;
+  if (mix.empty() || options.rate <= 0 || options.threads < 1 ||
+      !Resolve(options.host, options.port, &address) || !Probe(address))
+    return false;
+
+  report->options = options;
+  report->measured_s = std::max(0.0, options.duration_s - options.warmup_s);
+  std::vector<std::string> names;
+  std::vector<size_t> endpoint_of;
+  for (const auto &entry : mix) {
+    std::string name = PathOf(entry.target);
+    auto it = std::find(names.begin(), names.end(), name);
+    endpoint_of.push_back(static_cast<size_t>(it - names.begin()));
+    if (it == names.end())
+      names.push_back(name);
+  }
+
+  // A short lead so every thread is waiting before the first arrival.
+  int64_t start_ns = NowNs() + 20 * 1000000;
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (int i = 0; i < options.threads; ++i) {
+    int share = options.connections / options.threads +
+                (i < options.connections % options.threads ? 1 : 0);
+    workers.push_back(std::make_unique<Worker>(options, mix, endpoint_of,
+                                               names.size(), address, i,
+                                               share, start_ns));
+  }
+  std::vector<std::thread> threads;
+  for (auto &worker : workers)
+    threads.emplace_back([&worker] { worker->Run(); });
+  for (auto &thread : threads)
+    thread.join();
+
+  std::vector<EndpointStats> stats(names.size());
+  for (auto &worker : workers)
+    worker->Collect(&stats, &report->max_backlog);
+  for (size_t i = 0; i < names.size(); ++i) {
+    report->total.Merge(stats[i]);
+    report->endpoints[names[i]] = std::move(stats[i]);
+  }
+  return true;
+}
+
+std::string FormatText(const Report &report) {
+  const Options &o = report.options;
+  std::ostringstream out;
+  char line[200];
+  std::snprintf(line, sizeof(line),
+                "%.1f req/s for %.1f s (%.1f s warmup) to %s:%d over %d "
+                "connections, %d thread%s\n",
+                o.rate, o.duration_s, o.warmup_s, o.host.c_str(), o.port,
+                o.connections, o.threads, o.threads == 1 ? "" : "s");
+  out << line;
+  for (const auto &entry : report.endpoints) {
+    out << "\n";
+    FormatStats(out, entry.first, entry.second, report.measured_s);
+  }
+  out << "\n";
+  FormatStats(out, "total", report.total, report.measured_s);
+  out << "\nlatency is from when each request was due, service from when it "
+         "was sent.\nMax backlog: "
+      << report.max_backlog << " requests waiting for a connection\n";
+  return out.str();
+}
+
+std::string FormatJson(const Report &report) {
+  const Options &o = report.options;
+  std::string out;
+  database::JsonWriter w(&out);
+  w.Raw("{\"rate\":").Fixed(o.rate, 1);
+  w.Raw(",\"duration_s\":").Fixed(o.duration_s, 1);
+  w.Raw(",\"warmup_s\":").Fixed(o.warmup_s, 1);
+  w.Raw(",\"connections\":").Int(o.connections);
+  w.Raw(",\"threads\":").Int(o.threads);
+  w.Raw(",\"max_backlog\":").Int(static_cast<int64_t>(report.max_backlog));
+  w.Raw(",\"endpoints\":{");
+  bool first = true;
+  for (const auto &entry : report.endpoints) {
+    if (!first)
+      w.Raw(",");
+    first = false;
+    w.String(entry.first).Raw(":");
+    WriteStats(w, entry.second, report.measured_s);
+  }
+  w.Raw("},\"total\":");
+  WriteStats(w, report.total, report.measured_s);
+  w.Raw("}\n");
+  return out;
+}
+
+} // namespace loadgen
+} // namespace epiphany
@@ -0,0 +1,93 @@
+#pragma once
+#include "epiphany/observability/histogram.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace epiphany {
+namespace loadgen {
+
+// One line of a query mix: a request target sent with the given relative
+// weight.
+struct MixEntry {
+  double weight{1};
+  std::string target;
+};
+
+// Reads a mix file: one "<weight> <target>" per line, e.g.
+//   5 /api/search_v2?q=Pro&limit=10&offset=0
+//   1 /api/search?q=%E9%94%AE%E7%9B%98&limit=10
+// Blank lines and lines starting with '#' are skipped. False, with a
+// message on stderr, if the file cannot be read or has no valid entries.
+bool LoadMix(const std::string &path, std::vector<MixEntry> *mix);
+
+struct Options {
+  std::string host{"127.0.0.1"};
+  int port{8080};
+  // Target arrival rate over all threads, in requests per second.
+  double rate{100};
+  double duration_s{10};
+  // Requests due in the first warmup_s seconds are sent but not recorded.
+  double warmup_s{0};
+  // Keep-alive connections over all threads; each carries one request at a
+  // time.
+  int connections{16};
+  int threads{1};
+  // A request unanswered this long is counted as a timeout and its
+  // connection is reopened.
+  int timeout_ms{5000};
+  uint64_t seed{1};
+};
+
+// Results for one endpoint (the target's path, without the query string).
+struct EndpointStats {
+  uint64_t requests{0};
+  uint64_t ok{0};
+  uint64_t status_4xx{0};
+  uint64_t status_5xx{0};
+  // Connection failures, resets and malformed responses.
+  uint64_t io_errors{0};
+  uint64_t timeouts{0};
+  // From the time each request was due to the end of its response, so time
+  // spent waiting for a free connection counts: the coordinated-omission
+  // corrected view of what a user arriving at that moment would see.
+  std::unique_ptr<observability::HistogramSnapshot> latency;
+  // From the time the request was written to the end of its response: the
+  // server's service time alone.
+  std::unique_ptr<observability::HistogramSnapshot> service;
+
+  EndpointStats();
+  uint64_t errors() const {
+    return status_4xx + status_5xx + io_errors + timeouts;
+  }
+  void Merge(const EndpointStats &other);
+};
+
+struct Report {
+  Options options;
+  // Seconds over which recorded requests were due (duration less warmup).
+  double measured_s{0};
+  // Most requests ever waiting for a free connection on one thread; a
+  // growing backlog means the pool, not the server, set the pace.
+  size_t max_backlog{0};
+  std::map<std::string, EndpointStats> endpoints;
+  EndpointStats total;
+};
+
+// Drives the mix at a constant arrival rate, open-loop: request i is due at
+// i / rate whether or not earlier ones have been answered, and waits in a
+// client-side backlog when every connection is busy. Returns false if the
+// server cannot be reached at all.
+bool Run(const Options &options, const std::vector<MixEntry> &mix,
+         Report *report);
+
+// Human-readable percentile table.
+std::string FormatText(const Report &report);
+// The same figures as a JSON object, latencies in microseconds.
+std::string FormatJson(const Report &report);
+
+} // namespace loadgen
+} // namespace epiphany
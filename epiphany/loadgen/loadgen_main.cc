@@ -0,0 +1,73 @@
+#include "epiphany/loadgen/loadgen.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Open-loop HTTP load generator:
+//   epiphany_load [flags] <host:port> <mix-file>
+// See loadgen.h for the mix file format.
+int main(int argc, char *argv[]) {
+  epiphany::loadgen::Options options;
+  bool json = false;
+  std::string target, mix_file;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto flag = [&](const char *name, std::string *value) {
+      size_t n = std::strlen(name);
+      if (arg.compare(0, n, name) != 0 || arg.size() <= n || arg[n] != '=')
+        return false;
+      *value = arg.substr(n + 1);
+      return true;
+    };
+    std::string v;
+    if (flag("--rate", &v)) {
+      options.rate = std::atof(v.c_str());
+    } else if (flag("--duration", &v)) {
+      options.duration_s = std::atof(v.c_str());
+    } else if (flag("--warmup", &v)) {
+      options.warmup_s = std::atof(v.c_str());
+    } else if (flag("--connections", &v)) {
+      options.connections = std::atoi(v.c_str());
+    } else if (flag("--threads", &v)) {
+      options.threads = std::atoi(v.c_str());
+    } else if (flag("--timeout_ms", &v)) {
+      options.timeout_ms = std::atoi(v.c_str());
+    } else if (flag("--seed", &v)) {
+      options.seed = std::strtoull(v.c_str(), nullptr, 10);
+    } else if (arg == "--json") {
+      json = true;
+    } else if (arg.compare(0, 2, "--") != 0 && target.empty()) {
+      target = arg;
+    } else if (arg.compare(0, 2, "--") != 0 && mix_file.empty()) {
+      mix_file = arg;
+    } else {
+      target.clear();
+      break;
+    }
+  }
+  size_t colon = target.rfind(':');
+  if (target.empty() || mix_file.empty() || colon == std::string::npos ||
+      options.rate <= 0 || options.duration_s <= 0 ||
+      options.connections < 1 || options.threads < 1) {
+    std::cerr << "usage: " << argv[0]
+              << " [--rate=req/s] [--duration=s] [--warmup=s]"
+                 " [--connections=n] [--threads=n] [--timeout_ms=n]"
+                 " [--seed=n] [--json] <host:port> <mix-file>"
+              << std::endl;
+    return 2;
+  }
+  options.host = target.substr(0, colon);
+  options.port = std::atoi(target.c_str() + colon + 1);
+  options.threads = std::min(options.threads, options.connections);
+
+  std::vector<epiphany::loadgen::MixEntry> mix;
+  if (!epiphany::loadgen::LoadMix(mix_file, &mix))
+    return 1;
+  epiphany::loadgen::Report report;
+  if (!epiphany::loadgen::Run(options, mix, &report))
+    return 1;
+  std::cout << (json ? epiphany::loadgen::FormatJson(report)
+                     : epiphany::loadgen::FormatText(report));
+  return report.total.errors() == 0 ? 0 : 3;
+}
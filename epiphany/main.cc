@@ -1,35 +1,42 @@
 #include "epiphany/database/database.h"
 #include "epiphany/server/http_server.h"
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
 
-int main(int argc, char *argv[]) {
-  std::string conn_str = (argc > 1) ? argv[1] : "sqlite:epiphany.db";
-  const char *env_db = std::getenv("EP_DB");
-  if (env_db && std::string(env_db).size() > 0) {
-    conn_str = std::string(env_db);
-  }
-  std::cout << "Using database: " << conn_str << std::endl;
-
-  auto db = epiphany::database::Database::Create(conn_str);
-  if (!db) {
-    std::cerr << "Failed to connect to database." << std::endl;
-    return 1;
-  }
+namespace {
 
+// Creates the items table, the brand and category dictionaries and the
+// indexes, runs backend migrations and seeds the demo catalog.
+bool InitCatalog(epiphany::database::Database *db) {
   // Initialize Schema
-  const std::string init_sql = "CREATE TABLE IF NOT EXISTS items ("
-                               "id INTEGER PRIMARY KEY, "
-                               "title TEXT, "
-                               "price REAL, "
-                               "image_url TEXT);";
+  const std::string init_sql =
+      "CREATE TABLE IF NOT EXISTS brands ("
+      "id INTEGER PRIMARY KEY, "
+      "name TEXT NOT NULL UNIQUE);"
+      "CREATE TABLE IF NOT EXISTS categories ("
+      "id INTEGER PRIMARY KEY, "
+      "name TEXT NOT NULL UNIQUE);"
+      "CREATE TABLE IF NOT EXISTS items ("
+      "id INTEGER PRIMARY KEY, "
+      "title TEXT, "
+      "price REAL, "
+      "image_url TEXT, "
+      "brand_id INTEGER REFERENCES brands(id), "
+      "category_id INTEGER REFERENCES categories(id));";
   if (!db->Execute(init_sql)) {
     std::cerr << "Failed to initialize items table." << std::endl;
   }
   db->Execute(
       "CREATE UNIQUE INDEX IF NOT EXISTS idx_items_title ON items(title);");
+  for (const auto &migration : db->SchemaMigrations()) {
+    if (!db->Execute(migration)) {
+      std::cerr << "Schema migration failed: " << migration << std::endl;
+      return false;
+    }
+  }
 
   // Seed Data - Generate 1000 products
   const std::vector<std::string> categories = {
@@ -153,6 +160,7 @@ int main(int argc, char *argv[]) {
        "photo-1558494949-ef010cbdcc31?w=300&h=300&fit=crop"}};
 
   std::srand(42); // Fixed seed for reproducibility
+  std::vector<epiphany::database::Database::Item> items;
   for (int i = 1; i <= 1000; ++i) {
     const std::string &brand = brands[i % brands.size()];
     int category_idx = i % categories.size();
@@ -166,13 +174,47 @@ int main(int argc, char *argv[]) {
     std::string title =
         brand + " " + category + " " + adj + " " + std::to_string(i);
     double base_price = 500.0 + (i % 50) * 200.0 + (std::rand() % 1000);
-    std::string price = std::to_string(static_cast<int>(base_price)) + ".0";
 
-    db->Execute("INSERT OR IGNORE INTO items (title, price, image_url) VALUES "
-                "(?, ?, ?);",
-                {title, price, img});
+    epiphany::database::Database::Item item;
+    item.title = std::move(title);
+    item.price = static_cast<int>(base_price);
+    item.image_url = img;
+    item.brand = brand;
+    item.category = category;
+    items.push_back(std::move(item));
+  }
+  // One transaction instead of a commit per row; existing titles are kept.
+  epiphany::database::Database::BulkResult seeded;
+  if (!db->BulkInsert(items, {}, &seeded)) {
+    std::cerr << "Failed to seed products." << std::endl;
+    return false;
+  }
+  std::cout << "Seeded " << seeded.inserted << " products." << std::endl;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string conn_str = (argc > 1) ? argv[1] : "sqlite:epiphany.db";
+  const char *env_db = std::getenv("EP_DB");
+  if (env_db && std::string(env_db).size() > 0) {
+    conn_str = std::string(env_db);
+  }
+  std::cout << "Using database: " << conn_str << std::endl;
+
+  auto db = epiphany::database::Database::Create(conn_str);
+  if (!db) {
+    std::cerr << "Failed to connect to database." << std::endl;
+    return 1;
+  }
+
+  if (db->ReadOnly()) {
+    std::cout << "Read-only database; skipping schema setup and seeding."
+              << std::endl;
+  } else if (!InitCatalog(db.get())) {
+    return 1;
   }
-  std::cout << "Seeded 1000 products." << std::endl;
 
   int port = 8080;
   const char *env_port = std::getenv("EP_PORT");
@@ -187,7 +229,41 @@ int main(int argc, char *argv[]) {
   if (env_web && std::string(env_web).size() > 0) {
     web_root = std::string(env_web);
   }
-  epiphany::server::HttpServer server(port, std::move(db), web_root);
+  auto env_int = [](const char *name, int fallback) {
+    const char *v = std::getenv(name);
+    if (v) {
+      try {
+        return std::stoi(v);
+      } catch (...) {
+      }
+    }
+    return fallback;
+  };
+  epiphany::server::ServerOptions options;
+  options.io_threads = env_int("EP_IO_THREADS", options.io_threads);
+  options.worker_threads = env_int("EP_WORKER_THREADS", options.worker_threads);
+  options.backlog = env_int("EP_BACKLOG", options.backlog);
+  options.reuse_port = env_int("EP_REUSEPORT", options.reuse_port ? 1 : 0) != 0;
+  options.idle_timeout_ms =
+      env_int("EP_IDLE_TIMEOUT_MS", options.idle_timeout_ms);
+  options.max_body_bytes =
+      static_cast<size_t>(std::max(1, env_int("EP_MAX_BODY_MB", 8))) << 20;
+  options.admission.concurrency =
+      env_int("EP_CONCURRENCY", options.admission.concurrency);
+  options.admission.adaptive =
+      env_int("EP_ADAPTIVE_CONCURRENCY", options.admission.adaptive) != 0;
+  options.admission.max_queue =
+      env_int("EP_MAX_QUEUE", options.admission.max_queue);
+  options.admission.retry_after_s =
+      env_int("EP_RETRY_AFTER_S", options.admission.retry_after_s);
+  options.default_deadline_ms =
+      env_int("EP_DEADLINE_MS", options.default_deadline_ms);
+  options.static_files.max_age_s =
+      env_int("EP_STATIC_MAX_AGE_S", options.static_files.max_age_s);
+  options.qrs.cache_bytes =
+      static_cast<size_t>(std::max(0, env_int("EP_CACHE_MB", 64))) << 20;
+  options.qrs.cache_ttl_ms = env_int("EP_CACHE_TTL_MS", options.qrs.cache_ttl_ms);
+  epiphany::server::HttpServer server(port, std::move(db), web_root, options);
   server.Start();
 
   return 0;
@@ -0,0 +1,39 @@
+#include "epiphany/observability/histogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace epiphany {
+namespace observability {
+
+uint64_t HistogramSnapshot::PercentileUs(double p) const {
+  if (count == 0)
+    return 0;
+  uint64_t rank = static_cast<uint64_t>(std::ceil(p * count));
+  rank = std::max<uint64_t>(1, std::min(rank, count));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    seen += counts[i];
+    if (seen >= rank)
+      return std::min(HistogramBuckets::Highest(i), max_us);
+  }
+  return max_us;
+}
+
+uint64_t HistogramSnapshot::CountAtOrBelow(uint64_t us) const {
+  uint64_t total = 0;
+  size_t last = HistogramBuckets::Index(us);
+  for (size_t i = 0; i <= last; ++i)
+    total += counts[i];
+  return total;
+}
+
+void LatencyHistogram::MergeInto(HistogramSnapshot *out) const {
+  for (size_t i = 0; i < counts_.size(); ++i)
+    out->counts[i] += counts_[i].load(std::memory_order_relaxed);
+  out->count += count_.load(std::memory_order_relaxed);
+  out->sum_us += sum_us_.load(std::memory_order_relaxed);
+  out->max_us = std::max(out->max_us, max_us_.load(std::memory_order_relaxed));
+}
+
+} // namespace observability
+} // namespace epiphany
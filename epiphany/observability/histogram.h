@@ -0,0 +1,90 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace epiphany {
+namespace observability {
+
+// Log-linear (HDR-style) buckets over microseconds: exact below 128 us,
+// then 64 buckets per power of two, so any recorded value is known to
+// within 1/64 (~1.6%). Values from 2^36 us (about 19 hours) up share the
+// last bucket.
+struct HistogramBuckets {
+  static constexpr int kSubBits = 6;
+  static constexpr uint64_t kSubCount = uint64_t{1} << kSubBits;
+  static constexpr int kMaxBits = 36;
+  static constexpr uint64_t kMaxValue = (uint64_t{1} << kMaxBits) - 1;
+  static constexpr size_t kCount = (kMaxBits - kSubBits + 1) * kSubCount;
+
+  static size_t Index(uint64_t us) {
+    if (us > kMaxValue)
+      us = kMaxValue;
+    if (us < 2 * kSubCount)
+      return static_cast<size_t>(us);
+    int shift = 63 - __builtin_clzll(us) - kSubBits;
+    return (static_cast<size_t>(shift) << kSubBits) +
+           static_cast<size_t>(us >> shift);
+  }
+  static uint64_t Lowest(size_t index) {
+    if (index < 2 * kSubCount)
+      return index;
+    int shift = static_cast<int>(index >> kSubBits) - 1;
+    return static_cast<uint64_t>(index - (static_cast<size_t>(shift)
+                                          << kSubBits))
+           << shift;
+  }
+  static uint64_t Highest(size_t index) {
+    if (index < 2 * kSubCount)
+      return index;
+    int shift = static_cast<int>(index >> kSubBits) - 1;
+    return Lowest(index) + (uint64_t{1} << shift) - 1;
+  }
+};
+
+// Merged counts, taken on scrape.
+struct HistogramSnapshot {
+  std::array<uint64_t, HistogramBuckets::kCount> counts{};
+  uint64_t count{0};
+  uint64_t sum_us{0};
+  uint64_t max_us{0};
+
+  // Upper edge of the bucket holding the p-quantile (0 < p <= 1), capped
+  // at the largest value seen; 0 when empty.
+  uint64_t PercentileUs(double p) const;
+  // Number of values at most us, to bucket resolution.
+  uint64_t CountAtOrBelow(uint64_t us) const;
+};
+
+// A histogram with a single writing thread. Record uses relaxed loads and
+// stores instead of read-modify-writes, so it costs a few plain memory
+// operations on lines no other core writes; readers on other threads see
+// counts that are at most a few records stale.
+class LatencyHistogram {
+public:
+  void Record(uint64_t us) {
+    Bump(&counts_[HistogramBuckets::Index(us)], 1);
+    Bump(&count_, 1);
+    Bump(&sum_us_, us);
+    if (us > max_us_.load(std::memory_order_relaxed))
+      max_us_.store(us, std::memory_order_relaxed);
+  }
+
+  // Adds this histogram's counts to *out.
+  void MergeInto(HistogramSnapshot *out) const;
+
+private:
+  static void Bump(std::atomic<uint64_t> *v, uint64_t n) {
+    v->store(v->load(std::memory_order_relaxed) + n,
+             std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, HistogramBuckets::kCount> counts_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_us_{0};
+  std::atomic<uint64_t> max_us_{0};
+};
+
+} // namespace observability
+} // namespace epiphany
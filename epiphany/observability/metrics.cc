@@ -1,56 +1,283 @@
 #include "epiphany/observability/metrics.h"
-#include <sstream>
+#include "epiphany/observability/histogram.h"
+#include <algorithm>
 #include <array>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
 namespace epiphany {
 namespace observability {
-std::atomic<long> Metrics::requests{0};
 std::atomic<long> Metrics::api_search{0};
 std::atomic<long> Metrics::api_search_v2{0};
+std::atomic<long> Metrics::api_suggest{0};
+std::atomic<long> Metrics::api_bulk{0};
+std::atomic<long> Metrics::bulk_rows{0};
 std::atomic<long> Metrics::health{0};
+std::atomic<long> Metrics::static_files{0};
+std::atomic<long> Metrics::static_not_modified{0};
 std::atomic<long> Metrics::errors{0};
-std::atomic<long> Metrics::total_latency_ms{0};
-std::atomic<long> Metrics::last_latency_ms{0};
-std::array<std::atomic<long>, 10> Metrics::latency_buckets{
-    std::atomic<long>{0}, std::atomic<long>{0}, std::atomic<long>{0},
-    std::atomic<long>{0}, std::atomic<long>{0}, std::atomic<long>{0},
-    std::atomic<long>{0}, std::atomic<long>{0}, std::atomic<long>{0},
-    std::atomic<long>{0}};
-static const long bucket_edges[10] = {1, 5, 10, 50, 100, 200, 500, 1000, 2000, 1LL << 60};
-void Metrics::RecordRequest() { requests.fetch_add(1); }
-void Metrics::RecordLatency(long ms) {
-  last_latency_ms.store(ms);
-  total_latency_ms.fetch_add(ms);
-  for (int i = 0; i < 10; ++i) {
-    if (ms <= bucket_edges[i]) {
-      latency_buckets[i].fetch_add(1);
-      break;
-    }
+std::atomic<long> Metrics::shed{0};
+std::atomic<long> Metrics::timeouts{0};
+std::atomic<long> Metrics::concurrency_limit{0};
+std::atomic<long> Metrics::queued{0};
+std::atomic<long> Metrics::stmt_cache_hits{0};
+std::atomic<long> Metrics::stmt_cache_misses{0};
+std::atomic<long> Metrics::cache_hits{0};
+std::atomic<long> Metrics::cache_misses{0};
+std::atomic<long> Metrics::cache_evictions{0};
+std::atomic<long> Metrics::ingest_events{0};
+std::atomic<long> Metrics::ingest_errors{0};
+std::atomic<long> Metrics::ingest_lag_ms{0};
+std::atomic<long> Metrics::delta_ids{0};
+std::atomic<long> Metrics::merges{0};
+std::atomic<long> Metrics::merge_failures{0};
+std::atomic<long> Metrics::last_merge_ms{0};
+std::atomic<long> Metrics::total_merge_ms{0};
+
+namespace {
+
+constexpr size_t kEndpoints = static_cast<size_t>(Endpoint::kCount);
+
+// One thread's histograms. Shards are created on a thread's first request
+// and kept after it exits, so its counts are never lost.
+struct alignas(64) Shard {
+  std::array<LatencyHistogram, kEndpoints> latency;
+};
+
+std::mutex shards_mu;
+std::vector<std::unique_ptr<Shard>> shards;
+
+Shard *ThreadShard() {
+  thread_local Shard *shard = [] {
+    std::lock_guard<std::mutex> lock(shards_mu);
+    shards.push_back(std::make_unique<Shard>());
+    return shards.back().get();
+  }();
+  return shard;
+}
+
+std::array<HistogramSnapshot, kEndpoints> SnapshotLatency() {
+  std::array<HistogramSnapshot, kEndpoints> out;
+  std::lock_guard<std::mutex> lock(shards_mu);
+  for (const auto &shard : shards) {
+    for (size_t e = 0; e < kEndpoints; ++e)
+      shard->latency[e].MergeInto(&out[e]);
   }
+  return out;
 }
-static long Percentile(double p) {
-  long total = 0;
-  for (int i = 0; i < 10; ++i) total += Metrics::latency_buckets[i].load();
-  if (total == 0) return 0;
-  long target = static_cast<long>(p * total);
-  long acc = 0;
-  for (int i = 0; i < 10; ++i) {
-    acc += Metrics::latency_buckets[i].load();
-    if (acc >= target) return bucket_edges[i];
+
+HistogramSnapshot Total(const std::array<HistogramSnapshot, kEndpoints> &all) {
+  HistogramSnapshot total;
+  for (const auto &h : all) {
+    for (size_t i = 0; i < h.counts.size(); ++i)
+      total.counts[i] += h.counts[i];
+    total.count += h.count;
+    total.sum_us += h.sum_us;
+    total.max_us = std::max(total.max_us, h.max_us);
   }
-  return bucket_edges[9];
+  return total;
 }
+
+double Ms(uint64_t us) { return static_cast<double>(us) / 1000.0; }
+
+// Bucket edges of the exported Prometheus histogram, in microseconds. The
+// quantiles come from the full-resolution histogram instead.
+constexpr uint64_t kPromEdgesUs[] = {
+    50,     100,    250,    500,     1000,    2500,    5000,    10000,
+    25000,  50000,  100000, 250000,  500000,  1000000, 2500000, 5000000,
+    10000000};
+constexpr double kQuantiles[] = {0.5, 0.9, 0.95, 0.99, 0.999};
+
+} // namespace
+
+const char *EndpointName(Endpoint endpoint) {
+  switch (endpoint) {
+  case Endpoint::kSearch:
+    return "api_search";
+  case Endpoint::kSearchV2:
+    return "api_search_v2";
+  case Endpoint::kSuggest:
+    return "api_suggest";
+  case Endpoint::kStatic:
+    return "static";
+  case Endpoint::kHealth:
+    return "health";
+  case Endpoint::kBulk:
+    return "api_bulk";
+  case Endpoint::kMetrics:
+    return "metrics";
+  default:
+    return "other";
+  }
+}
+
+void Metrics::RecordRequest(Endpoint endpoint, long latency_us) {
+  ThreadShard()->latency[static_cast<size_t>(endpoint)].Record(
+      static_cast<uint64_t>(std::max(0L, latency_us)));
+}
+
 std::string Metrics::ToJson() {
-  long req = requests.load();
-  long avg = req > 0 ? total_latency_ms.load() / req : 0;
-  long p95 = Percentile(0.95);
-  long p99 = Percentile(0.99);
+  auto latency = SnapshotLatency();
+  HistogramSnapshot total = Total(latency);
+  long req = static_cast<long>(total.count);
+  double avg = req > 0 ? Ms(total.sum_us) / req : 0.0;
+  long hits = cache_hits.load();
+  long lookups = hits + cache_misses.load();
+  double hit_ratio = lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
   std::ostringstream oss;
   oss << "{\"requests\":" << req << ",\"api_search\":" << api_search.load()
       << ",\"api_search_v2\":" << api_search_v2.load()
-      << ",\"health\":" << health.load() << ",\"errors\":" << errors.load()
-      << ",\"last_latency_ms\":" << last_latency_ms.load()
+      << ",\"api_suggest\":" << api_suggest.load()
+      << ",\"api_bulk\":" << api_bulk.load()
+      << ",\"bulk_rows\":" << bulk_rows.load()
+      << ",\"health\":" << health.load()
+      << ",\"static_files\":" << static_files.load()
+      << ",\"static_not_modified\":" << static_not_modified.load()
+      << ",\"errors\":" << errors.load()
+      << ",\"shed\":" << shed.load()
+      << ",\"timeouts\":" << timeouts.load()
+      << ",\"concurrency_limit\":" << concurrency_limit.load()
+      << ",\"queued\":" << queued.load()
       << ",\"avg_latency_ms\":" << avg
-      << ",\"p95_ms\":" << p95 << ",\"p99_ms\":" << p99 << "}";
+      << ",\"p50_ms\":" << Ms(total.PercentileUs(0.5))
+      << ",\"p95_ms\":" << Ms(total.PercentileUs(0.95))
+      << ",\"p99_ms\":" << Ms(total.PercentileUs(0.99))
+      << ",\"max_ms\":" << Ms(total.max_us)
+      << ",\"stmt_cache_hits\":" << stmt_cache_hits.load()
+      << ",\"stmt_cache_misses\":" << stmt_cache_misses.load()
+      << ",\"cache_hits\":" << hits
+      << ",\"cache_misses\":" << cache_misses.load()
+      << ",\"cache_hit_ratio\":" << hit_ratio
+      << ",\"cache_evictions\":" << cache_evictions.load()
+      << ",\"ingest_events\":" << ingest_events.load()
+      << ",\"ingest_errors\":" << ingest_errors.load()
+      << ",\"ingest_lag_ms\":" << ingest_lag_ms.load()
+      << ",\"delta_ids\":" << delta_ids.load()
+      << ",\"merges\":" << merges.load()
+      << ",\"merge_failures\":" << merge_failures.load()
+      << ",\"last_merge_ms\":" << last_merge_ms.load()
+      << ",\"total_merge_ms\":" << total_merge_ms.load()
+      << ",\"latency\":{";
+  bool first = true;
+  for (size_t e = 0; e < kEndpoints; ++e) {
+    const HistogramSnapshot &h = latency[e];
+    if (h.count == 0)
+      continue;
+    oss << (first ? "" : ",") << "\"" << EndpointName(static_cast<Endpoint>(e))
+        << "\":{\"count\":" << h.count
+        << ",\"avg_ms\":" << Ms(h.sum_us) / h.count
+        << ",\"p50_ms\":" << Ms(h.PercentileUs(0.5))
+        << ",\"p95_ms\":" << Ms(h.PercentileUs(0.95))
+        << ",\"p99_ms\":" << Ms(h.PercentileUs(0.99))
+        << ",\"max_ms\":" << Ms(h.max_us) << "}";
+    first = false;
+  }
+  oss << "}}";
+  return oss.str();
+}
+
+std::string Metrics::ToPrometheus() {
+  struct Scalar {
+    const char *name;
+    const char *type;
+    const char *help;
+    const std::atomic<long> *value;
+  };
+  static const Scalar kScalars[] = {
+      {"epiphany_search_requests_total", "counter",
+       "Calls to /api/search.", &api_search},
+      {"epiphany_search_v2_requests_total", "counter",
+       "Calls to /api/search_v2.", &api_search_v2},
+      {"epiphany_suggest_requests_total", "counter",
+       "Calls to /api/suggest.", &api_suggest},
+      {"epiphany_bulk_requests_total", "counter",
+       "Calls to /api/items:bulk.", &api_bulk},
+      {"epiphany_bulk_rows_total", "counter", "Rows written by bulk loads.",
+       &bulk_rows},
+      {"epiphany_health_requests_total", "counter", "Calls to /health.",
+       &health},
+      {"epiphany_static_files_total", "counter", "Static files served.",
+       &static_files},
+      {"epiphany_static_not_modified_total", "counter",
+       "Static files answered with 304.", &static_not_modified},
+      {"epiphany_errors_total", "counter", "Requests that failed.", &errors},
+      {"epiphany_shed_total", "counter",
+       "Requests refused with 503 by admission control.", &shed},
+      {"epiphany_timeouts_total", "counter",
+       "Requests that ran out of their deadline.", &timeouts},
+      {"epiphany_concurrency_limit", "gauge",
+       "Requests admission control lets run at once.", &concurrency_limit},
+      {"epiphany_queued_requests", "gauge",
+       "Admitted requests waiting for a slot.", &queued},
+      {"epiphany_stmt_cache_hits_total", "counter",
+       "Prepared statement cache hits.", &stmt_cache_hits},
+      {"epiphany_stmt_cache_misses_total", "counter",
+       "Prepared statement cache misses.", &stmt_cache_misses},
+      {"epiphany_result_cache_hits_total", "counter",
+       "Search result cache hits.", &cache_hits},
+      {"epiphany_result_cache_misses_total", "counter",
+       "Search result cache misses.", &cache_misses},
+      {"epiphany_result_cache_evictions_total", "counter",
+       "Search result cache evictions.", &cache_evictions},
+      {"epiphany_ingest_events_total", "counter", "Catalog events applied.",
+       &ingest_events},
+      {"epiphany_ingest_errors_total", "counter",
+       "Catalog events rejected.", &ingest_errors},
+      {"epiphany_ingest_lag_ms", "gauge",
+       "Age of the last applied event when it was applied.", &ingest_lag_ms},
+      {"epiphany_delta_ids", "gauge", "Ids in the unmerged live delta.",
+       &delta_ids},
+      {"epiphany_merges_total", "counter", "Live delta merges.", &merges},
+      {"epiphany_merge_failures_total", "counter",
+       "Live delta merges that failed.", &merge_failures},
+      {"epiphany_last_merge_ms", "gauge", "Duration of the last merge.",
+       &last_merge_ms},
+      {"epiphany_merge_ms_total", "counter", "Time spent merging.",
+       &total_merge_ms},
+  };
+  std::ostringstream oss;
+  oss.precision(12);
+  for (const auto &s : kScalars) {
+    oss << "# HELP " << s.name << " " << s.help << "\n# TYPE " << s.name
+        << " " << s.type << "\n"
+        << s.name << " " << s.value->load() << "\n";
+  }
+
+  auto latency = SnapshotLatency();
+  const char *hist = "epiphany_request_duration_seconds";
+  oss << "# HELP " << hist << " Request latency by endpoint.\n# TYPE "
+      << hist << " histogram\n";
+  for (size_t e = 0; e < kEndpoints; ++e) {
+    const HistogramSnapshot &h = latency[e];
+    const char *name = EndpointName(static_cast<Endpoint>(e));
+    for (uint64_t edge : kPromEdgesUs) {
+      oss << hist << "_bucket{endpoint=\"" << name << "\",le=\""
+          << static_cast<double>(edge) / 1e6 << "\"} " << h.CountAtOrBelow(edge)
+          << "\n";
+    }
+    oss << hist << "_bucket{endpoint=\"" << name << "\",le=\"+Inf\"} "
+        << h.count << "\n"
+        << hist << "_sum{endpoint=\"" << name << "\"} "
+        << static_cast<double>(h.sum_us) / 1e6 << "\n"
+        << hist << "_count{endpoint=\"" << name << "\"} " << h.count << "\n";
+  }
+  const char *summary = "epiphany_request_latency_seconds";
+  oss << "# HELP " << summary
+      << " Request latency quantiles by endpoint, since start.\n# TYPE "
+      << summary << " summary\n";
+  for (size_t e = 0; e < kEndpoints; ++e) {
+    const HistogramSnapshot &h = latency[e];
+    const char *name = EndpointName(static_cast<Endpoint>(e));
+    for (double q : kQuantiles) {
+      oss << summary << "{endpoint=\"" << name << "\",quantile=\"" << q
+          << "\"} " << static_cast<double>(h.PercentileUs(q)) / 1e6 << "\n";
+    }
+    oss << summary << "_sum{endpoint=\"" << name << "\"} "
+        << static_cast<double>(h.sum_us) / 1e6 << "\n"
+        << summary << "_count{endpoint=\"" << name << "\"} " << h.count
+        << "\n";
+  }
   return oss.str();
 }
 } // namespace observability
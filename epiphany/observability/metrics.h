@@ -4,18 +4,56 @@
 #include <string>
 namespace epiphany {
 namespace observability {
+// Request latency is tracked per endpoint in microsecond histograms (see
+// histogram.h). Each thread records into its own cache-line-aligned set,
+// so requests never contend on a shared counter; scrapes merge them.
+enum class Endpoint {
+  kSearch,
+  kSearchV2,
+  kSuggest,
+  kStatic,
+  kHealth,
+  kBulk,
+  kMetrics,
+  kOther,
+  kCount,
+};
+const char *EndpointName(Endpoint endpoint);
 struct Metrics {
-  static std::atomic<long> requests;
   static std::atomic<long> api_search;
   static std::atomic<long> api_search_v2;
+  static std::atomic<long> api_suggest;
+  static std::atomic<long> api_bulk;
+  static std::atomic<long> bulk_rows;
   static std::atomic<long> health;
+  static std::atomic<long> static_files;
+  static std::atomic<long> static_not_modified;
   static std::atomic<long> errors;
-  static std::atomic<long> total_latency_ms;
-  static std::atomic<long> last_latency_ms;
-  static std::array<std::atomic<long>, 10> latency_buckets;
+  // Requests turned away by admission control, and requests answered past
+  // or cut short by their deadline.
+  static std::atomic<long> shed;
+  static std::atomic<long> timeouts;
+  // Admission state: the concurrency limit in force and the requests
+  // waiting for a slot under it.
+  static std::atomic<long> concurrency_limit;
+  static std::atomic<long> queued;
+  static std::atomic<long> stmt_cache_hits;
+  static std::atomic<long> stmt_cache_misses;
+  static std::atomic<long> cache_hits;
+  static std::atomic<long> cache_misses;
+  static std::atomic<long> cache_evictions;
+  static std::atomic<long> ingest_events;
+  static std::atomic<long> ingest_errors;
+  static std::atomic<long> ingest_lag_ms;
+  static std::atomic<long> delta_ids;
+  static std::atomic<long> merges;
+  static std::atomic<long> merge_failures;
+  static std::atomic<long> last_merge_ms;
+  static std::atomic<long> total_merge_ms;
   static std::string ToJson();
-  static void RecordRequest();
-  static void RecordLatency(long ms);
+  // Prometheus text exposition format, version 0.0.4.
+  static std::string ToPrometheus();
+  static void RecordRequest(Endpoint endpoint, long latency_us);
 };
 } // namespace observability
 } // namespace epiphany
@@ -0,0 +1,219 @@
+#include "epiphany/observability/trace.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+
+namespace epiphany {
+namespace observability {
+
+namespace {
+
+static_assert(sizeof(TraceRecord) % sizeof(uint64_t) == 0,
+              "TraceRecord is copied as whole words");
+constexpr size_t kRecordWords = sizeof(TraceRecord) / sizeof(uint64_t);
+
+// A slot is guarded by a sequence number that is odd while the owner
+// writes it. The words are atomics so that a reader racing the writer
+// sees stale or torn data, which it then discards, rather than undefined
+// behaviour.
+struct Slot {
+  std::atomic<uint64_t> seq{0};
+  std::array<std::atomic<uint64_t>, kRecordWords> words{};
+};
+
+struct alignas(64) Ring {
+  std::array<Slot, TraceStore::kRingSize> slots;
+  // Only the owning thread writes next.
+  size_t next{0};
+
+  void Put(const TraceRecord &record) {
+    uint64_t words[kRecordWords];
+    std::memcpy(words, &record, sizeof(record));
+    Slot &slot = slots[next];
+    next = (next + 1) % slots.size();
+    uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kRecordWords; ++i)
+      slot.words[i].store(words[i], std::memory_order_relaxed);
+    slot.seq.store(seq + 2, std::memory_order_release);
+  }
+
+  // False if the slot is empty or was being rewritten.
+  static bool Get(const Slot &slot, TraceRecord *record) {
+    uint64_t before = slot.seq.load(std::memory_order_acquire);
+    if (before == 0 || (before & 1) != 0)
+      return false;
+    uint64_t words[kRecordWords];
+    for (size_t i = 0; i < kRecordWords; ++i)
+      words[i] = slot.words[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != before)
+      return false;
+    std::memcpy(record, words, sizeof(*record));
+    return true;
+  }
+};
+
+std::mutex rings_mu;
+std::vector<std::unique_ptr<Ring>> rings;
+
+Ring *ThreadRing() {
+  thread_local Ring *ring = [] {
+    std::lock_guard<std::mutex> lock(rings_mu);
+    rings.push_back(std::make_unique<Ring>());
+    return rings.back().get();
+  }();
+  return ring;
+}
+
+thread_local Trace *current_trace = nullptr;
+
+bool ValidTraceId(const std::string &id) {
+  if (id.empty() || id.size() > 36)
+    return false;
+  for (char c : id) {
+    bool ok = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+              (c >= 'A' && c <= 'Z') || c == '.' || c == '_' || c == ':' ||
+              c == '-';
+    if (!ok)
+      return false;
+  }
+  return true;
+}
+
+uint64_t RandomId() {
+  thread_local std::mt19937_64 rng([] {
+    std::random_device rd;
+    std::seed_seq seq{rd(), rd(), rd(), rd()};
+    return std::mt19937_64(seq);
+  }());
+  uint64_t id;
+  do {
+    id = rng();
+  } while (id == 0);
+  return id;
+}
+
+} // namespace
+
+const char *StageName(Stage stage) {
+  switch (stage) {
+  case Stage::kAccept:
+    return "accept";
+  case Stage::kRead:
+    return "read";
+  case Stage::kParse:
+    return "parse";
+  case Stage::kQueue:
+    return "queue";
+  case Stage::kRoute:
+    return "route";
+  case Stage::kCount:
+    return "count";
+  case Stage::kSearch:
+    return "search";
+  case Stage::kAggregate:
+    return "aggregate";
+  case Stage::kSerialize:
+    return "serialize";
+  case Stage::kSend:
+    return "send";
+  default:
+    return "unknown";
+  }
+}
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+Trace::Trace(const std::string &trace_id, int64_t start_ns)
+    : start_ns_(start_ns) {
+  if (ValidTraceId(trace_id)) {
+    std::memcpy(record_.trace_id, trace_id.data(), trace_id.size());
+  } else {
+    std::snprintf(record_.trace_id, sizeof(record_.trace_id), "%016llx",
+                  static_cast<unsigned long long>(RandomId()));
+  }
+  auto wall = std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::system_clock::now().time_since_epoch())
+                  .count();
+  record_.start_unix_us = wall - (NowNs() - start_ns) / 1000;
+  record_.endpoint = Endpoint::kOther;
+}
+
+void Trace::AddSpan(Stage stage, int64_t begin_ns, int64_t end_ns) {
+  if (record_.span_count >= TraceRecord::kMaxSpans)
+    return;
+  TraceRecord::Span &span = record_.spans[record_.span_count++];
+  span.stage = stage;
+  span.offset_ns = begin_ns - start_ns_;
+  span.duration_ns = std::max<int64_t>(0, end_ns - begin_ns);
+}
+
+int64_t Trace::StageNs(Stage stage) const {
+  int64_t total = 0;
+  for (uint32_t i = 0; i < record_.span_count; ++i) {
+    if (record_.spans[i].stage == stage)
+      total += record_.spans[i].duration_ns;
+  }
+  return total;
+}
+
+void Trace::SetTarget(const std::string &target) {
+  size_t n = std::min(target.size(), sizeof(record_.target) - 1);
+  std::memcpy(record_.target, target.data(), n);
+  record_.target[n] = '\0';
+}
+
+void Trace::SetResult(int status, Endpoint endpoint) {
+  record_.status = static_cast<uint32_t>(status);
+  record_.endpoint = endpoint;
+}
+
+void Trace::Finish() {
+  record_.total_ns = NowNs() - start_ns_;
+  ThreadRing()->Put(record_);
+}
+
+Trace *CurrentTrace() { return current_trace; }
+
+ScopedTrace::ScopedTrace(Trace *trace) : previous_(current_trace) {
+  current_trace = trace;
+}
+
+ScopedTrace::~ScopedTrace() { current_trace = previous_; }
+
+std::vector<TraceRecord> TraceStore::Slowest(size_t n) {
+  std::vector<TraceRecord> all;
+  {
+    std::lock_guard<std::mutex> lock(rings_mu);
+    all.reserve(rings.size() * kRingSize);
+    TraceRecord record;
+    for (const auto &ring : rings) {
+      for (const auto &slot : ring->slots) {
+        if (Ring::Get(slot, &record))
+          all.push_back(record);
+      }
+    }
+  }
+  n = std::min(n, all.size());
+  std::partial_sort(all.begin(), all.begin() + n, all.end(),
+                    [](const TraceRecord &a, const TraceRecord &b) {
+                      return a.total_ns > b.total_ns;
+                    });
+  all.resize(n);
+  return all;
+}
+
+} // namespace observability
+} // namespace epiphany
@@ -0,0 +1,138 @@
+#pragma once
+#include "epiphany/observability/metrics.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace epiphany {
+namespace observability {
+
+// Where a request spends its time. accept, read and parse happen on the
+// I/O thread, queue is the wait for a worker, route through serialize run
+// on the worker, and send covers the hand-back to the I/O thread and the
+// first write.
+enum class Stage : uint32_t {
+  kAccept,
+  kRead,
+  kParse,
+  kQueue,
+  kRoute,
+  kCount,
+  kSearch,
+  kAggregate,
+  kSerialize,
+  kSend,
+  kStages,
+};
+const char *StageName(Stage stage);
+
+// Monotonic nanoseconds, the clock every span is measured on.
+int64_t NowNs();
+
+// A finished trace as kept in the store. Plain data of fixed size, so it
+// can be copied in and out of the ring buffers word by word.
+struct TraceRecord {
+  static constexpr size_t kMaxSpans = 16;
+  static constexpr size_t kMaxIdBytes = 40;
+  static constexpr size_t kMaxTargetBytes = 120;
+
+  struct Span {
+    Stage stage;
+    uint32_t reserved;
+    // Relative to the trace start; negative for work done before the
+    // request's first byte arrived (the accept).
+    int64_t offset_ns;
+    int64_t duration_ns;
+  };
+
+  char trace_id[kMaxIdBytes];
+  // Request target, truncated.
+  char target[kMaxTargetBytes];
+  int64_t start_unix_us;
+  int64_t total_ns;
+  uint32_t status;
+  Endpoint endpoint;
+  uint32_t span_count;
+  uint32_t reserved;
+  Span spans[kMaxSpans];
+};
+
+// One request's trace while it is in flight. It is handed between the I/O
+// thread and a worker but only touched by one thread at a time; Finish
+// publishes it to the store of the thread that calls it.
+class Trace {
+public:
+  // Uses trace_id if it is a plausible id (1 to 36 of [0-9A-Za-z._:-]),
+  // otherwise a random one. start_ns is when the request's first byte was
+  // read.
+  Trace(const std::string &trace_id, int64_t start_ns);
+
+  const char *id() const { return record_.trace_id; }
+  int64_t start_ns() const { return start_ns_; }
+
+  void AddSpan(Stage stage, int64_t begin_ns, int64_t end_ns);
+  // Total time recorded for a stage so far.
+  int64_t StageNs(Stage stage) const;
+
+  void SetTarget(const std::string &target);
+  void SetResult(int status, Endpoint endpoint);
+  // Stamps the total and copies the trace into this thread's ring buffer.
+  void Finish();
+
+private:
+  TraceRecord record_{};
+  int64_t start_ns_;
+};
+
+// The trace of the request the calling thread is working on, if any.
+Trace *CurrentTrace();
+
+// Makes trace current on this thread for the lifetime of the scope.
+class ScopedTrace {
+public:
+  explicit ScopedTrace(Trace *trace);
+  ~ScopedTrace();
+  ScopedTrace(const ScopedTrace &) = delete;
+  ScopedTrace &operator=(const ScopedTrace &) = delete;
+
+private:
+  Trace *previous_;
+};
+
+// Adds a span to the current trace, if there is one, when the scope ends
+// or End is called.
+class ScopedSpan {
+public:
+  explicit ScopedSpan(Stage stage)
+      : trace_(CurrentTrace()), stage_(stage),
+        begin_ns_(trace_ ? NowNs() : 0) {}
+  ~ScopedSpan() { End(); }
+  ScopedSpan(const ScopedSpan &) = delete;
+  ScopedSpan &operator=(const ScopedSpan &) = delete;
+
+  void End() {
+    if (trace_)
+      trace_->AddSpan(stage_, begin_ns_, NowNs());
+    trace_ = nullptr;
+  }
+
+private:
+  Trace *trace_;
+  Stage stage_;
+  int64_t begin_ns_;
+};
+
+// Finished traces live in fixed-size rings, one per thread that finishes
+// requests. The owning thread overwrites the oldest slot without locking;
+// readers copy slots under a per-slot sequence number and skip any slot
+// rewritten while they read it.
+struct TraceStore {
+  static constexpr size_t kRingSize = 256;
+
+  // The n slowest traces still held, slowest first.
+  static std::vector<TraceRecord> Slowest(size_t n);
+};
+
+} // namespace observability
+} // namespace epiphany
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <string>
+namespace epiphany {
+namespace qrs {
+// Opaque keyset-pagination cursor. It carries the ordering key of the last
+// item returned (the item id, since results are in id order) as base64url
+// text so clients treat it as a token rather than a number to tweak.
+struct Cursor {
+  int64_t last_id{0};
+};
+inline std::string EncodeCursor(const Cursor &cursor) {
+  static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  std::string raw = "i" + std::to_string(cursor.last_id);
+  std::string out;
+  size_t i = 0;
+  for (; i + 3 <= raw.size(); i += 3) {
+    uint32_t n = (uint8_t(raw[i]) << 16) | (uint8_t(raw[i + 1]) << 8) | uint8_t(raw[i + 2]);
+    out += kAlphabet[(n >> 18) & 63];
+    out += kAlphabet[(n >> 12) & 63];
+    out += kAlphabet[(n >> 6) & 63];
+    out += kAlphabet[n & 63];
+  }
+  if (i + 1 == raw.size()) {
+    uint32_t n = uint8_t(raw[i]) << 16;
+    out += kAlphabet[(n >> 18) & 63];
+    out += kAlphabet[(n >> 12) & 63];
+  } else if (i + 2 == raw.size()) {
+    uint32_t n = (uint8_t(raw[i]) << 16) | (uint8_t(raw[i + 1]) << 8);
+    out += kAlphabet[(n >> 18) & 63];
+    out += kAlphabet[(n >> 12) & 63];
+    out += kAlphabet[(n >> 6) & 63];
+  }
+  return out;
+}
+// An empty token is the first page. Returns false for malformed tokens.
+inline bool DecodeCursor(const std::string &token, Cursor *cursor) {
+  cursor->last_id = 0;
+  if (token.empty()) return true;
+  std::string raw;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (char c : token) {
+    int v;
+    if (c >= 'A' && c <= 'Z') v = c - 'A';
+    else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+    else if (c >= '0' && c <= '9') v = c - '0' + 52;
+    else if (c == '-') v = 62;
+    else if (c == '_') v = 63;
+    else return false;
+    acc = (acc << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      raw += static_cast<char>((acc >> bits) & 0xFF);
+    }
+  }
+  // "i" and up to 19 digits: every id EncodeCursor writes, up to INT64_MAX.
+  if (raw.size() < 2 || raw[0] != 'i' || raw.size() > 20) return false;
+  int64_t id = 0;
+  for (size_t i = 1; i < raw.size(); ++i) {
+    if (raw[i] < '0' || raw[i] > '9') return false;
+    int d = raw[i] - '0';
+    if (id > (std::numeric_limits<int64_t>::max() - d) / 10) return false;
+    id = id * 10 + d;
+  }
+  cursor->last_id = id;
+  return true;
+}
+} // namespace qrs
+} // namespace epiphany
@@ -1,48 +1,216 @@
 #pragma once
+#include "epiphany/database/deadline.h"
+#include "epiphany/database/json_writer.h"
+#include "epiphany/observability/trace.h"
+#include "epiphany/qrs/cursor.h"
+#include "epiphany/qrs/result_cache.h"
 #include "epiphany/searcher/searcher.h"
+#include "epiphany/suggest/suggester.h"
 #include <chrono>
+#include <cmath>
 #include <memory>
 #include <random>
-#include <sstream>
 #include <string>
+#include <string_view>
 namespace epiphany {
 namespace qrs {
+struct QRSOptions {
+  // Result cache budget in bytes; 0 disables caching.
+  size_t cache_bytes{64 << 20};
+  int cache_ttl_ms{60000};
+  size_t cache_shards{16};
+};
+enum class SortOrder { kRelevance, kId, kPriceAsc, kPriceDesc };
+// Parameters of one search call. keyset selects cursor paging, in which
+// case after_id replaces offset and results are always in id order.
+// facets, a Database::Facet mask, only applies to search_v2. A search
+// still running at deadline_ns (observability::NowNs, 0 for none) is cut
+// short where the backend can stop early; its result is incomplete and
+// not cached.
+struct SearchRequest {
+  std::string q;
+  int limit{10};
+  int offset{0};
+  bool keyset{false};
+  int64_t after_id{0};
+  SortOrder sort{SortOrder::kRelevance};
+  unsigned facets{0};
+  query::PriceRange price;
+  int64_t deadline_ns{0};
+};
 class QRS {
 public:
-  explicit QRS(std::shared_ptr<epiphany::database::Database> db)
-      : searcher_(std::make_shared<epiphany::searcher::Searcher>(db)) {}
+  explicit QRS(std::shared_ptr<epiphany::database::Database> db, const QRSOptions &options = QRSOptions())
+      : db_(db), searcher_(std::make_shared<epiphany::searcher::Searcher>(db)),
+        suggester_(std::make_shared<epiphany::suggest::Suggester>(db)),
+        cache_(options.cache_bytes, std::chrono::milliseconds(options.cache_ttl_ms), options.cache_shards) {}
   std::string Search(const std::string &q, int limit, int offset) {
-    return searcher_->Search(q, limit, offset).first;
+    SearchRequest req;
+    req.q = q;
+    req.limit = limit;
+    req.offset = offset;
+    return Search(req);
   }
   std::string SearchV2(const std::string &q, int limit, int offset) {
-    auto t0 = std::chrono::steady_clock::now();
-    auto result = searcher_->Search(q, limit, offset);
-    auto t1 = std::chrono::steady_clock::now();
-    auto search_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
-    auto t2 = std::chrono::steady_clock::now();
-    auto aggs = searcher_->ComputeAggregates(q);
-    auto t3 = std::chrono::steady_clock::now();
-    auto aggregate_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count();
-    std::ostringstream oss;
-    oss << "{\"trace_id\":\"" << GenerateTraceId() << "\",\"limit\":" << limit
-        << ",\"offset\":" << offset << ",\"total\":" << result.second
-        << ",\"elapsed_ms\":" << (search_ms + aggregate_ms)
-        << ",\"parse_ms\":0,\"route_ms\":0,\"search_ms\":" << search_ms
-        << ",\"aggregate_ms\":" << aggregate_ms
-        << ",\"aggregates\":{\"price\":{\"avg\":" << aggs.avg
-        << ",\"min\":" << aggs.min << ",\"max\":" << aggs.max << "}}"
-        << ",\"items\":" << result.first << "}";
-    return oss.str();
+    SearchRequest req;
+    req.q = q;
+    req.limit = limit;
+    req.offset = offset;
+    return SearchV2(req);
+  }
+  std::string Search(const SearchRequest &req) {
+    epiphany::database::ScopedDeadline deadline(req.deadline_ns);
+    uint64_t generation = db_->WriteGeneration();
+    std::string key = CacheKey("search", req);
+    std::string json;
+    if (cache_.enabled() && cache_.Get(key, generation, &json)) return json;
+    if (req.keyset) {
+      auto result = searcher_->SearchAfter(req.q, req.limit, req.after_id, false, 0, req.price);
+      json = std::move(result.items);
+      // {"items": [...], "latency_ms": N} gains a trailing next_cursor.
+      observability::ScopedSpan serialize(observability::Stage::kSerialize);
+      json.insert(json.size() - 1, ",\"next_cursor\":" + NextCursor(result));
+    } else if (req.sort == SortOrder::kRelevance) {
+      json = std::move(searcher_->SearchRanked(req.q, req.limit, req.offset, false, 0, req.price).items);
+    } else if (req.sort == SortOrder::kId) {
+      json = searcher_->Search(req.q, req.limit, req.offset, req.price).first;
+    } else {
+      json = std::move(searcher_->SearchByPrice(req.q, req.limit, req.offset, req.sort == SortOrder::kPriceDesc, false, 0, req.price).items);
+    }
+    if (cache_.enabled() && !epiphany::database::DeadlineExceeded()) cache_.Put(key, generation, json);
+    return json;
+  }
+  std::string SearchV2(const SearchRequest &req) {
+    // Only the result part (total, aggregates, items) is cached; trace id
+    // and timings are per request. Timings come from the request's trace
+    // when it has one.
+    const observability::Trace *trace = observability::CurrentTrace();
+    epiphany::database::ScopedDeadline deadline(req.deadline_ns);
+    uint64_t generation = db_->WriteGeneration();
+    std::string key = CacheKey("search_v2", req);
+    int64_t t0 = observability::NowNs();
+    std::string body;
+    if (!cache_.enabled() || !cache_.Get(key, generation, &body)) {
+      auto result = SearchWithStats(req);
+      observability::ScopedSpan serialize(observability::Stage::kSerialize);
+      const auto &aggs = result.price;
+      body.reserve(result.items.size() + 192);
+      epiphany::database::JsonWriter out(&body);
+      out.Raw(",\"total\":").Int(result.total)
+          .Raw(",\"aggregates\":{\"price\":{\"avg\":").General(aggs.avg)
+          .Raw(",\"min\":").General(aggs.min)
+          .Raw(",\"max\":").General(aggs.max).Raw("}");
+      AppendFacets(out, req.facets, result.facets);
+      out.Raw("}");
+      if (req.keyset) out.Raw(",\"next_cursor\":").Raw(NextCursor(result));
+      out.Raw(",\"items\":").Raw(result.items).Raw("}");
+      if (cache_.enabled() && !epiphany::database::DeadlineExceeded()) cache_.Put(key, generation, body);
+    }
+    int64_t t1 = observability::NowNs();
+    // Aggregates are computed inside the search call; report them apart
+    // when the backend traced them separately.
+    int64_t aggregate_ns = trace ? trace->StageNs(observability::Stage::kAggregate) : 0;
+    int64_t search_ns = t1 - t0 - aggregate_ns;
+    int64_t parse_ns = trace ? trace->StageNs(observability::Stage::kParse) : 0;
+    int64_t route_ns = trace ? trace->StageNs(observability::Stage::kRoute) : 0;
+    int64_t elapsed_ns = trace ? t1 - trace->start_ns() : t1 - t0;
+    // The response is assembled in one buffer sized up front.
+    observability::ScopedSpan serialize(observability::Stage::kSerialize);
+    std::string json;
+    json.reserve(body.size() + 192);
+    epiphany::database::JsonWriter writer(&json);
+    writer.Raw("{\"trace_id\":\"");
+    if (trace) writer.Raw(trace->id());
+    else writer.Hex(GenerateTraceId());
+    writer.Raw("\",\"limit\":").Int(req.limit)
+        .Raw(",\"offset\":").Int(req.keyset ? 0 : req.offset)
+        .Raw(",\"elapsed_ms\":").Fixed(elapsed_ns / 1e6, 3)
+        .Raw(",\"parse_ms\":").Fixed(parse_ns / 1e6, 3)
+        .Raw(",\"route_ms\":").Fixed(route_ns / 1e6, 3)
+        .Raw(",\"search_ms\":").Fixed(search_ns / 1e6, 3)
+        .Raw(",\"aggregate_ms\":").Fixed(aggregate_ns / 1e6, 3)
+        .Raw(body);
+    return json;
+  }
+  // Typeahead completions of prefix. Not cached: the trie answers faster
+  // than a cache lookup would.
+  std::string Suggest(std::string_view prefix, int limit) {
+    return suggester_->SuggestJson(prefix, limit);
   }
 private:
-  std::string GenerateTraceId() {
-    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
-    std::mt19937_64 rng(now);
-    std::ostringstream oss;
-    oss << std::hex << rng();
-    return oss.str();
+  using Facets = epiphany::database::Database::Facets;
+  // The page req asks for, with total, aggregates and facets over every
+  // match.
+  epiphany::database::Database::SearchResult SearchWithStats(const SearchRequest &req) {
+    if (req.keyset) return searcher_->SearchAfter(req.q, req.limit, req.after_id, true, req.facets, req.price);
+    if (req.sort == SortOrder::kRelevance) return searcher_->SearchRanked(req.q, req.limit, req.offset, true, req.facets, req.price);
+    if (req.sort == SortOrder::kId) return searcher_->SearchWithAggregates(req.q, req.limit, req.offset, req.facets, req.price);
+    return searcher_->SearchByPrice(req.q, req.limit, req.offset, req.sort == SortOrder::kPriceDesc, true, req.facets, req.price);
+  }
+  // The requested facets as members of "aggregates": "brand" and
+  // "category" as [{"value": ..., "count": N}, ...], the price histogram as
+  // "price_histogram": [{"from": X, "to": Y, "count": N}, ...] with a null
+  // "to" on an open-ended last bucket.
+  static void AppendFacets(epiphany::database::JsonWriter &out, unsigned requested, const Facets &facets) {
+    using Database = epiphany::database::Database;
+    auto values = [&out](const char *name, const std::vector<Database::FacetCount> &counts) {
+      out.Raw(",\"").Raw(name).Raw("\":[");
+      for (size_t i = 0; i < counts.size(); ++i) {
+        if (i > 0) out.Raw(",");
+        out.Raw("{\"value\":").String(counts[i].value).Raw(",\"count\":").Int(counts[i].count).Raw("}");
+      }
+      out.Raw("]");
+    };
+    if (requested & Database::kFacetBrand) values("brand", facets.brand);
+    if (requested & Database::kFacetCategory) values("category", facets.category);
+    if (requested & Database::kFacetPrice) {
+      out.Raw(",\"price_histogram\":[");
+      for (size_t i = 0; i < facets.price.size(); ++i) {
+        const auto &bucket = facets.price[i];
+        if (i > 0) out.Raw(",");
+        out.Raw("{\"from\":").General(bucket.from).Raw(",\"to\":");
+        if (std::isinf(bucket.to)) out.Raw("null");
+        else out.General(bucket.to);
+        out.Raw(",\"count\":").Int(bucket.count).Raw("}");
+      }
+      out.Raw("]");
+    }
+  }
+  // JSON value for the cursor that resumes after this page; null once a
+  // page comes back empty.
+  static std::string NextCursor(const epiphany::database::Database::SearchResult &result) {
+    if (result.last_id == 0) return "null";
+    return "\"" + EncodeCursor(Cursor{result.last_id}) + "\"";
+  }
+  // LIKE matching ignores ASCII case, so queries differing only in case
+  // share an entry.
+  static std::string CacheKey(const char *endpoint, const SearchRequest &req) {
+    std::string key = endpoint;
+    key += '\0';
+    for (char c : req.q) key += (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    key += '\0';
+    key += std::to_string(req.limit);
+    key += '\0';
+    static const char kSortKeys[] = {'r', 'o', 'a', 'd'};
+    key += req.keyset ? 'c' : kSortKeys[static_cast<int>(req.sort)];
+    key += std::to_string(req.keyset ? req.after_id : req.offset);
+    key += '\0';
+    key += std::to_string(req.facets);
+    // The bounds' bytes, so no two ranges share a key.
+    key += '\0';
+    key.append(reinterpret_cast<const char *>(&req.price.min), sizeof(req.price.min));
+    key.append(reinterpret_cast<const char *>(&req.price.max), sizeof(req.price.max));
+    return key;
+  }
+  // For calls made outside a traced request.
+  static uint64_t GenerateTraceId() {
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    return rng();
   }
+  std::shared_ptr<epiphany::database::Database> db_;
   std::shared_ptr<epiphany::searcher::Searcher> searcher_;
+  std::shared_ptr<epiphany::suggest::Suggester> suggester_;
+  ResultCache cache_;
 };
 } // namespace qrs
 } // namespace epiphany
@@ -0,0 +1,90 @@
+#pragma once
+#include "epiphany/observability/metrics.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+namespace epiphany {
+namespace qrs {
+// Sharded, lock-striped LRU of serialized responses. Each entry remembers
+// the database write generation it was computed at; a lookup at a newer
+// generation or past the TTL is a miss. The byte budget is split evenly
+// across shards and enforced per shard.
+class ResultCache {
+public:
+  ResultCache(size_t max_bytes, std::chrono::milliseconds ttl, size_t shards = 16)
+      : ttl_(ttl), shards_(shards < 1 ? 1 : shards) {
+    for (auto &shard : shards_) shard.budget = max_bytes / shards_.size();
+  }
+  bool enabled() const { return shards_[0].budget > 0; }
+  bool Get(const std::string &key, uint64_t generation, std::string *value) {
+    Shard &shard = ShardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+      observability::Metrics::cache_misses.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    auto entry = it->second;
+    if (entry->generation != generation || std::chrono::steady_clock::now() >= entry->expires) {
+      shard.Erase(entry);
+      observability::Metrics::cache_misses.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+    *value = entry->value;
+    observability::Metrics::cache_hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  void Put(const std::string &key, uint64_t generation, const std::string &value) {
+    Shard &shard = ShardFor(key);
+    size_t charge = Charge(key, value);
+    if (charge > shard.budget) return;
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) shard.Erase(it->second);
+    shard.lru.push_front(Entry{key, value, generation, std::chrono::steady_clock::now() + ttl_, charge});
+    shard.index[key] = shard.lru.begin();
+    shard.bytes += charge;
+    while (shard.bytes > shard.budget) {
+      shard.Erase(std::prev(shard.lru.end()));
+      observability::Metrics::cache_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+private:
+  struct Entry {
+    std::string key;
+    std::string value;
+    uint64_t generation;
+    std::chrono::steady_clock::time_point expires;
+    size_t charge;
+  };
+  struct Shard {
+    std::mutex mu;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t bytes{0};
+    size_t budget{0};
+    void Erase(std::list<Entry>::iterator entry) {
+      bytes -= entry->charge;
+      index.erase(entry->key);
+      lru.erase(entry);
+    }
+  };
+  // Approximate footprint: both strings (key stored twice) plus node overhead.
+  static size_t Charge(const std::string &key, const std::string &value) {
+    return 2 * key.size() + value.size() + 128;
+  }
+  Shard &ShardFor(const std::string &key) {
+    return shards_[std::hash<std::string>()(key) % shards_.size()];
+  }
+  std::chrono::milliseconds ttl_;
+  std::vector<Shard> shards_;
+};
+} // namespace qrs
+} // namespace epiphany
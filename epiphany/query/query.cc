@@ -0,0 +1,126 @@
+#include "epiphany/query/query.h"
+#include <utility>
+
+namespace epiphany {
+namespace query {
+
+namespace {
+
+struct Token {
+  std::string text;
+  bool quoted{false};
+  bool negated{false};
+};
+
+bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+std::vector<Token> Lex(const std::string &text) {
+  std::vector<Token> tokens;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    if (IsSpace(text[pos])) {
+      ++pos;
+      continue;
+    }
+    Token token;
+    if (text[pos] == '-' && pos + 1 < text.size() && !IsSpace(text[pos + 1])) {
+      token.negated = true;
+      ++pos;
+    }
+    if (text[pos] == '"') {
+      size_t close = text.find('"', pos + 1);
+      size_t end = close == std::string::npos ? text.size() : close;
+      token.text = text.substr(pos + 1, end - pos - 1);
+      token.quoted = true;
+      pos = close == std::string::npos ? end : close + 1;
+      if (token.text.empty())
+        continue;
+    } else {
+      size_t end = pos;
+      while (end < text.size() && !IsSpace(text[end]))
+        ++end;
+      token.text = text.substr(pos, end - pos);
+      pos = end;
+    }
+    tokens.push_back(std::move(token));
+  }
+  return tokens;
+}
+
+bool IsOr(const Token &token) {
+  return !token.quoted && !token.negated && token.text == "OR";
+}
+
+Node Literal(Token &&token) {
+  Node term = Node::Term(std::move(token.text));
+  if (!token.negated)
+    return term;
+  Node node;
+  node.kind = Node::Kind::kNot;
+  node.children.push_back(std::move(term));
+  return node;
+}
+
+Node Group(Node::Kind kind, std::vector<Node> &&children) {
+  if (children.size() == 1)
+    return std::move(children[0]);
+  Node node;
+  node.kind = kind;
+  node.children = std::move(children);
+  return node;
+}
+
+} // namespace
+
+Node Node::Term(std::string text) {
+  Node node;
+  node.kind = Kind::kTerm;
+  node.term = std::move(text);
+  return node;
+}
+
+Node Node::Price(const PriceRange &range) {
+  Node node;
+  node.kind = Kind::kPrice;
+  node.price = range;
+  return node;
+}
+
+Node Parse(const std::string &text) {
+  std::vector<Token> tokens = Lex(text);
+  std::vector<Node> clauses;
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    std::vector<Node> alternatives;
+    alternatives.push_back(Literal(std::move(tokens[i])));
+    while (i + 2 < tokens.size() && IsOr(tokens[i + 1])) {
+      alternatives.push_back(Literal(std::move(tokens[i + 2])));
+      i += 2;
+    }
+    clauses.push_back(Group(Node::Kind::kOr, std::move(alternatives)));
+  }
+  return Group(Node::Kind::kAnd, std::move(clauses));
+}
+
+Node Restrict(Node query, const PriceRange &price) {
+  if (!price.bounded())
+    return query;
+  if (query.kind != Node::Kind::kAnd) {
+    Node node;
+    node.children.push_back(std::move(query));
+    query = std::move(node);
+  }
+  query.children.push_back(Node::Price(price));
+  return query;
+}
+
+void CollectTerms(const Node &node, std::vector<const std::string *> *terms) {
+  if (node.kind == Node::Kind::kTerm) {
+    terms->push_back(&node.term);
+    return;
+  }
+  for (const auto &child : node.children)
+    CollectTerms(child, terms);
+}
+
+} // namespace query
+} // namespace epiphany
@@ -0,0 +1,54 @@
+#pragma once
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace epiphany {
+namespace query {
+
+// Inclusive price bounds; an infinite bound leaves that side open.
+struct PriceRange {
+  double min{-std::numeric_limits<double>::infinity()};
+  double max{std::numeric_limits<double>::infinity()};
+
+  bool bounded() const {
+    return min > -std::numeric_limits<double>::infinity() ||
+           max < std::numeric_limits<double>::infinity();
+  }
+};
+
+// Boolean query tree over title substrings. A term matches titles that
+// contain it (ASCII case-insensitively, like LIKE); kAnd and kOr combine any
+// number of children and kNot has exactly one. kPrice matches items priced
+// within price; it is never parsed from user text, only added by Restrict.
+struct Node {
+  enum class Kind { kTerm, kAnd, kOr, kNot, kPrice };
+  Kind kind{Kind::kAnd};
+  std::string term;
+  PriceRange price;
+  std::vector<Node> children;
+
+  static Node Term(std::string text);
+  static Node Price(const PriceRange &range);
+};
+
+// Parses the user query syntax:
+//
+//   Pro 相机         both terms, anywhere in the title
+//   Dell OR Sony    either term; OR binds tighter than the implicit AND
+//   -Mini           titles without the term
+//   "Pro 10"        the quoted text as one contiguous term
+//
+// Never fails: a stray OR or '-' is taken literally, an unterminated quote
+// runs to the end. A query with no terms matches everything.
+Node Parse(const std::string &text);
+
+// query limited to items priced within price: a kPrice clause joins the
+// top-level kAnd, or a new one. An unbounded price leaves query as is.
+Node Restrict(Node query, const PriceRange &price);
+
+// Terms in the tree, left to right.
+void CollectTerms(const Node &node, std::vector<const std::string *> *terms);
+
+} // namespace query
+} // namespace epiphany
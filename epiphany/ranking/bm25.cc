@@ -0,0 +1,61 @@
+#include "epiphany/ranking/bm25.h"
+#include <algorithm>
+#include <cmath>
+
+namespace epiphany {
+namespace ranking {
+
+namespace {
+
+char Fold(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+void Collect(const query::Node &node, std::vector<std::string> *terms) {
+  using Kind = query::Node::Kind;
+  if (node.kind == Kind::kNot)
+    return;
+  if (node.kind == Kind::kTerm) {
+    std::string term = node.term;
+    std::transform(term.begin(), term.end(), term.begin(), Fold);
+    if (!term.empty() &&
+        std::find(terms->begin(), terms->end(), term) == terms->end())
+      terms->push_back(std::move(term));
+    return;
+  }
+  for (const auto &child : node.children)
+    Collect(child, terms);
+}
+
+} // namespace
+
+double Bm25::Idf(uint64_t df) const {
+  double n = static_cast<double>(docs_);
+  double d = static_cast<double>(std::min(df, docs_));
+  return std::log(1 + (n - d + 0.5) / (d + 0.5));
+}
+
+ScoringTerms CollectScoringTerms(const query::Node &query) {
+  using Kind = query::Node::Kind;
+  ScoringTerms scoring;
+  Collect(query, &scoring.terms);
+  // A price clause filters without adding to any score.
+  auto required = [](const query::Node &node) {
+    return node.kind == Kind::kTerm || node.kind == Kind::kNot ||
+           node.kind == Kind::kPrice;
+  };
+  scoring.uniform =
+      query.kind == Kind::kTerm ||
+      (query.kind == Kind::kAnd &&
+       std::all_of(query.children.begin(), query.children.end(), required));
+  return scoring;
+}
+
+bool ContainsTerm(std::string_view title, std::string_view term) {
+  return std::search(title.begin(), title.end(), term.begin(), term.end(),
+                     [](char a, char b) { return Fold(a) == b; }) !=
+         title.end();
+}
+
+} // namespace ranking
+} // namespace epiphany
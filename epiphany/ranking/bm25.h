@@ -0,0 +1,59 @@
+#pragma once
+#include "epiphany/query/query.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace epiphany {
+namespace ranking {
+
+// BM25 relevance over title substrings, with the usual k1 and b. Titles are
+// a few words long, so a term counts once per title that contains it (tf
+// saturates at 1) and a document scores
+//
+//   LengthNorm(title length) * sum of Idf over the query terms it contains.
+//
+// For a given set of terms that only falls as titles get longer, so the
+// best possible score of a title of length n is LengthNorm(n) times the
+// Idf of every term: rankers visit matches shortest first and stop once
+// that bound drops below the k-th best score found.
+class Bm25 {
+public:
+  static constexpr double kK1 = 1.2;
+  static constexpr double kB = 0.75;
+
+  // A collection of docs documents averaging avg_length code points.
+  Bm25(uint64_t docs, double avg_length)
+      : docs_(docs), avg_length_(avg_length > 0 ? avg_length : 1) {}
+
+  uint64_t docs() const { return docs_; }
+  // Weight of a term found in df documents; never negative.
+  double Idf(uint64_t df) const;
+  // The tf component of a matching term in a title of length code points.
+  double LengthNorm(double length) const {
+    return (kK1 + 1) / (1 + kK1 * (1 - kB + kB * length / avg_length_));
+  }
+
+private:
+  uint64_t docs_;
+  double avg_length_;
+};
+
+// The terms that can add to a score: each term not under a negation, once,
+// ASCII-folded to lower case as matching is.
+struct ScoringTerms {
+  std::vector<std::string> terms;
+  // Every match contains every term, as when the query is a conjunction of
+  // terms and negations. All matches of one length then score alike, so
+  // ranking needs no term weights and orders them by id.
+  bool uniform{false};
+};
+ScoringTerms CollectScoringTerms(const query::Node &query);
+
+// True if title contains term, which must already be folded; ASCII letters
+// compare case-insensitively, like LIKE.
+bool ContainsTerm(std::string_view title, std::string_view term);
+
+} // namespace ranking
+} // namespace epiphany
@@ -0,0 +1,74 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace epiphany {
+namespace ranking {
+
+// Keeps the k best of the entries offered: higher scores first, equal
+// scores by ascending id. A heap of k entries with the worst on top, so an
+// entry that cannot make the cut costs one comparison.
+template <typename T> class TopK {
+public:
+  // candidates bounds how many entries can be offered, so a k taken from
+  // a request reserves no more than the entries there are.
+  explicit TopK(size_t k, size_t candidates = SIZE_MAX) : k_(k) {
+    heap_.reserve(std::min(k, candidates));
+  }
+
+  bool full() const { return heap_.size() >= k_; }
+  // Score of the worst entry kept; only meaningful once full.
+  double threshold() const { return heap_.front().score; }
+
+  // Whether an entry with this score and id would be kept.
+  bool Accepts(double score, int64_t id) const {
+    if (k_ == 0)
+      return false;
+    return !full() || Better(score, id, heap_.front());
+  }
+
+  void Push(double score, int64_t id, T value) {
+    if (!Accepts(score, id))
+      return;
+    if (full()) {
+      std::pop_heap(heap_.begin(), heap_.end(), Order);
+      heap_.pop_back();
+    }
+    heap_.push_back(Entry{score, id, std::move(value)});
+    std::push_heap(heap_.begin(), heap_.end(), Order);
+  }
+
+  // The entries kept, best first; leaves the heap empty.
+  std::vector<T> Take() {
+    std::sort_heap(heap_.begin(), heap_.end(), Order);
+    std::vector<T> out;
+    out.reserve(heap_.size());
+    for (auto &entry : heap_)
+      out.push_back(std::move(entry.value));
+    heap_.clear();
+    return out;
+  }
+
+private:
+  struct Entry {
+    double score;
+    int64_t id;
+    T value;
+  };
+
+  static bool Better(double score, int64_t id, const Entry &than) {
+    return score > than.score || (score == than.score && id < than.id);
+  }
+  // Heap order: "less" means better, which puts the worst entry on top.
+  static bool Order(const Entry &a, const Entry &b) {
+    return Better(a.score, a.id, b);
+  }
+
+  size_t k_;
+  std::vector<Entry> heap_;
+};
+
+} // namespace ranking
+} // namespace epiphany
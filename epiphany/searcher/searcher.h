@@ -1,22 +1,47 @@
 #pragma once
 #include "epiphany/database/database.h"
+#include "epiphany/query/query.h"
 #include <memory>
 #include <string>
 #include <utility>
 namespace epiphany {
 namespace searcher {
+// Parses q with query::Parse ("a b", "a OR b", "-c", "\"a b\""), restricts
+// it to the price range if one is given, and hands the tree to the
+// database, which evaluates it in one pass.
 class Searcher {
 public:
   explicit Searcher(std::shared_ptr<epiphany::database::Database> db) : db_(db) {}
-  std::pair<std::string,int> Search(const std::string &q, int limit, int offset) {
-    int total = db_->Count(q);
-    std::string items = db_->Search(q, limit, offset);
+  std::pair<std::string,int> Search(const std::string &q, int limit, int offset, const query::PriceRange &price = query::PriceRange()) {
+    query::Node query = Query(q, price);
+    int total = db_->Count(query);
+    std::string items = db_->Search(query, limit, offset);
     return {items, total};
   }
   epiphany::database::Database::PriceAggregates ComputeAggregates(const std::string &q) {
-    return db_->PriceStats(q);
+    return db_->PriceStats(query::Parse(q));
+  }
+  // Page, total, price aggregates and facets (a Database::Facet mask) from
+  // one scan of the matches.
+  epiphany::database::Database::SearchResult SearchWithAggregates(const std::string &q, int limit, int offset, unsigned facets = 0, const query::PriceRange &price = query::PriceRange()) {
+    return db_->SearchWithStats(Query(q, price), limit, offset, facets);
+  }
+  // Keyset page after the given id; stats cover all matches when requested.
+  epiphany::database::Database::SearchResult SearchAfter(const std::string &q, int limit, int64_t after_id, bool with_stats, unsigned facets = 0, const query::PriceRange &price = query::PriceRange()) {
+    return db_->SearchAfter(Query(q, price), limit, after_id, with_stats, facets);
+  }
+  // Offset page in BM25 order; stats cover all matches when requested.
+  epiphany::database::Database::SearchResult SearchRanked(const std::string &q, int limit, int offset, bool with_stats, unsigned facets = 0, const query::PriceRange &price = query::PriceRange()) {
+    return db_->SearchRanked(Query(q, price), limit, offset, with_stats, facets);
+  }
+  // Offset page in price order; stats cover all matches when requested.
+  epiphany::database::Database::SearchResult SearchByPrice(const std::string &q, int limit, int offset, bool descending, bool with_stats, unsigned facets = 0, const query::PriceRange &price = query::PriceRange()) {
+    return db_->SearchByPrice(Query(q, price), limit, offset, descending, with_stats, facets);
   }
 private:
+  static query::Node Query(const std::string &q, const query::PriceRange &price) {
+    return query::Restrict(query::Parse(q), price);
+  }
   std::shared_ptr<epiphany::database::Database> db_;
 };
 } // namespace searcher
@@ -0,0 +1,118 @@
+#include "epiphany/server/admission_controller.h"
+#include "epiphany/observability/metrics.h"
+#include "epiphany/observability/trace.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace epiphany {
+namespace server {
+
+namespace {
+
+// Weights of a new sample in the short- and long-term latency averages.
+constexpr double kShortWeight = 0.1;
+constexpr double kLongWeight = 1.0 / 600;
+// Short-term latency up to this multiple of the long-term is not taken for
+// contention.
+constexpr double kTolerance = 1.5;
+// The most one request can shrink the limit's estimate by.
+constexpr double kMinGradient = 0.5;
+// How far the limit moves towards a new estimate per request.
+constexpr double kSmoothing = 0.2;
+constexpr double kTimeoutBackoff = 0.9;
+
+} // namespace
+
+AdmissionController::AdmissionController(ThreadPool *pool, int workers,
+                                         const AdmissionOptions &options)
+    : pool_(pool),
+      max_limit_(std::max(1, options.concurrency > 0 ? options.concurrency
+                                                     : workers)),
+      adaptive_(options.adaptive),
+      max_queue_(static_cast<size_t>(std::max(0, options.max_queue))),
+      limit_(max_limit_) {
+  Publish();
+}
+
+bool AdmissionController::Submit(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (running_ >= Limit()) {
+      if (queue_.size() >= max_queue_)
+        return false;
+      queue_.push_back(std::move(task));
+      Publish();
+      return true;
+    }
+    ++running_;
+  }
+  Start(std::move(task));
+  return true;
+}
+
+void AdmissionController::Start(Task task) {
+  pool_->Submit([this, task = std::move(task)] {
+    int64_t begin = observability::NowNs();
+    bool timed_out = task();
+    Finish(observability::NowNs() - begin, timed_out);
+  });
+}
+
+void AdmissionController::Finish(int64_t latency_ns, bool timed_out) {
+  std::vector<Task> ready;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (adaptive_)
+      Adapt(latency_ns, timed_out, running_);
+    --running_;
+    while (running_ < Limit() && !queue_.empty()) {
+      ready.push_back(std::move(queue_.front()));
+      queue_.pop_front();
+      ++running_;
+    }
+    Publish();
+  }
+  for (auto &task : ready)
+    Start(std::move(task));
+}
+
+void AdmissionController::Adapt(int64_t latency_ns, bool timed_out,
+                                int running) {
+  if (timed_out) {
+    limit_ = std::max(1.0, limit_ * kTimeoutBackoff);
+    return;
+  }
+  double sample = static_cast<double>(std::max<int64_t>(latency_ns, 1));
+  if (short_ns_ == 0) {
+    short_ns_ = long_ns_ = sample;
+    return;
+  }
+  short_ns_ += (sample - short_ns_) * kShortWeight;
+  long_ns_ += (sample - long_ns_) * kLongWeight;
+  // After a burst the long-term average lags far behind; let it catch up
+  // so the next burst is measured against recent latency.
+  if (long_ns_ > 2 * short_ns_)
+    long_ns_ *= 0.95;
+  double gradient =
+      std::clamp(kTolerance * long_ns_ / short_ns_, kMinGradient, 1.0);
+  // A limit that is mostly unused says nothing about whether it is too low.
+  if (gradient == 1.0 && running * 2 < limit_)
+    return;
+  double estimate = limit_ * gradient + std::sqrt(limit_);
+  limit_ = std::clamp(limit_ + (estimate - limit_) * kSmoothing, 1.0,
+                      static_cast<double>(max_limit_));
+}
+
+int AdmissionController::Limit() const {
+  return adaptive_ ? static_cast<int>(limit_) : max_limit_;
+}
+
+void AdmissionController::Publish() const {
+  observability::Metrics::concurrency_limit.store(Limit());
+  observability::Metrics::queued.store(static_cast<long>(queue_.size()));
+}
+
+} // namespace server
+} // namespace epiphany
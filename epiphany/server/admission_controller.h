@@ -0,0 +1,75 @@
+#pragma once
+#include "epiphany/server/thread_pool.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace epiphany {
+namespace server {
+
+struct AdmissionOptions {
+  // Requests allowed to run at once; 0 means one per worker thread.
+  int concurrency{0};
+  // Move the limit between 1 and the concurrency above as latency shows
+  // the workers keeping up or falling behind, instead of holding it fixed.
+  bool adaptive{false};
+  // Admitted requests that may wait for a slot. Past this, new requests
+  // are refused rather than queued.
+  int max_queue{256};
+  // Seconds a refused client is told to wait, sent as Retry-After.
+  int retry_after_s{1};
+};
+
+// Bounds the work the server takes on. Requests run on the pool while
+// fewer than the limit are running, wait in a bounded FIFO while it is
+// full, and are refused once the FIFO is full too, so overload is answered
+// at once instead of by an ever longer queue.
+//
+// The adaptive limit follows the gradient of request latency: a short-term
+// average rising above a long-term one means requests are contending, and
+// the limit shrinks in proportion; otherwise it grows by about its square
+// root while it is in use. A request that ran out of its deadline cuts the
+// limit by a tenth outright.
+class AdmissionController {
+public:
+  // Runs the request; returns whether it ran out of its deadline.
+  using Task = std::function<bool()>;
+
+  // workers is the pool's thread count, the default and, when adaptive,
+  // the ceiling of the limit.
+  AdmissionController(ThreadPool *pool, int workers,
+                      const AdmissionOptions &options);
+
+  AdmissionController(const AdmissionController &) = delete;
+  AdmissionController &operator=(const AdmissionController &) = delete;
+
+  // Starts or queues task; false if it was refused.
+  bool Submit(Task task);
+
+private:
+  // Hands task to the pool and, when it returns, frees its slot.
+  void Start(Task task);
+  void Finish(int64_t latency_ns, bool timed_out);
+  // Updates limit_ from a finished request; running is how many were
+  // running when it finished, itself included.
+  void Adapt(int64_t latency_ns, bool timed_out, int running);
+  int Limit() const;
+  void Publish() const;
+
+  ThreadPool *pool_;
+  const int max_limit_;
+  const bool adaptive_;
+  const size_t max_queue_;
+  std::mutex mu_;
+  double limit_;
+  // Exponential averages of request latency over about ten and about six
+  // hundred requests; 0 before the first.
+  double short_ns_{0};
+  double long_ns_{0};
+  int running_{0};
+  std::deque<Task> queue_;
+};
+
+} // namespace server
+} // namespace epiphany
@@ -0,0 +1,397 @@
+#include "epiphany/server/event_loop.h"
+#include "epiphany/observability/trace.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace epiphany {
+namespace server {
+
+namespace {
+constexpr int kMaxEvents = 256;
+constexpr size_t kReadChunk = 16384;
+// Output chunks gathered into one sendmsg.
+constexpr size_t kMaxIov = 16;
+constexpr int kAcceptBackoffMs = 100;
+} // namespace
+
+EventLoop::EventLoop(int listen_fd, bool owns_listen_fd, ReadHandler on_read,
+                     int idle_timeout_ms)
+    : listen_fd_(listen_fd), owns_listen_fd_(owns_listen_fd),
+      epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      on_read_(std::move(on_read)), idle_timeout_ms_(idle_timeout_ms) {
+  // Without SO_REUSEPORT every loop watches the same listening socket;
+  // EPOLLEXCLUSIVE wakes only one of them per incoming connection.
+  listen_events_ = owns_listen_fd_ ? EPOLLIN : (EPOLLIN | EPOLLEXCLUSIVE);
+  struct epoll_event ev {};
+  ev.events = listen_events_;
+  ev.data.fd = listen_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+  ev.events = EPOLLIN;
+  ev.data.fd = wake_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+}
+
+EventLoop::~EventLoop() {
+  for (auto &entry : connections_) {
+    close(entry.first);
+  }
+  close(wake_fd_);
+  close(epoll_fd_);
+  if (owns_listen_fd_) {
+    close(listen_fd_);
+  }
+}
+
+int EventLoop::Listen(int port, int backlog, bool reuse_port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("Socket creation failed");
+    return -1;
+  }
+
+  int opt = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  if (reuse_port) {
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+  }
+
+  struct sockaddr_in address {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = INADDR_ANY;
+  address.sin_port = htons(port);
+
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    perror("Bind failed");
+    close(fd);
+    return -1;
+  }
+
+  if (listen(fd, backlog) < 0) {
+    perror("Listen failed");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void EventLoop::Run() {
+  running_ = true;
+  struct epoll_event events[kMaxEvents];
+  int wait_ms = idle_timeout_ms_ > 0 ? std::min(idle_timeout_ms_, 1000) : -1;
+  auto last_sweep = std::chrono::steady_clock::now();
+  while (running_) {
+    int timeout_ms = wait_ms;
+    if (accept_paused_) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      accept_resume_ - std::chrono::steady_clock::now())
+                      .count();
+      int resume_ms = static_cast<int>(std::max<int64_t>(left, 0));
+      timeout_ms = timeout_ms < 0 ? resume_ms : std::min(timeout_ms, resume_ms);
+    }
+    int n = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait failed");
+      return;
+    }
+    for (int i = 0; i < n; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == listen_fd_) {
+        Accept();
+        continue;
+      }
+      if (fd == wake_fd_) {
+        uint64_t value;
+        while (read(wake_fd_, &value, sizeof(value)) > 0) {
+        }
+        RunPending();
+        continue;
+      }
+      auto it = connections_.find(fd);
+      if (it == connections_.end())
+        continue;
+      auto conn = it->second;
+      if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+        Close(conn);
+        continue;
+      }
+      if (events[i].events & EPOLLOUT) {
+        Flush(conn);
+      }
+      if (!conn->closed && (events[i].events & EPOLLIN)) {
+        OnReadable(conn);
+      }
+    }
+    if (accept_paused_ && std::chrono::steady_clock::now() >= accept_resume_)
+      ResumeAccept();
+    if (idle_timeout_ms_ > 0) {
+      auto now = std::chrono::steady_clock::now();
+      if (now - last_sweep >= std::chrono::milliseconds(wait_ms)) {
+        last_sweep = now;
+        CloseIdle();
+      }
+    }
+  }
+}
+
+void EventLoop::CloseIdle() {
+  auto deadline = std::chrono::steady_clock::now() -
+                  std::chrono::milliseconds(idle_timeout_ms_);
+  std::vector<std::shared_ptr<Connection>> idle;
+  for (auto &entry : connections_) {
+    const auto &conn = entry.second;
+    if (!conn->busy && conn->last_active < deadline) {
+      idle.push_back(conn);
+    }
+  }
+  for (auto &conn : idle) {
+    Close(conn);
+  }
+}
+
+void EventLoop::Stop() {
+  running_ = false;
+  uint64_t one = 1;
+  write(wake_fd_, &one, sizeof(one));
+}
+
+void EventLoop::Post(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(pending_mu_);
+    pending_.push_back(std::move(task));
+  }
+  uint64_t one = 1;
+  write(wake_fd_, &one, sizeof(one));
+}
+
+void EventLoop::RunPending() {
+  std::vector<std::function<void()>> tasks;
+  {
+    std::lock_guard<std::mutex> lock(pending_mu_);
+    tasks.swap(pending_);
+  }
+  for (auto &task : tasks) {
+    task();
+  }
+}
+
+void EventLoop::Accept() {
+  while (true) {
+    struct sockaddr_in client_addr;
+    socklen_t client_len = sizeof(client_addr);
+    int64_t accept_begin = observability::NowNs();
+    int fd = accept4(listen_fd_, (struct sockaddr *)&client_addr, &client_len,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+          errno == ENOMEM)
+        PauseAccept();
+      return;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    auto conn = std::make_shared<Connection>();
+    conn->fd = fd;
+    conn->loop = this;
+    char client_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
+    conn->client_ip = client_ip;
+    conn->client_port = ntohs(client_addr.sin_port);
+    conn->last_active = std::chrono::steady_clock::now();
+    conn->accept_begin_ns = accept_begin;
+    conn->accept_end_ns = observability::NowNs();
+
+    struct epoll_event ev {};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      close(fd);
+      continue;
+    }
+    connections_[fd] = std::move(conn);
+  }
+}
+
+void EventLoop::PauseAccept() {
+  perror("accept4 failed, pausing accepts");
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr);
+  accept_paused_ = true;
+  accept_resume_ = std::chrono::steady_clock::now() +
+                   std::chrono::milliseconds(kAcceptBackoffMs);
+}
+
+void EventLoop::ResumeAccept() {
+  struct epoll_event ev {};
+  ev.events = listen_events_;
+  ev.data.fd = listen_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+  accept_paused_ = false;
+}
+
+void EventLoop::OnReadable(const std::shared_ptr<Connection> &conn) {
+  char buffer[kReadChunk];
+  bool got_data = false;
+  bool eof = false;
+  while (true) {
+    ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+    if (n > 0) {
+      if (!got_data)
+        conn->read_ns = observability::NowNs();
+      conn->in.append(buffer, static_cast<size_t>(n));
+      got_data = true;
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    eof = true;
+    break;
+  }
+  if (got_data) {
+    conn->last_active = std::chrono::steady_clock::now();
+    on_read_(conn);
+  }
+  if (!eof || conn->closed)
+    return;
+  // Peer closed or hard error. Drop the connection unless a worker still
+  // owes it a response, in which case Flush() closes it after writing.
+  if (conn->busy) {
+    conn->close_after_write = true;
+    struct epoll_event ev {};
+    ev.events = 0;
+    ev.data.fd = conn->fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn->fd, &ev);
+  } else {
+    Close(conn);
+  }
+}
+
+void EventLoop::Queue(const std::shared_ptr<Connection> &conn,
+                      std::string data) {
+  if (conn->closed || data.empty())
+    return;
+  OutChunk chunk;
+  chunk.data = std::move(data);
+  conn->out.push_back(std::move(chunk));
+}
+
+void EventLoop::Send(const std::shared_ptr<Connection> &conn,
+                     std::string data, bool close_after_write) {
+  if (conn->closed)
+    return;
+  Queue(conn, std::move(data));
+  if (close_after_write)
+    conn->close_after_write = true;
+  Flush(conn);
+}
+
+void EventLoop::Send(const std::shared_ptr<Connection> &conn, OutChunk chunk,
+                     bool close_after_write) {
+  if (conn->closed)
+    return;
+  if (chunk.size() > 0)
+    conn->out.push_back(std::move(chunk));
+  if (close_after_write)
+    conn->close_after_write = true;
+  Flush(conn);
+}
+
+void EventLoop::Flush(const std::shared_ptr<Connection> &conn) {
+  while (!conn->out.empty()) {
+    ssize_t n;
+    const OutChunk &front = conn->out.front();
+    if (front.is_file()) {
+      off_t offset = front.file_offset + static_cast<off_t>(conn->out_offset);
+      n = sendfile(conn->fd, front.file_fd, &offset,
+                   front.file_length - conn->out_offset);
+    } else {
+      iovec iov[kMaxIov];
+      size_t count = 0;
+      bool more = false;
+      for (auto it = conn->out.begin(); it != conn->out.end() && count < kMaxIov;
+           ++it, ++count) {
+        if (it->is_file()) {
+          // Let the head of a file response share a segment with its start.
+          more = true;
+          break;
+        }
+        size_t skip = count == 0 ? conn->out_offset : 0;
+        iov[count].iov_base = const_cast<char *>(it->bytes()) + skip;
+        iov[count].iov_len = it->size() - skip;
+      }
+      msghdr msg{};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = count;
+      n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    }
+    if (n > 0) {
+      size_t sent = static_cast<size_t>(n);
+      while (sent > 0) {
+        size_t left = conn->out.front().size() - conn->out_offset;
+        if (sent < left) {
+          conn->out_offset += sent;
+          break;
+        }
+        sent -= left;
+        conn->out.pop_front();
+        conn->out_offset = 0;
+      }
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (conn->want_write)
+        return;
+      conn->want_write = true;
+      struct epoll_event ev {};
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+      ev.data.fd = conn->fd;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn->fd, &ev);
+      return;
+    }
+    Close(conn);
+    return;
+  }
+  conn->out_offset = 0;
+  conn->last_active = std::chrono::steady_clock::now();
+  if (conn->close_after_write && !conn->busy) {
+    Close(conn);
+    return;
+  }
+  if (!conn->want_write)
+    return;
+  conn->want_write = false;
+  struct epoll_event ev {};
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.fd = conn->fd;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+void EventLoop::Close(const std::shared_ptr<Connection> &conn) {
+  if (conn->closed)
+    return;
+  conn->closed = true;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn->fd, nullptr);
+  close(conn->fd);
+  connections_.erase(conn->fd);
+}
+
+} // namespace server
+} // namespace epiphany
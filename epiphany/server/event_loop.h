@@ -0,0 +1,138 @@
+#pragma once
+#include "epiphany/server/http_parser.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+namespace epiphany {
+namespace server {
+
+class EventLoop;
+
+// One piece of pending output: bytes owned by the chunk, bytes shared with a
+// cache, or a range of an open file sent with sendfile. The file descriptor
+// belongs to whoever queued it and must outlive the connection.
+struct OutChunk {
+  std::string data;
+  std::shared_ptr<const std::string> shared;
+  int file_fd{-1};
+  off_t file_offset{0};
+  size_t file_length{0};
+
+  bool is_file() const { return file_fd >= 0; }
+  const char *bytes() const { return shared ? shared->data() : data.data(); }
+  size_t size() const {
+    return is_file() ? file_length : shared ? shared->size() : data.size();
+  }
+};
+
+// Per-socket state. Buffers and flags are owned by the loop thread; other
+// threads hold a shared_ptr only to hand responses back through Post().
+struct Connection {
+  int fd{-1};
+  std::string client_ip;
+  int client_port{0};
+  EventLoop *loop{nullptr};
+  std::string in;
+  // Pending output chunks; runs of in-memory chunks are written with one
+  // sendmsg, file chunks with sendfile. out_offset counts the bytes of the
+  // front chunk already sent.
+  std::deque<OutChunk> out;
+  size_t out_offset{0};
+  std::chrono::steady_clock::time_point last_active;
+  // Trace timestamps (observability::NowNs). The accept span goes to the
+  // first request only; read_ns is when the latest bytes arrived and
+  // request_start_ns when the request being parsed began, 0 between
+  // requests. parse_ns accumulates time spent parsing it.
+  int64_t accept_begin_ns{0};
+  int64_t accept_end_ns{0};
+  int64_t read_ns{0};
+  int64_t request_start_ns{0};
+  int64_t parse_ns{0};
+  // Requests parsed off the wire but not yet answered, in arrival order.
+  std::unique_ptr<HttpParser> parser;
+  std::deque<HttpRequest> pipeline;
+  bool busy{false};
+  bool want_write{false};
+  bool close_after_write{false};
+  bool closed{false};
+};
+
+// Non-blocking epoll reactor. Each loop runs on its own thread, accepts from
+// its listening socket (shared via EPOLLEXCLUSIVE or private via
+// SO_REUSEPORT) and invokes the read handler whenever new bytes arrive.
+class EventLoop {
+public:
+  using ReadHandler = std::function<void(const std::shared_ptr<Connection> &)>;
+
+  // Connections with no request in flight are closed after idle_timeout_ms
+  // without traffic; 0 disables the timeout.
+  EventLoop(int listen_fd, bool owns_listen_fd, ReadHandler on_read,
+            int idle_timeout_ms = 0);
+  ~EventLoop();
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  // Blocks running the loop until Stop() is called.
+  void Run();
+  void Stop();
+
+  // Thread-safe: queues a task to run on the loop thread.
+  void Post(std::function<void()> task);
+
+  // Loop thread only: queues bytes for the connection and flushes as much as
+  // the socket accepts; the remainder is written on EPOLLOUT. data is moved,
+  // not copied, into the output queue.
+  void Send(const std::shared_ptr<Connection> &conn, std::string data,
+            bool close_after_write);
+  // Loop thread only: queues bytes without flushing, so they go out in the
+  // same write as the next Send (e.g. response head, then body).
+  void Queue(const std::shared_ptr<Connection> &conn, std::string data);
+  // Loop thread only: queues a chunk by reference (cached bytes or a file
+  // range) and flushes.
+  void Send(const std::shared_ptr<Connection> &conn, OutChunk chunk,
+            bool close_after_write);
+  void Close(const std::shared_ptr<Connection> &conn);
+
+  // Creates a non-blocking listening socket bound to the given port.
+  static int Listen(int port, int backlog, bool reuse_port);
+
+private:
+  void Accept();
+  // Out of descriptors or memory, accept4 fails at once for as long as
+  // connections wait, and a level-triggered listen fd would spin the loop.
+  // Stop watching it for a short back-off instead.
+  void PauseAccept();
+  void ResumeAccept();
+  void OnReadable(const std::shared_ptr<Connection> &conn);
+  void Flush(const std::shared_ptr<Connection> &conn);
+  void RunPending();
+  void CloseIdle();
+
+  int listen_fd_;
+  bool owns_listen_fd_;
+  uint32_t listen_events_;
+  // When the listen fd is out of the epoll set, when to put it back.
+  bool accept_paused_{false};
+  std::chrono::steady_clock::time_point accept_resume_;
+  int epoll_fd_;
+  int wake_fd_;
+  std::atomic<bool> running_{false};
+  ReadHandler on_read_;
+  int idle_timeout_ms_;
+  std::unordered_map<int, std::shared_ptr<Connection>> connections_;
+  std::mutex pending_mu_;
+  std::vector<std::function<void()>> pending_;
+};
+
+} // namespace server
+} // namespace epiphany
@@ -0,0 +1,355 @@
+#include "epiphany/server/http_parser.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <strings.h>
+
+namespace epiphany {
+namespace server {
+
+namespace {
+
+const char *ReasonPhrase(int status) {
+  switch (status) {
+  case 100:
+    return "Continue";
+  case 200:
+    return "OK";
+  case 304:
+    return "Not Modified";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 408:
+    return "Request Timeout";
+  case 413:
+    return "Payload Too Large";
+  case 431:
+    return "Request Header Fields Too Large";
+  case 500:
+    return "Internal Server Error";
+  case 501:
+    return "Not Implemented";
+  case 503:
+    return "Service Unavailable";
+  case 504:
+    return "Gateway Timeout";
+  case 505:
+    return "HTTP Version Not Supported";
+  default:
+    return "Unknown";
+  }
+}
+
+bool ContainsToken(const std::string &value, const char *token) {
+  size_t n = std::strlen(token);
+  size_t pos = 0;
+  while (pos < value.size()) {
+    size_t end = value.find(',', pos);
+    if (end == std::string::npos)
+      end = value.size();
+    size_t b = value.find_first_not_of(" \t", pos);
+    size_t e = end;
+    while (e > b && (value[e - 1] == ' ' || value[e - 1] == '\t'))
+      --e;
+    if (b < e && e - b == n && strncasecmp(value.data() + b, token, n) == 0)
+      return true;
+    pos = end + 1;
+  }
+  return false;
+}
+
+// Appends bytes up to and including the next '\n' to line. Returns the number
+// of bytes used; *done is set once the line is complete.
+size_t ReadLine(const char *data, size_t len, std::string *line, bool *done) {
+  const char *nl = static_cast<const char *>(std::memchr(data, '\n', len));
+  size_t used = nl ? static_cast<size_t>(nl - data) + 1 : len;
+  line->append(data, used);
+  *done = nl != nullptr;
+  return used;
+}
+
+} // namespace
+
+bool CaseInsensitiveLess::operator()(const std::string &a,
+                                     const std::string &b) const {
+  return strcasecmp(a.c_str(), b.c_str()) < 0;
+}
+
+// Helper function to parse HTTP headers
+HeaderMap ParseHeaders(const std::string &request) {
+  HeaderMap headers;
+  std::istringstream iss(request);
+  std::string line;
+  // Skip first line (request line)
+  std::getline(iss, line);
+  while (std::getline(iss, line)) {
+    if (line.empty() || line == "\r")
+      break;
+    // Remove trailing \r if present
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+      std::string key = line.substr(0, colon);
+      std::string value = line.substr(colon + 1);
+      // Trim leading whitespace from value
+      size_t start = value.find_first_not_of(" \t");
+      if (start != std::string::npos) {
+        value = value.substr(start);
+      }
+      headers[key] = value;
+    }
+  }
+  return headers;
+}
+
+std::string UrlDecode(const std::string &in) {
+  std::string out;
+  out.reserve(in.size());
+  for (size_t i = 0; i < in.size(); ++i) {
+    if (in[i] == '%' && i + 2 < in.size()) {
+      char hex[3] = {in[i + 1], in[i + 2], 0};
+      int v = std::strtol(hex, nullptr, 16);
+      out.push_back(static_cast<char>(v));
+      i += 2;
+    } else if (in[i] == '+') {
+      out.push_back(' ');
+    } else {
+      out.push_back(in[i]);
+    }
+  }
+  return out;
+}
+
+const std::string &HttpRequest::Header(const std::string &name) const {
+  static const std::string kEmpty;
+  auto it = headers.find(name);
+  return it != headers.end() ? it->second : kEmpty;
+}
+
+size_t HttpResponse::BodySize() const {
+  if (file_fd >= 0)
+    return file_length;
+  return shared_body ? shared_body->size() : body.size();
+}
+
+std::string SerializeHead(const HttpResponse &response, bool keep_alive) {
+  std::string out;
+  out.reserve(128);
+  out += "HTTP/1.1 ";
+  out += std::to_string(response.status);
+  out += ' ';
+  out += ReasonPhrase(response.status);
+  out += "\r\nContent-Type: ";
+  out += response.content_type;
+  if (response.status != 304) {
+    out += "\r\nContent-Length: ";
+    out += std::to_string(response.BodySize());
+  }
+  out += keep_alive ? "\r\nConnection: keep-alive" : "\r\nConnection: close";
+  for (const auto &h : response.headers) {
+    out += "\r\n";
+    out += h.first;
+    out += ": ";
+    out += h.second;
+  }
+  out += "\r\n\r\n";
+  return out;
+}
+
+HttpParser::Status HttpParser::Parse(const char *data, size_t len,
+                                     size_t *consumed) {
+  size_t pos = 0;
+  while (pos < len) {
+    switch (state_) {
+    case State::kHead: {
+      size_t old_size = head_.size();
+      size_t take = std::min(len - pos, max_head_bytes_ + 4 - old_size);
+      head_.append(data + pos, take);
+      size_t from = old_size >= 3 ? old_size - 3 : 0;
+      size_t end = head_.find("\r\n\r\n", from);
+      if (end == std::string::npos) {
+        pos += take;
+        if (head_.size() > max_head_bytes_) {
+          *consumed = pos;
+          return Fail(431);
+        }
+        break;
+      }
+      head_.resize(end + 4);
+      pos += end + 4 - old_size;
+      Status s = OnHeadComplete();
+      if (s != Status::kNeedMore) {
+        *consumed = pos;
+        return s;
+      }
+      break;
+    }
+    case State::kBody: {
+      size_t take = std::min(len - pos, remaining_);
+      request_.body.append(data + pos, take);
+      pos += take;
+      remaining_ -= take;
+      if (remaining_ == 0) {
+        *consumed = pos;
+        return Status::kComplete;
+      }
+      break;
+    }
+    case State::kChunkSize: {
+      bool done = false;
+      pos += ReadLine(data + pos, len - pos, &line_, &done);
+      if (line_.size() > 1024) {
+        *consumed = pos;
+        return Fail(400);
+      }
+      if (!done)
+        break;
+      char *end = nullptr;
+      unsigned long long size = std::strtoull(line_.c_str(), &end, 16);
+      if (end == line_.c_str()) {
+        *consumed = pos;
+        return Fail(400);
+      }
+      line_.clear();
+      if (size == 0) {
+        state_ = State::kTrailers;
+        break;
+      }
+      if (size > max_body_bytes_ - request_.body.size()) {
+        *consumed = pos;
+        return Fail(413);
+      }
+      remaining_ = static_cast<size_t>(size);
+      state_ = State::kChunkData;
+      break;
+    }
+    case State::kChunkData: {
+      size_t take = std::min(len - pos, remaining_);
+      request_.body.append(data + pos, take);
+      pos += take;
+      remaining_ -= take;
+      if (remaining_ == 0)
+        state_ = State::kChunkDataEnd;
+      break;
+    }
+    case State::kChunkDataEnd: {
+      bool done = false;
+      pos += ReadLine(data + pos, len - pos, &line_, &done);
+      if (!done)
+        break;
+      bool blank = line_ == "\r\n" || line_ == "\n";
+      line_.clear();
+      if (!blank) {
+        *consumed = pos;
+        return Fail(400);
+      }
+      state_ = State::kChunkSize;
+      break;
+    }
+    case State::kTrailers: {
+      bool done = false;
+      pos += ReadLine(data + pos, len - pos, &line_, &done);
+      if (line_.size() > max_head_bytes_) {
+        *consumed = pos;
+        return Fail(431);
+      }
+      if (!done)
+        break;
+      bool blank = line_ == "\r\n" || line_ == "\n";
+      line_.clear();
+      if (blank) {
+        *consumed = pos;
+        return Status::kComplete;
+      }
+      break;
+    }
+    }
+  }
+  *consumed = pos;
+  return Status::kNeedMore;
+}
+
+HttpParser::Status HttpParser::OnHeadComplete() {
+  size_t line_end = head_.find("\r\n");
+  std::istringstream li(head_.substr(0, line_end));
+  li >> request_.method >> request_.target >> request_.version;
+  if (request_.method.empty() || request_.target.empty() ||
+      request_.version.rfind("HTTP/", 0) != 0) {
+    return Fail(400);
+  }
+  if (request_.version != "HTTP/1.1" && request_.version != "HTTP/1.0") {
+    return Fail(505);
+  }
+  request_.headers = ParseHeaders(head_);
+
+  const std::string &connection = request_.Header("Connection");
+  if (request_.version == "HTTP/1.1") {
+    request_.keep_alive = !ContainsToken(connection, "close");
+  } else {
+    request_.keep_alive = ContainsToken(connection, "keep-alive");
+  }
+
+  const std::string &te = request_.Header("Transfer-Encoding");
+  const std::string &cl = request_.Header("Content-Length");
+  if (!te.empty()) {
+    if (!ContainsToken(te, "chunked")) {
+      return Fail(501);
+    }
+    state_ = State::kChunkSize;
+  } else if (!cl.empty()) {
+    if (cl.find_first_not_of("0123456789") != std::string::npos ||
+        cl.size() > 18) {
+      return Fail(400);
+    }
+    remaining_ = static_cast<size_t>(std::stoull(cl));
+    if (remaining_ > max_body_bytes_) {
+      return Fail(413);
+    }
+    if (remaining_ == 0) {
+      return Status::kComplete;
+    }
+    request_.body.reserve(remaining_);
+    state_ = State::kBody;
+  } else {
+    return Status::kComplete;
+  }
+  expect_continue_ = ContainsToken(request_.Header("Expect"), "100-continue");
+  return Status::kNeedMore;
+}
+
+HttpParser::Status HttpParser::Fail(int status) {
+  request_.error_status = status;
+  request_.keep_alive = false;
+  return Status::kError;
+}
+
+HttpRequest HttpParser::TakeRequest() {
+  HttpRequest out = std::move(request_);
+  Reset();
+  return out;
+}
+
+bool HttpParser::TakeExpectContinue() {
+  bool out = expect_continue_;
+  expect_continue_ = false;
+  return out;
+}
+
+void HttpParser::Reset() {
+  state_ = State::kHead;
+  head_.clear();
+  line_.clear();
+  remaining_ = 0;
+  expect_continue_ = false;
+  request_ = HttpRequest();
+}
+
+} // namespace server
+} // namespace epiphany
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace epiphany {
+namespace observability {
+class Trace;
+} // namespace observability
+namespace server {
+
+// Header names compare case-insensitively but keep the spelling the client
+// sent, so they can be echoed back unchanged.
+struct CaseInsensitiveLess {
+  bool operator()(const std::string &a, const std::string &b) const;
+};
+using HeaderMap = std::map<std::string, std::string, CaseInsensitiveLess>;
+
+// Parses the header lines of a request head (the request line is skipped).
+HeaderMap ParseHeaders(const std::string &request);
+
+// Decodes %XX escapes and '+' in a query-string component.
+std::string UrlDecode(const std::string &in);
+
+struct HttpRequest {
+  std::string method;
+  std::string target;
+  std::string version;
+  HeaderMap headers;
+  std::string body;
+  bool keep_alive{true};
+  // Non-zero when the request could not be parsed; the connection answers
+  // with this status and closes.
+  int error_status{0};
+  // Set by the server once the request is complete; shared so it can ride
+  // along in the tasks that carry the request between threads.
+  std::shared_ptr<epiphany::observability::Trace> trace;
+
+  const std::string &Header(const std::string &name) const;
+};
+
+struct HttpResponse {
+  int status{200};
+  std::string content_type{"application/json"};
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+  // Set instead of body to send bytes owned elsewhere (e.g. the static file
+  // cache) without copying them.
+  std::shared_ptr<const std::string> shared_body;
+  // Set instead of body to send the first file_length bytes of an open
+  // file with sendfile. The descriptor must outlive the response.
+  int file_fd{-1};
+  size_t file_length{0};
+
+  size_t BodySize() const;
+};
+
+// Serializes the status line and headers of a response, with Content-Length
+// framing for its body (omitted for 304, which has none). The body is sent
+// as is after it, so it is never copied into the head.
+std::string SerializeHead(const HttpResponse &response, bool keep_alive);
+
+// Incremental HTTP/1.1 request parser. Bytes may arrive in arbitrary
+// fragments; each byte is examined once. Supports Content-Length and chunked
+// request bodies.
+class HttpParser {
+public:
+  enum class Status { kNeedMore, kComplete, kError };
+
+  HttpParser(size_t max_head_bytes, size_t max_body_bytes)
+      : max_head_bytes_(max_head_bytes), max_body_bytes_(max_body_bytes) {}
+
+  // Consumes bytes from data[0, len) and stores the number used in
+  // *consumed. On kComplete the request is available via TakeRequest(); on
+  // kError the request carries error_status.
+  Status Parse(const char *data, size_t len, size_t *consumed);
+  HttpRequest TakeRequest();
+
+  // True once per request when the head asked for "Expect: 100-continue"
+  // and the body has not arrived yet.
+  bool TakeExpectContinue();
+
+private:
+  enum class State {
+    kHead,
+    kBody,
+    kChunkSize,
+    kChunkData,
+    kChunkDataEnd,
+    kTrailers,
+  };
+
+  Status OnHeadComplete();
+  Status Fail(int status);
+  void Reset();
+
+  size_t max_head_bytes_;
+  size_t max_body_bytes_;
+  State state_{State::kHead};
+  std::string head_;
+  std::string line_;
+  size_t remaining_{0};
+  bool expect_continue_{false};
+  HttpRequest request_;
+};
+
+} // namespace server
+} // namespace epiphany
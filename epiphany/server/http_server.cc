@@ -1,150 +1,569 @@
 #include "epiphany/server/http_server.h"
+#include "epiphany/database/item_json.h"
+#include "epiphany/database/json_writer.h"
 #include "epiphany/observability/metrics.h"
-#include <arpa/inet.h>
+#include "epiphany/observability/trace.h"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <csignal>
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <map>
-#include <netinet/in.h>
 #include <sstream>
 #include <string>
-#include <sys/socket.h>
+#include <string_view>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
 namespace epiphany {
 namespace server {
 
+namespace {
+constexpr size_t kMaxHeaderBytes = 64 * 1024;
+constexpr size_t kMaxPipelined = 16;
+// Longest deadline a request may ask for, so it converts to ns safely.
+constexpr int64_t kMaxDeadlineMs = 24 * 60 * 60 * 1000;
+
+using epiphany::observability::NowNs;
+using epiphany::observability::Stage;
+using epiphany::observability::Trace;
+
+HttpResponse JsonResponse(int status, std::string body) {
+  HttpResponse response;
+  response.status = status;
+  response.body = std::move(body);
+  return response;
+}
+
+// A request refused by admission control, told when to come back.
+HttpResponse Overloaded(int retry_after_s) {
+  HttpResponse response = JsonResponse(503, "{\"error\":\"overloaded\"}");
+  response.headers.emplace_back("Retry-After", std::to_string(retry_after_s));
+  return response;
+}
+
+HttpResponse TimeoutResponse() {
+  return JsonResponse(504, "{\"error\":\"deadline exceeded\"}");
+}
+
+// Health checks and metric scrapes bypass admission control, so a server
+// shedding load still says so.
+bool IsProbe(const std::string &target) {
+  return target == "/health" || target.rfind("/metrics", 0) == 0;
+}
+
+// The request's deadline: the X-Request-Timeout header or, failing that,
+// the deadline_ms parameter, in milliseconds from the request's first
+// byte, else default_ms; 0 for none. Values other than positive integers
+// are ignored, and budgets past a day are cut to one.
+int64_t RequestDeadline(const HttpRequest &request, int default_ms) {
+  std::string ms = request.Header("X-Request-Timeout");
+  if (ms.empty()) {
+    size_t qm = request.target.find('?');
+    std::istringstream qss(qm != std::string::npos
+                               ? request.target.substr(qm + 1)
+                               : std::string());
+    std::string kv;
+    while (std::getline(qss, kv, '&')) {
+      if (kv.rfind("deadline_ms=", 0) == 0)
+        ms = kv.substr(12);
+    }
+  }
+  int64_t budget_ms = default_ms;
+  try {
+    size_t used = 0;
+    long long value = ms.empty() ? 0 : std::stoll(ms, &used);
+    if (value > 0 && used == ms.size())
+      budget_ms = value;
+  } catch (...) {
+  }
+  if (budget_ms <= 0)
+    return 0;
+  budget_ms = std::min<int64_t>(budget_ms, kMaxDeadlineMs);
+  int64_t start_ns = request.trace ? request.trace->start_ns() : NowNs();
+  return start_ns + budget_ms * 1000000;
+}
+
+// The whole of text as a number; NaN is refused.
+bool ParsePrice(const std::string &text, double *price) {
+  try {
+    size_t used = 0;
+    double value = std::stod(text, &used);
+    if (used != text.size() || std::isnan(value))
+      return false;
+    *price = value;
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+// Reads q, limit, offset, sort, cursor, facets, min_price and max_price from
+// the query string of a search path. Any cursor parameter, even an empty
+// one, selects keyset paging, which is always in id order. sort is
+// "relevance" (the default), "id", "price_asc" or "price_desc". facets is a
+// comma list of "brand", "category" and "price". The price bounds are
+// inclusive; either may be left out. Offsets past database::kMaxOffset
+// are refused.
+bool ParseSearchRequest(const std::string &path,
+                        epiphany::qrs::SearchRequest *search,
+                        std::string *error) {
+  size_t qm = path.find('?');
+  std::string qs = (qm != std::string::npos) ? path.substr(qm + 1) : "";
+  std::string limit_s, offset_s, cursor, sort, facets, min_price, max_price;
+  std::istringstream qss(qs);
+  std::string kv;
+  while (std::getline(qss, kv, '&')) {
+    size_t eq = kv.find('=');
+    if (eq == std::string::npos)
+      continue;
+    std::string k = kv.substr(0, eq);
+    std::string v = UrlDecode(kv.substr(eq + 1));
+    if (k == "q")
+      search->q = v;
+    else if (k == "limit")
+      limit_s = v;
+    else if (k == "offset")
+      offset_s = v;
+    else if (k == "sort")
+      sort = v;
+    else if (k == "facets")
+      facets = v;
+    else if (k == "min_price")
+      min_price = v;
+    else if (k == "max_price")
+      max_price = v;
+    else if (k == "cursor") {
+      search->keyset = true;
+      cursor = v;
+    }
+  }
+  if (search->q.empty()) {
+    *error = "missing q";
+    return false;
+  }
+  try {
+    if (!limit_s.empty())
+      search->limit = std::stoi(limit_s);
+    if (!offset_s.empty())
+      search->offset = std::stoi(offset_s);
+  } catch (...) {
+    *error = "invalid limit or offset";
+    return false;
+  }
+  if (search->offset > epiphany::database::kMaxOffset) {
+    *error = "offset too large";
+    return false;
+  }
+  if ((!min_price.empty() && !ParsePrice(min_price, &search->price.min)) ||
+      (!max_price.empty() && !ParsePrice(max_price, &search->price.max))) {
+    *error = "invalid min_price or max_price";
+    return false;
+  }
+  if (sort == "id") {
+    search->sort = epiphany::qrs::SortOrder::kId;
+  } else if (sort == "price_asc") {
+    search->sort = epiphany::qrs::SortOrder::kPriceAsc;
+  } else if (sort == "price_desc") {
+    search->sort = epiphany::qrs::SortOrder::kPriceDesc;
+  } else if (!sort.empty() && sort != "relevance") {
+    *error = "invalid sort";
+    return false;
+  }
+  std::istringstream fss(facets);
+  std::string facet;
+  while (std::getline(fss, facet, ',')) {
+    using Database = epiphany::database::Database;
+    if (facet == "brand") {
+      search->facets |= Database::kFacetBrand;
+    } else if (facet == "category") {
+      search->facets |= Database::kFacetCategory;
+    } else if (facet == "price") {
+      search->facets |= Database::kFacetPrice;
+    } else {
+      *error = "invalid facets";
+      return false;
+    }
+  }
+  if (search->keyset) {
+    epiphany::qrs::Cursor decoded;
+    if (!epiphany::qrs::DecodeCursor(cursor, &decoded)) {
+      *error = "invalid cursor";
+      return false;
+    }
+    search->after_id = decoded.last_id;
+  }
+  return true;
+}
+// Reads prefix and limit (default kTopK) from the query string of
+// /api/suggest. A missing prefix completes the empty one.
+bool ParseSuggestRequest(const std::string &path, std::string *prefix,
+                         int *limit, std::string *error) {
+  *limit = static_cast<int>(epiphany::suggest::CompletionTrie::kTopK);
+  size_t qm = path.find('?');
+  std::istringstream qss(qm != std::string::npos ? path.substr(qm + 1)
+                                                 : std::string());
+  std::string kv;
+  while (std::getline(qss, kv, '&')) {
+    size_t eq = kv.find('=');
+    if (eq == std::string::npos)
+      continue;
+    std::string k = kv.substr(0, eq);
+    if (k == "prefix") {
+      *prefix = UrlDecode(kv.substr(eq + 1));
+    } else if (k == "limit") {
+      try {
+        *limit = std::stoi(kv.substr(eq + 1));
+      } catch (...) {
+        *error = "invalid limit";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+// GET /debug/traces?n=N: the N (default 20) slowest traces still held,
+// slowest first.
+std::string TracesJson(const std::string &path) {
+  using epiphany::observability::TraceRecord;
+  size_t n = 20;
+  size_t qm = path.find('?');
+  std::istringstream qss(qm != std::string::npos ? path.substr(qm + 1)
+                                                 : std::string());
+  std::string kv;
+  while (std::getline(qss, kv, '&')) {
+    if (kv.rfind("n=", 0) == 0) {
+      try {
+        n = std::stoul(kv.substr(2));
+      } catch (...) {
+      }
+    }
+  }
+  std::vector<TraceRecord> traces =
+      epiphany::observability::TraceStore::Slowest(n);
+  std::string json;
+  json.reserve(256 + traces.size() * 768);
+  epiphany::database::JsonWriter out(&json);
+  out.Raw("{\"traces\":[");
+  for (size_t i = 0; i < traces.size(); ++i) {
+    const TraceRecord &t = traces[i];
+    out.Raw(i == 0 ? "{" : ",{")
+        .Raw("\"trace_id\":").String(t.trace_id)
+        .Raw(",\"target\":").String(t.target)
+        .Raw(",\"endpoint\":\"").Raw(epiphany::observability::EndpointName(t.endpoint))
+        .Raw("\",\"status\":").Int(t.status)
+        .Raw(",\"start_unix_us\":").Int(t.start_unix_us)
+        .Raw(",\"total_ms\":").Fixed(t.total_ns / 1e6, 3)
+        .Raw(",\"spans\":[");
+    for (uint32_t k = 0; k < t.span_count; ++k) {
+      const TraceRecord::Span &span = t.spans[k];
+      out.Raw(k == 0 ? "{\"stage\":\"" : ",{\"stage\":\"")
+          .Raw(epiphany::observability::StageName(span.stage))
+          .Raw("\",\"offset_ms\":").Fixed(span.offset_ns / 1e6, 3)
+          .Raw(",\"duration_ms\":").Fixed(span.duration_ns / 1e6, 3)
+          .Raw("}");
+    }
+    out.Raw("]}");
+  }
+  out.Raw("]}");
+  return json;
+}
+} // namespace
+
 HttpServer::HttpServer(int port,
                        std::shared_ptr<epiphany::database::Database> db,
-                       const std::string &web_root)
-    : port_(port), qrs_(std::make_shared<epiphany::qrs::QRS>(db)),
-      web_root_(web_root) {}
+                       const std::string &web_root,
+                       const ServerOptions &options)
+    : port_(port), db_(db), qrs_(std::make_shared<epiphany::qrs::QRS>(db, options.qrs)),
+      web_root_(web_root), options_(options) {
+  if (static_files_.Load(web_root_, options_.static_files)) {
+    std::cout << "Loaded " << static_files_.size() << " static files from "
+              << web_root_ << std::endl;
+  }
+}
 
 void HttpServer::Start() {
-  int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (server_fd == 0) {
-    perror("Socket creation failed");
-    return;
-  }
+  signal(SIGPIPE, SIG_IGN);
 
-  int opt = 1;
-  setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  int cores = static_cast<int>(std::thread::hardware_concurrency());
+  if (cores < 1)
+    cores = 1;
+  int io_threads = options_.io_threads > 0 ? options_.io_threads : cores;
+  int worker_threads =
+      options_.worker_threads > 0 ? options_.worker_threads : cores;
 
-  struct sockaddr_in address;
-  address.sin_family = AF_INET;
-  address.sin_addr.s_addr = INADDR_ANY;
-  address.sin_port = htons(port_);
+  workers_ = std::make_unique<ThreadPool>(worker_threads);
+  admission_ = std::make_unique<AdmissionController>(
+      workers_.get(), worker_threads, options_.admission);
+  auto on_read = [this](const std::shared_ptr<Connection> &conn) {
+    OnReadable(conn);
+  };
 
-  if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-    perror("Bind failed");
-    return;
+  int shared_fd = -1;
+  if (!options_.reuse_port) {
+    shared_fd = EventLoop::Listen(port_, options_.backlog, false);
+    if (shared_fd < 0)
+      return;
   }
-
-  if (listen(server_fd, 3) < 0) {
-    perror("Listen failed");
-    return;
+  for (int i = 0; i < io_threads; ++i) {
+    int fd = shared_fd;
+    if (options_.reuse_port) {
+      fd = EventLoop::Listen(port_, options_.backlog, true);
+      if (fd < 0)
+        return;
+    }
+    loops_.push_back(std::make_unique<EventLoop>(
+        fd, options_.reuse_port, on_read, options_.idle_timeout_ms));
   }
 
-  std::cout << "Server listening on port " << port_ << std::endl;
+  std::cout << "Server listening on port " << port_ << " (" << io_threads
+            << " io threads, " << worker_threads << " workers"
+            << (options_.admission.adaptive ? ", adaptive concurrency" : "")
+            << (options_.reuse_port ? ", SO_REUSEPORT" : "") << ")"
+            << std::endl;
 
-  while (true) {
-    struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int new_socket =
-        accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
-    if (new_socket >= 0) {
-      char client_ip[INET_ADDRSTRLEN];
-      inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-      int client_port = ntohs(client_addr.sin_port);
-      HandleClient(new_socket, std::string(client_ip), client_port);
-      close(new_socket);
-    }
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < loops_.size(); ++i) {
+    threads.emplace_back([this, i] { loops_[i]->Run(); });
+  }
+  loops_[0]->Run();
+  for (auto &t : threads) {
+    t.join();
+  }
+  if (shared_fd >= 0) {
+    close(shared_fd);
   }
 }
 
-// Helper function to parse HTTP headers
-std::map<std::string, std::string> ParseHeaders(const std::string &request) {
-  std::map<std::string, std::string> headers;
-  std::istringstream iss(request);
-  std::string line;
-  // Skip first line (request line)
-  std::getline(iss, line);
-  while (std::getline(iss, line)) {
-    if (line.empty() || line == "\r")
+void HttpServer::OnReadable(const std::shared_ptr<Connection> &conn) {
+  if (conn->close_after_write) {
+    // A "Connection: close" response is on its way out; ignore the rest.
+    conn->in.clear();
+    return;
+  }
+  if (!conn->parser) {
+    conn->parser =
+        std::make_unique<HttpParser>(kMaxHeaderBytes, options_.max_body_bytes);
+  }
+  size_t offset = 0;
+  while (offset < conn->in.size() && conn->pipeline.size() < kMaxPipelined) {
+    if (!conn->pipeline.empty() && conn->pipeline.back().error_status != 0)
       break;
-    // Remove trailing \r if present
-    if (!line.empty() && line.back() == '\r') {
-      line.pop_back();
-    }
-    size_t colon = line.find(':');
-    if (colon != std::string::npos) {
-      std::string key = line.substr(0, colon);
-      std::string value = line.substr(colon + 1);
-      // Trim leading whitespace from value
-      size_t start = value.find_first_not_of(" \t");
-      if (start != std::string::npos) {
-        value = value.substr(start);
+    if (conn->request_start_ns == 0)
+      conn->request_start_ns = conn->read_ns;
+    size_t consumed = 0;
+    int64_t parse_begin = NowNs();
+    auto status = conn->parser->Parse(conn->in.data() + offset,
+                                      conn->in.size() - offset, &consumed);
+    int64_t parse_end = NowNs();
+    conn->parse_ns += parse_end - parse_begin;
+    offset += consumed;
+    if (status == HttpParser::Status::kNeedMore) {
+      if (conn->parser->TakeExpectContinue()) {
+        conn->loop->Send(conn, "HTTP/1.1 100 Continue\r\n\r\n", false);
       }
-      headers[key] = value;
+      break;
     }
+    HttpRequest request = conn->parser->TakeRequest();
+    StartTrace(conn, &request, parse_end);
+    conn->pipeline.push_back(std::move(request));
   }
-  return headers;
+  conn->in.erase(0, offset);
+  Dispatch(conn);
 }
 
-void HttpServer::HandleClient(int client_socket, const std::string &client_ip,
-                              int client_port) {
-  char buffer[4096] = {0};
-  read(client_socket, buffer, 4096);
-  std::string request(buffer);
-  {
-    std::istringstream li(request);
-    std::string m, p;
-    li >> m >> p;
-    std::cout << "[req] " << m << " " << p << " from " << client_ip << ":"
-              << client_port << std::endl;
+void HttpServer::StartTrace(const std::shared_ptr<Connection> &conn,
+                            HttpRequest *request, int64_t parsed_ns) {
+  // Traces start at the request's first byte. A connection's first request
+  // also carries the accept, at a negative offset: the client's pause
+  // between connecting and sending is not server time.
+  auto trace = std::make_shared<Trace>(request->Header("X-Trace-Id"),
+                                       conn->request_start_ns);
+  if (conn->accept_end_ns != 0) {
+    trace->AddSpan(Stage::kAccept, conn->accept_begin_ns, conn->accept_end_ns);
+    conn->accept_end_ns = 0;
   }
+  trace->AddSpan(Stage::kRead, conn->request_start_ns, parsed_ns);
+  trace->AddSpan(Stage::kParse, parsed_ns - conn->parse_ns, parsed_ns);
+  trace->SetTarget(request->target);
+  request->trace = std::move(trace);
+  conn->request_start_ns = 0;
+  conn->parse_ns = 0;
+}
 
+void HttpServer::Dispatch(const std::shared_ptr<Connection> &conn) {
+  if (conn->busy || conn->closed || conn->pipeline.empty())
+    return;
+  if (conn->pipeline.front().error_status != 0) {
+    // Answered and closed through Respond like any other request, so it
+    // leaves after the responses before it. The bad request stays queued
+    // until then, which keeps OnReadable from parsing past it.
+    conn->busy = true;
+    HttpResponse response;
+    response.status = conn->pipeline.front().error_status;
+    response.body = "{\"error\":\"bad request\"}";
+    epiphany::observability::Metrics::errors.fetch_add(1);
+    auto trace = std::move(conn->pipeline.front().trace);
+    if (trace) {
+      trace->SetResult(response.status,
+                       epiphany::observability::Endpoint::kOther);
+      response.headers.emplace_back("X-Trace-Id", trace->id());
+    }
+    Respond(conn, std::move(response), false, std::move(trace));
+    return;
+  }
+  conn->busy = true;
+  auto request = std::make_shared<HttpRequest>(std::move(conn->pipeline.front()));
+  conn->pipeline.pop_front();
+  int64_t queued_ns = NowNs();
+  auto task = [this, conn, request, queued_ns] {
+    if (request->trace)
+      request->trace->AddSpan(Stage::kQueue, queued_ns, NowNs());
+    return HandleRequest(conn, *request);
+  };
+  if (IsProbe(request->target)) {
+    workers_->Submit(std::move(task));
+    return;
+  }
+  if (admission_->Submit(std::move(task)))
+    return;
+  epiphany::observability::Metrics::shed.fetch_add(1);
+  HttpResponse response = Overloaded(options_.admission.retry_after_s);
+  if (request->trace) {
+    request->trace->SetResult(response.status,
+                              epiphany::observability::Endpoint::kOther);
+    response.headers.emplace_back("X-Trace-Id", request->trace->id());
+  }
+  Respond(conn, std::move(response), request->keep_alive, request->trace);
+}
+
+bool HttpServer::HandleRequest(const std::shared_ptr<Connection> &conn,
+                               const HttpRequest &request) {
+  std::cout << "[req] " << request.method << " " << request.target << " from "
+            << conn->client_ip << ":" << conn->client_port << std::endl;
+
+  epiphany::observability::ScopedTrace scoped_trace(request.trace.get());
   auto t0 = std::chrono::steady_clock::now();
-  auto response = ProcessRequest(request, client_ip, client_port);
+  auto endpoint = epiphany::observability::Endpoint::kOther;
+  int64_t deadline_ns = RequestDeadline(request, options_.default_deadline_ms);
+  // A request that spent its deadline waiting for a worker is not started.
+  auto response = deadline_ns != 0 && NowNs() >= deadline_ns
+                      ? TimeoutResponse()
+                      : ProcessRequest(request, conn->client_ip,
+                                       conn->client_port, deadline_ns,
+                                       &endpoint);
+  bool timed_out = response.status == 504;
+  if (timed_out)
+    epiphany::observability::Metrics::timeouts.fetch_add(1);
   auto t1 = std::chrono::steady_clock::now();
-  auto ms =
-      std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
-  epiphany::observability::Metrics::RecordRequest();
-  epiphany::observability::Metrics::RecordLatency(ms);
-  send(client_socket, response.c_str(), response.size(), 0);
+  auto us =
+      std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+  epiphany::observability::Metrics::RecordRequest(endpoint, us);
+  if (request.trace) {
+    request.trace->SetResult(response.status, endpoint);
+    response.headers.emplace_back("X-Trace-Id", request.trace->id());
+  }
+  Respond(conn, std::move(response), request.keep_alive, request.trace);
+  return timed_out;
 }
 
-std::string HttpServer::ProcessRequest(const std::string &request,
-                                       const std::string &client_ip,
-                                       int client_port) {
-  std::istringstream iss(request);
-  std::string method, path, protocol;
-  iss >> method >> path >> protocol;
+void HttpServer::Respond(const std::shared_ptr<Connection> &conn,
+                         HttpResponse response, bool keep_alive,
+                         std::shared_ptr<Trace> trace) {
+  epiphany::observability::ScopedSpan serialize(Stage::kSerialize);
+  std::string head = SerializeHead(response, keep_alive);
+  serialize.End();
+  // Head and body are handed to the loop as separate chunks and leave in one
+  // sendmsg; the body is moved or shared, never copied. Static files too big
+  // to cache follow their head with sendfile.
+  OutChunk body;
+  if (response.file_fd >= 0) {
+    body.file_fd = response.file_fd;
+    body.file_length = response.file_length;
+  } else if (response.shared_body) {
+    body.shared = std::move(response.shared_body);
+  } else {
+    body.data = std::move(response.body);
+  }
+  int64_t posted_ns = NowNs();
+  conn->loop->Post([this, conn, keep_alive, head = std::move(head),
+                    body = std::move(body), trace = std::move(trace),
+                    posted_ns]() mutable {
+    conn->busy = false;
+    if (!keep_alive) {
+      conn->pipeline.clear();
+      conn->in.clear();
+      conn->loop->Queue(conn, std::move(head));
+      conn->loop->Send(conn, std::move(body), true);
+    } else {
+      // Queue this response before starting the next pipelined request so
+      // responses leave in request order. The connection stays busy while
+      // a request is waiting, so a peer that half-closed after sending is
+      // not dropped before it gets every response.
+      conn->busy = !conn->pipeline.empty();
+      conn->loop->Queue(conn, std::move(head));
+      conn->loop->Send(conn, std::move(body), false);
+      conn->busy = false;
+      Dispatch(conn);
+    }
+    if (trace) {
+      trace->AddSpan(Stage::kSend, posted_ns, NowNs());
+      trace->Finish();
+    }
+    if (keep_alive && !conn->in.empty()) {
+      OnReadable(conn);
+    }
+  });
+}
 
-  // Parse headers for client info
-  auto headers = ParseHeaders(request);
+HttpResponse HttpServer::ProcessRequest(
+    const HttpRequest &request, const std::string &client_ip, int client_port,
+    int64_t deadline_ns, epiphany::observability::Endpoint *endpoint) {
+  using epiphany::observability::Endpoint;
+  // Ends where a handler takes over; trivial handlers are counted in it.
+  epiphany::observability::ScopedSpan route(Stage::kRoute);
+  const std::string &method = request.method;
+  std::string path = request.target;
+  const HeaderMap &headers = request.headers;
 
-  if (method != "GET") {
-    epiphany::observability::Metrics::errors.fetch_add(1);
-    return "HTTP/1.1 405 Method Not Allowed\r\nContent-Type: "
-           "application/json\r\n\r\n{\"error\":\"method not allowed\"}";
+  if (method == "POST" && path.rfind("/api/items:bulk", 0) == 0) {
+    *endpoint = Endpoint::kBulk;
+    route.End();
+    return BulkInsert(request);
   }
 
-  if (path == "/") {
-    path = "/index.html";
+  if (method != "GET") {
+    epiphany::observability::Metrics::errors.fetch_add(1);
+    return JsonResponse(405, "{\"error\":\"method not allowed\"}");
   }
 
   if (path == "/health") {
+    *endpoint = Endpoint::kHealth;
     epiphany::observability::Metrics::health.fetch_add(1);
-    return "HTTP/1.1 200 OK\r\nContent-Type: "
-           "application/json\r\n\r\n{\"status\":\"ok\"}";
+    return JsonResponse(200, "{\"status\":\"ok\"}");
   }
 
   if (path.find("/metrics") == 0) {
+    *endpoint = Endpoint::kMetrics;
+    // Prometheus asks for text/plain or OpenMetrics; browsers and curl get
+    // the JSON unless they ask with ?format=prometheus.
+    const std::string &accept = request.Header("Accept");
+    if (path.find("format=prometheus") != std::string::npos ||
+        accept.find("text/plain") != std::string::npos ||
+        accept.find("application/openmetrics-text") != std::string::npos) {
+      HttpResponse response;
+      response.content_type = "text/plain; version=0.0.4; charset=utf-8";
+      response.body = epiphany::observability::Metrics::ToPrometheus();
+      return response;
+    }
     std::string json = epiphany::observability::Metrics::ToJson();
-    return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" + json;
+    return JsonResponse(200, std::move(json));
+  }
+
+  if (path.rfind("/debug/traces", 0) == 0) {
+    return JsonResponse(200, TracesJson(path));
   }
 
   // Client info endpoint
@@ -154,16 +573,16 @@ std::string HttpServer::ProcessRequest(const std::string &request,
     json << "\"ip\":\"" << client_ip << "\",";
     json << "\"port\":" << client_port << ",";
     json << "\"user_agent\":\""
-         << (headers.count("User-Agent") ? headers["User-Agent"] : "") << "\",";
+         << (headers.count("User-Agent") ? headers.at("User-Agent") : "") << "\",";
     json << "\"accept_language\":\""
-         << (headers.count("Accept-Language") ? headers["Accept-Language"] : "")
+         << (headers.count("Accept-Language") ? headers.at("Accept-Language") : "")
          << "\",";
-    json << "\"host\":\"" << (headers.count("Host") ? headers["Host"] : "")
+    json << "\"host\":\"" << (headers.count("Host") ? headers.at("Host") : "")
          << "\",";
     json << "\"connection\":\""
-         << (headers.count("Connection") ? headers["Connection"] : "") << "\",";
+         << (headers.count("Connection") ? headers.at("Connection") : "") << "\",";
     json << "\"accept\":\""
-         << (headers.count("Accept") ? headers["Accept"] : "") << "\",";
+         << (headers.count("Accept") ? headers.at("Accept") : "") << "\",";
     json << "\"headers\":{";
     bool first = true;
     for (const auto &h : headers) {
@@ -184,153 +603,128 @@ std::string HttpServer::ProcessRequest(const std::string &request,
     }
     json << "}";
     json << "}";
-    return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" +
-           json.str();
+    return JsonResponse(200, json.str());
+  }
+
+  if (path.find("/api/suggest") == 0) {
+    *endpoint = Endpoint::kSuggest;
+    epiphany::observability::Metrics::api_suggest.fetch_add(1);
+    std::string prefix, error;
+    int limit;
+    if (!ParseSuggestRequest(path, &prefix, &limit, &error)) {
+      return JsonResponse(400, "{\"error\":\"" + error + "\"}");
+    }
+    route.End();
+    return JsonResponse(200, qrs_->Suggest(prefix, limit));
   }
 
   if (path.find("/api/search_v2") == 0) {
+    *endpoint = Endpoint::kSearchV2;
     epiphany::observability::Metrics::api_search_v2.fetch_add(1);
-    size_t qm = path.find('?');
-    std::string qs = (qm != std::string::npos) ? path.substr(qm + 1) : "";
-    auto decode = [](const std::string &in) {
-      std::string out;
-      out.reserve(in.size());
-      for (size_t i = 0; i < in.size(); ++i) {
-        if (in[i] == '%' && i + 2 < in.size()) {
-          char hex[3] = {in[i + 1], in[i + 2], 0};
-          int v = std::strtol(hex, nullptr, 16);
-          out.push_back(static_cast<char>(v));
-          i += 2;
-        } else if (in[i] == '+') {
-          out.push_back(' ');
-        } else {
-          out.push_back(in[i]);
-        }
-      }
-      return out;
-    };
-    std::string q, limit_s, offset_s;
-    std::istringstream qss(qs);
-    std::string kv;
-    while (std::getline(qss, kv, '&')) {
-      size_t eq = kv.find('=');
-      if (eq == std::string::npos)
-        continue;
-      std::string k = kv.substr(0, eq);
-      std::string v = decode(kv.substr(eq + 1));
-      if (k == "q")
-        q = v;
-      else if (k == "limit")
-        limit_s = v;
-      else if (k == "offset")
-        offset_s = v;
-    }
-    if (q.empty()) {
-      return "HTTP/1.1 400 Bad Request\r\nContent-Type: "
-             "application/json\r\n\r\n{\"error\":\"missing q\"}";
+    epiphany::qrs::SearchRequest search;
+    std::string error;
+    if (!ParseSearchRequest(path, &search, &error)) {
+      return JsonResponse(400, "{\"error\":\"" + error + "\"}");
     }
-    int limit = 10, offset = 0;
-    try {
-      if (!limit_s.empty())
-        limit = std::stoi(limit_s);
-      if (!offset_s.empty())
-        offset = std::stoi(offset_s);
-    } catch (...) {
-      return "HTTP/1.1 400 Bad Request\r\nContent-Type: "
-             "application/json\r\n\r\n{\"error\":\"invalid limit or offset\"}";
-    }
-    std::string json = qrs_->SearchV2(q, limit, offset);
-    return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" + json;
+    search.deadline_ns = deadline_ns;
+    route.End();
+    std::string json = qrs_->SearchV2(search);
+    if (deadline_ns != 0 && NowNs() >= deadline_ns)
+      return TimeoutResponse();
+    return JsonResponse(200, std::move(json));
   }
 
   if (path.find("/api/search") == 0) {
+    *endpoint = Endpoint::kSearch;
     epiphany::observability::Metrics::api_search.fetch_add(1);
-    size_t qm = path.find('?');
-    std::string qs = (qm != std::string::npos) ? path.substr(qm + 1) : "";
-    auto decode = [](const std::string &in) {
-      std::string out;
-      out.reserve(in.size());
-      for (size_t i = 0; i < in.size(); ++i) {
-        if (in[i] == '%' && i + 2 < in.size()) {
-          char hex[3] = {in[i + 1], in[i + 2], 0};
-          int v = std::strtol(hex, nullptr, 16);
-          out.push_back(static_cast<char>(v));
-          i += 2;
-        } else if (in[i] == '+') {
-          out.push_back(' ');
-        } else {
-          out.push_back(in[i]);
-        }
-      }
-      return out;
-    };
-    std::string q, limit_s, offset_s;
-    std::istringstream qss(qs);
-    std::string kv;
-    while (std::getline(qss, kv, '&')) {
-      size_t eq = kv.find('=');
-      if (eq == std::string::npos)
-        continue;
-      std::string k = kv.substr(0, eq);
-      std::string v = decode(kv.substr(eq + 1));
-      if (k == "q")
-        q = v;
-      else if (k == "limit")
-        limit_s = v;
-      else if (k == "offset")
-        offset_s = v;
-    }
-    if (q.empty()) {
-      return "HTTP/1.1 400 Bad Request\r\nContent-Type: "
-             "application/json\r\n\r\n{\"error\":\"missing q\"}";
+    epiphany::qrs::SearchRequest search;
+    std::string error;
+    if (!ParseSearchRequest(path, &search, &error)) {
+      return JsonResponse(400, "{\"error\":\"" + error + "\"}");
     }
-    int limit = 10, offset = 0;
-    try {
-      if (!limit_s.empty())
-        limit = std::stoi(limit_s);
-      if (!offset_s.empty())
-        offset = std::stoi(offset_s);
-    } catch (...) {
-      return "HTTP/1.1 400 Bad Request\r\nContent-Type: "
-             "application/json\r\n\r\n{\"error\":\"invalid limit or offset\"}";
-    }
-    std::string json = qrs_->Search(q, limit, offset);
-    return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" + json;
+    search.deadline_ns = deadline_ns;
+    route.End();
+    std::string json = qrs_->Search(search);
+    if (deadline_ns != 0 && NowNs() >= deadline_ns)
+      return TimeoutResponse();
+    return JsonResponse(200, std::move(json));
   }
 
-  if (path.find("..") != std::string::npos) {
-    epiphany::observability::Metrics::errors.fetch_add(1);
-    return "HTTP/1.1 400 Bad Request\r\nContent-Type: "
-           "application/json\r\n\r\n{\"error\":\"invalid path\"}";
-  }
-  std::string content = ReadFile(web_root_ + path);
-  if (!content.empty()) {
-    return "HTTP/1.1 200 OK\r\nContent-Type: " + GetMimeType(path) +
-           "\r\n\r\n" + content;
+  HttpResponse response;
+  if (static_files_.Serve(path, request, &response)) {
+    *endpoint = Endpoint::kStatic;
+    epiphany::observability::Metrics::static_files.fetch_add(1);
+    if (response.status == 304)
+      epiphany::observability::Metrics::static_not_modified.fetch_add(1);
+    return response;
   }
 
-  return "HTTP/1.1 404 Not Found\r\nContent-Type: "
-         "application/json\r\n\r\n{\"error\":\"not found\"}";
+  return JsonResponse(404, "{\"error\":\"not found\"}");
 }
 
-std::string HttpServer::ReadFile(const std::string &path) {
-  std::ifstream f(path);
-  if (f.good()) {
-    std::stringstream buffer;
-    buffer << f.rdbuf();
-    return buffer.str();
+// POST /api/items:bulk?batch=N&fast=1 with one item object per line (see
+// ParseItemJson). The whole body is validated before anything is written:
+// a line with an id that is not a positive int64 fails the request rather
+// than landing on a rounded id or a fresh row.
+HttpResponse HttpServer::BulkInsert(const HttpRequest &request) {
+  epiphany::observability::Metrics::api_bulk.fetch_add(1);
+  auto start = std::chrono::steady_clock::now();
+  epiphany::database::Database::BulkOptions options;
+  size_t qm = request.target.find('?');
+  std::istringstream qss(qm != std::string::npos
+                             ? request.target.substr(qm + 1)
+                             : std::string());
+  std::string kv;
+  while (std::getline(qss, kv, '&')) {
+    if (kv.rfind("batch=", 0) == 0) {
+      try {
+        options.batch_size = std::stoul(kv.substr(6));
+      } catch (...) {
+        return JsonResponse(400, "{\"error\":\"invalid batch\"}");
+      }
+    } else if (kv == "fast=1") {
+      options.fast = true;
+    }
+  }
+
+  std::vector<epiphany::database::Database::Item> items;
+  size_t line_no = 0;
+  size_t pos = 0;
+  while (pos < request.body.size()) {
+    size_t newline = request.body.find('\n', pos);
+    if (newline == std::string::npos)
+      newline = request.body.size();
+    std::string_view line(request.body.data() + pos, newline - pos);
+    pos = newline + 1;
+    ++line_no;
+    if (line.find_first_not_of(" \t\r") == std::string_view::npos)
+      continue;
+    epiphany::database::Database::Item item;
+    if (!epiphany::database::ParseItemJson(line, &item) || item.id < 0) {
+      epiphany::observability::Metrics::errors.fetch_add(1);
+      return JsonResponse(400, "{\"error\":\"invalid item on line " +
+                                   std::to_string(line_no) + "\"}");
+    }
+    items.push_back(std::move(item));
   }
-  return "";
-}
 
-std::string HttpServer::GetMimeType(const std::string &path) {
-  if (path.find(".html") != std::string::npos)
-    return "text/html";
-  if (path.find(".css") != std::string::npos)
-    return "text/css";
-  if (path.find(".js") != std::string::npos)
-    return "application/javascript";
-  return "text/plain";
+  epiphany::database::Database::BulkResult result;
+  bool ok = db_->BulkInsert(items, options, &result);
+  epiphany::observability::Metrics::bulk_rows.fetch_add(
+      static_cast<long>(result.inserted));
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+  std::ostringstream json;
+  json << "{\"inserted\":" << result.inserted
+       << ",\"skipped\":" << result.skipped << ",\"elapsed_ms\":" << ms;
+  if (!ok) {
+    epiphany::observability::Metrics::errors.fetch_add(1);
+    json << ",\"error\":\"bulk insert failed\"}";
+    return JsonResponse(500, json.str());
+  }
+  json << "}";
+  return JsonResponse(200, json.str());
 }
 
 } // namespace server
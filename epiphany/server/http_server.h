@@ -1,30 +1,84 @@
 #pragma once
 #include "epiphany/database/database.h"
+#include "epiphany/observability/metrics.h"
+#include "epiphany/observability/trace.h"
 #include "epiphany/qrs/qrs.h"
+#include "epiphany/server/admission_controller.h"
+#include "epiphany/server/event_loop.h"
+#include "epiphany/server/http_parser.h"
+#include "epiphany/server/static_files.h"
+#include "epiphany/server/thread_pool.h"
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace epiphany {
 namespace server {
 
+struct ServerOptions {
+  // Number of epoll I/O threads; 0 means one per core.
+  int io_threads{0};
+  // Number of threads running ProcessRequest; 0 means one per core.
+  int worker_threads{0};
+  int backlog{1024};
+  // Give every I/O thread its own SO_REUSEPORT listening socket instead of
+  // sharing one, letting the kernel spread accepts across cores.
+  bool reuse_port{false};
+  // Keep-alive connections idle for this long are closed; 0 disables.
+  int idle_timeout_ms{30000};
+  size_t max_body_bytes{8 << 20};
+  AdmissionOptions admission;
+  // Deadline of requests that set none with deadline_ms or
+  // X-Request-Timeout, counted from their first byte; 0 for none.
+  int default_deadline_ms{0};
+  StaticFiles::Options static_files;
+  epiphany::qrs::QRSOptions qrs;
+};
+
 class HttpServer {
 public:
   HttpServer(int port, std::shared_ptr<epiphany::database::Database> db,
-             const std::string &web_root);
+             const std::string &web_root,
+             const ServerOptions &options = ServerOptions());
   void Start();
 
 private:
-  void HandleClient(int client_socket, const std::string &client_ip,
-                    int client_port);
-  std::string ProcessRequest(const std::string &request,
-                             const std::string &client_ip, int client_port);
-  std::string GetMimeType(const std::string &path);
-  std::string ReadFile(const std::string &path);
+  void OnReadable(const std::shared_ptr<Connection> &conn);
+  // Attaches a trace holding the accept, read and parse spans to a request
+  // that has just been parsed.
+  void StartTrace(const std::shared_ptr<Connection> &conn,
+                  HttpRequest *request, int64_t parsed_ns);
+  // Starts the connection's next request, or refuses it with 503 when
+  // admission control is full.
+  void Dispatch(const std::shared_ptr<Connection> &conn);
+  // Returns whether the request ran out of its deadline.
+  bool HandleRequest(const std::shared_ptr<Connection> &conn,
+                     const HttpRequest &request);
+  HttpResponse BulkInsert(const HttpRequest &request);
+  // Sets *endpoint to the latency histogram the request belongs to.
+  // Searches are cut short at deadline_ns (observability::NowNs, 0 for
+  // none) and answered with 504.
+  HttpResponse ProcessRequest(const HttpRequest &request,
+                              const std::string &client_ip, int client_port,
+                              int64_t deadline_ns,
+                              epiphany::observability::Endpoint *endpoint);
+  // Hands a finished response to the connection's loop, which finishes the
+  // trace once the response is written or queued.
+  void Respond(const std::shared_ptr<Connection> &conn, HttpResponse response,
+               bool keep_alive,
+               std::shared_ptr<epiphany::observability::Trace> trace);
 
   int port_;
+  std::shared_ptr<epiphany::database::Database> db_;
   std::shared_ptr<epiphany::qrs::QRS> qrs_;
   std::string web_root_;
+  ServerOptions options_;
+  StaticFiles static_files_;
+  // Declared before workers_ so it outlives the tasks the pool drains.
+  std::unique_ptr<AdmissionController> admission_;
+  std::unique_ptr<ThreadPool> workers_;
+  std::vector<std::unique_ptr<EventLoop>> loops_;
 };
 
 } // namespace server
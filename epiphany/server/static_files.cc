@@ -0,0 +1,278 @@
+#include "epiphany/server/static_files.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+namespace epiphany {
+namespace server {
+
+namespace {
+
+constexpr uint64_t kFnvOffset = 1469598103934665603ULL;
+constexpr uint64_t kFnvPrime = 1099511628211ULL;
+
+uint64_t Fnv1a(uint64_t hash, const char *data, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+
+std::string MakeETag(size_t length, uint64_t hash) {
+  char buf[48];
+  std::snprintf(buf, sizeof(buf), "\"%zx-%016llx\"", length,
+                static_cast<unsigned long long>(hash));
+  return buf;
+}
+
+bool EndsWith(const std::string &s, const char *suffix) {
+  size_t n = std::strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+bool Compressible(const std::string &content_type) {
+  return content_type.rfind("text/", 0) == 0 ||
+         content_type == "application/javascript" ||
+         content_type == "application/json" ||
+         content_type == "image/svg+xml";
+}
+
+// gzip-framed deflate of in, or false if zlib fails.
+bool Gzip(const std::string &in, std::string *out) {
+  z_stream zs{};
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  out->resize(deflateBound(&zs, in.size()) + 32);
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+  zs.avail_in = static_cast<uInt>(in.size());
+  zs.next_out = reinterpret_cast<Bytef *>(&(*out)[0]);
+  zs.avail_out = static_cast<uInt>(out->size());
+  int rc = deflate(&zs, Z_FINISH);
+  out->resize(zs.total_out);
+  deflateEnd(&zs);
+  return rc == Z_STREAM_END;
+}
+
+// Trims spaces and tabs from both ends of s[begin, end).
+std::string Trim(const std::string &s, size_t begin, size_t end) {
+  while (begin < end && (s[begin] == ' ' || s[begin] == '\t'))
+    ++begin;
+  while (end > begin && (s[end - 1] == ' ' || s[end - 1] == '\t'))
+    --end;
+  return s.substr(begin, end - begin);
+}
+
+// True if an Accept-Encoding value allows gzip, i.e. names gzip (or "*")
+// without q=0.
+bool AcceptsGzip(const std::string &header) {
+  size_t pos = 0;
+  while (pos <= header.size()) {
+    size_t comma = header.find(',', pos);
+    if (comma == std::string::npos)
+      comma = header.size();
+    std::string item = Trim(header, pos, comma);
+    pos = comma + 1;
+    size_t semi = item.find(';');
+    std::string coding = Trim(item, 0, std::min(semi, item.size()));
+    if (coding != "gzip" && coding != "x-gzip" && coding != "*")
+      continue;
+    if (semi == std::string::npos)
+      return true;
+    std::string param = Trim(item, semi + 1, item.size());
+    if (param.rfind("q=", 0) != 0)
+      return true;
+    return std::strtod(param.c_str() + 2, nullptr) > 0;
+  }
+  return false;
+}
+
+// True if an If-None-Match value lists etag, comparing weakly as RFC 7232
+// asks for this header.
+bool MatchesETag(const std::string &header, const std::string &etag) {
+  size_t pos = 0;
+  while (pos <= header.size()) {
+    size_t comma = header.find(',', pos);
+    if (comma == std::string::npos)
+      comma = header.size();
+    std::string tag = Trim(header, pos, comma);
+    pos = comma + 1;
+    if (tag.rfind("W/", 0) == 0)
+      tag.erase(0, 2);
+    if (tag == "*" || tag == etag)
+      return true;
+  }
+  return false;
+}
+
+} // namespace
+
+std::string MimeType(const std::string &path) {
+  static const std::pair<const char *, const char *> kTypes[] = {
+      {".html", "text/html"},
+      {".css", "text/css"},
+      {".js", "application/javascript"},
+      {".json", "application/json"},
+      {".svg", "image/svg+xml"},
+      {".png", "image/png"},
+      {".jpg", "image/jpeg"},
+      {".jpeg", "image/jpeg"},
+      {".gif", "image/gif"},
+      {".ico", "image/x-icon"},
+      {".webp", "image/webp"},
+      {".woff2", "font/woff2"},
+      {".gz", "application/gzip"},
+  };
+  for (const auto &type : kTypes) {
+    if (EndsWith(path, type.first))
+      return type.second;
+  }
+  return "text/plain";
+}
+
+StaticFiles::~StaticFiles() {
+  for (const auto &entry : files_) {
+    if (entry.second.identity.fd >= 0)
+      close(entry.second.identity.fd);
+    if (entry.second.gzip.fd >= 0)
+      close(entry.second.gzip.fd);
+  }
+}
+
+bool StaticFiles::LoadVariant(const std::string &path,
+                              size_t max_cached_bytes, Variant *v) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    std::cerr << "Cannot read " << path << ": " << std::strerror(errno)
+              << std::endl;
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  size_t length = static_cast<size_t>(st.st_size);
+  bool cached = length <= max_cached_bytes;
+  std::string bytes;
+  if (cached)
+    bytes.reserve(length);
+  uint64_t hash = kFnvOffset;
+  size_t total = 0;
+  char buf[65536];
+  ssize_t n;
+  while ((n = pread(fd, buf, sizeof(buf), static_cast<off_t>(total))) > 0) {
+    hash = Fnv1a(hash, buf, static_cast<size_t>(n));
+    if (cached)
+      bytes.append(buf, static_cast<size_t>(n));
+    total += static_cast<size_t>(n);
+  }
+  if (n < 0 || total != length) {
+    std::cerr << "Short read of " << path << std::endl;
+    close(fd);
+    return false;
+  }
+  v->etag = MakeETag(length, hash);
+  v->length = length;
+  if (cached) {
+    v->bytes = std::make_shared<const std::string>(std::move(bytes));
+    close(fd);
+  } else {
+    v->fd = fd;
+  }
+  return true;
+}
+
+bool StaticFiles::Load(const std::string &root, const Options &options) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  std::vector<std::string> names;
+  for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (it->is_regular_file(ec))
+      names.push_back("/" + it->path().lexically_relative(root).generic_string());
+  }
+  if (ec) {
+    std::cerr << "Cannot read web root " << root << ": " << ec.message()
+              << std::endl;
+    return false;
+  }
+
+  for (const auto &name : names) {
+    if (EndsWith(name, ".gz") &&
+        fs::is_regular_file(root + name.substr(0, name.size() - 3), ec))
+      continue; // Loaded below as the gzip variant of its base file.
+    File file;
+    file.content_type = MimeType(name);
+    if (file.content_type == "text/html")
+      file.cache_control = "no-cache";
+    else
+      file.cache_control = "public, max-age=" + std::to_string(options.max_age_s);
+    if (!LoadVariant(root + name, options.max_cached_bytes, &file.identity))
+      continue;
+
+    if (fs::is_regular_file(root + name + ".gz", ec)) {
+      file.has_gzip =
+          LoadVariant(root + name + ".gz", options.max_cached_bytes, &file.gzip);
+    } else if (file.identity.bytes && Compressible(file.content_type)) {
+      auto gz = std::make_shared<std::string>();
+      if (Gzip(*file.identity.bytes, gz.get()) &&
+          gz->size() < file.identity.length) {
+        file.gzip.length = gz->size();
+        file.gzip.bytes = std::move(gz);
+        file.has_gzip = true;
+      }
+    }
+    if (file.has_gzip) {
+      // A distinct tag per encoding, so caches never confuse the two.
+      file.gzip.etag = file.identity.etag;
+      file.gzip.etag.insert(file.gzip.etag.size() - 1, "-gz");
+    }
+    files_.emplace(name, std::move(file));
+  }
+  return true;
+}
+
+bool StaticFiles::Serve(const std::string &path, const HttpRequest &request,
+                        HttpResponse *response) const {
+  std::string name = path.substr(0, path.find_first_of("?#"));
+  if (!name.empty() && name.back() == '/')
+    name += "index.html";
+  auto it = files_.find(name);
+  if (it == files_.end())
+    return false;
+  const File &file = it->second;
+  bool gzip = file.has_gzip && AcceptsGzip(request.Header("Accept-Encoding"));
+  const Variant &v = gzip ? file.gzip : file.identity;
+
+  response->status = 200;
+  response->content_type = file.content_type;
+  response->headers.emplace_back("ETag", v.etag);
+  response->headers.emplace_back("Cache-Control", file.cache_control);
+  if (file.has_gzip)
+    response->headers.emplace_back("Vary", "Accept-Encoding");
+  const std::string &if_none_match = request.Header("If-None-Match");
+  if (!if_none_match.empty() && MatchesETag(if_none_match, v.etag)) {
+    response->status = 304;
+    return true;
+  }
+  if (gzip)
+    response->headers.emplace_back("Content-Encoding", "gzip");
+  if (v.bytes) {
+    response->shared_body = v.bytes;
+  } else {
+    response->file_fd = v.fd;
+    response->file_length = v.length;
+  }
+  return true;
+}
+
+} // namespace server
+} // namespace epiphany
@@ -0,0 +1,69 @@
+#pragma once
+#include "epiphany/server/http_parser.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace epiphany {
+namespace server {
+
+// The web root, loaded once at startup. Small files are held in memory and
+// shared with responses by reference; larger ones stay open and go out with
+// sendfile. Every file gets a strong ETag from its contents, and a gzip
+// variant taken from a "<name>.gz" sibling on disk or, for in-memory files,
+// compressed at load time when that saves space. Files added or changed
+// after startup are not picked up.
+class StaticFiles {
+public:
+  struct Options {
+    // Files up to this size are cached in memory.
+    size_t max_cached_bytes{256 << 10};
+    // Cache-Control max-age for everything but HTML. HTML is "no-cache",
+    // so a new deploy shows up at once and a revalidation costs one 304.
+    int max_age_s{3600};
+  };
+
+  StaticFiles() = default;
+  ~StaticFiles();
+  StaticFiles(const StaticFiles &) = delete;
+  StaticFiles &operator=(const StaticFiles &) = delete;
+
+  // Loads every regular file under root; false if root cannot be read.
+  bool Load(const std::string &root, const Options &options);
+
+  // Fills *response for path ("/style.css"; any query string is ignored),
+  // honouring If-None-Match and Accept-Encoding. False if there is no such
+  // file.
+  bool Serve(const std::string &path, const HttpRequest &request,
+             HttpResponse *response) const;
+
+  size_t size() const { return files_.size(); }
+
+private:
+  struct Variant {
+    std::string etag;
+    std::shared_ptr<const std::string> bytes;
+    int fd{-1};
+    size_t length{0};
+  };
+  struct File {
+    std::string content_type;
+    std::string cache_control;
+    Variant identity;
+    Variant gzip;
+    bool has_gzip{false};
+  };
+
+  // Opens path as v, reading it into memory when small enough.
+  bool LoadVariant(const std::string &path, size_t max_cached_bytes,
+                   Variant *v);
+
+  std::unordered_map<std::string, File> files_;
+};
+
+// Content-Type for a file name, by extension.
+std::string MimeType(const std::string &path);
+
+} // namespace server
+} // namespace epiphany
@@ -0,0 +1,333 @@
+#include "epiphany/suggest/completion_trie.h"
+#include "epiphany/index/utf8.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace epiphany {
+namespace suggest {
+
+namespace {
+
+char Fold(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+// Orders text, folded on the fly, against an already folded key.
+int CompareFolded(std::string_view text, std::string_view key) {
+  size_t n = std::min(text.size(), key.size());
+  for (size_t i = 0; i < n; ++i) {
+    auto a = static_cast<unsigned char>(Fold(text[i]));
+    auto b = static_cast<unsigned char>(key[i]);
+    if (a != b)
+      return a < b ? -1 : 1;
+  }
+  if (text.size() == key.size())
+    return 0;
+  return text.size() < key.size() ? -1 : 1;
+}
+
+// Bytes of the UTF-8 sequence at s[pos], clipped to the end of s.
+size_t SequenceAt(std::string_view s, size_t pos) {
+  return std::min(index::SequenceLength(s[pos]), s.size() - pos);
+}
+
+uint32_t SaturatingAdd(uint32_t a, uint64_t b) {
+  return static_cast<uint32_t>(
+      std::min<uint64_t>(a + b, std::numeric_limits<uint32_t>::max()));
+}
+
+} // namespace
+
+CompletionTrie::CompletionTrie(std::vector<Entry> entries) {
+  std::vector<std::pair<std::string, uint32_t>> order;
+  order.reserve(entries.size());
+  for (uint32_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].text.empty())
+      continue;
+    std::string key = entries[i].text;
+    std::transform(key.begin(), key.end(), key.begin(), Fold);
+    order.emplace_back(std::move(key), i);
+  }
+  // Equal keys end up adjacent, the heaviest spelling first.
+  std::sort(order.begin(), order.end(), [&](const auto &a, const auto &b) {
+    if (a.first != b.first)
+      return a.first < b.first;
+    return entries[a.second].weight > entries[b.second].weight;
+  });
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < order.size();) {
+    const Entry &kept = entries[order[i].second];
+    uint32_t weight = 0;
+    size_t j = i;
+    for (; j < order.size() && order[j].first == order[i].first; ++j)
+      weight = SaturatingAdd(weight, entries[order[j].second].weight);
+    entries_.push_back(StoredEntry{static_cast<uint32_t>(texts_.size()),
+                                   static_cast<uint32_t>(kept.text.size()),
+                                   weight});
+    texts_ += kept.text;
+    keys.push_back(std::move(order[i].first));
+    i = j;
+  }
+  nodes_.push_back(Node{});
+  Scratch scratch;
+  Build(0, keys, 0, keys.size(), 0, &scratch);
+}
+
+void CompletionTrie::Build(uint32_t node, const std::vector<std::string> &keys,
+                           size_t lo, size_t hi, size_t depth,
+                           Scratch *scratch) {
+  size_t top_begin = scratch->tops.size();
+  size_t i = lo;
+  if (i < hi && keys[i].size() == depth) {
+    nodes_[node].entry = static_cast<uint32_t>(i);
+    scratch->tops.push_back(static_cast<uint32_t>(i++));
+  }
+  // Keys are sorted, so those sharing the sequence at depth are adjacent.
+  // Each run becomes a child whose edge runs to the last sequence boundary
+  // its first and last key share.
+  size_t group_begin = scratch->groups.size();
+  while (i < hi) {
+    const std::string &first = keys[i];
+    size_t n = SequenceAt(first, depth);
+    size_t j = i + 1;
+    while (j < hi && keys[j].compare(depth, n, first, depth, n) == 0)
+      ++j;
+    const std::string &last = keys[j - 1];
+    size_t end = depth + n;
+    while (end < first.size() && end < last.size()) {
+      size_t m = SequenceAt(first, end);
+      if (end + m > last.size() || first.compare(end, m, last, end, m) != 0)
+        break;
+      end += m;
+    }
+    scratch->groups.push_back(Group{i, j, end});
+    i = j;
+  }
+  auto child_count =
+      static_cast<uint32_t>(scratch->groups.size() - group_begin);
+  auto first_child = static_cast<uint32_t>(nodes_.size());
+  nodes_.resize(nodes_.size() + child_count);
+  nodes_[node].first_child = first_child;
+  nodes_[node].child_count = child_count;
+  nodes_[node].child_capacity = child_count;
+  for (uint32_t k = 0; k < child_count; ++k) {
+    Group group = scratch->groups[group_begin + k];
+    uint32_t child = first_child + k;
+    nodes_[child].label = static_cast<uint32_t>(labels_.size());
+    nodes_[child].label_length = static_cast<uint32_t>(group.depth - depth);
+    labels_.append(keys[group.lo], depth, group.depth - depth);
+    Build(child, keys, group.lo, group.hi, group.depth, scratch);
+    const Node &built = nodes_[child];
+    scratch->tops.insert(scratch->tops.end(), tops_.begin() + built.top,
+                         tops_.begin() + built.top + built.top_count);
+  }
+  scratch->groups.resize(group_begin);
+
+  auto begin = scratch->tops.begin() + static_cast<ptrdiff_t>(top_begin);
+  size_t keep = std::min(scratch->tops.size() - top_begin, kTopK);
+  std::partial_sort(begin, begin + static_cast<ptrdiff_t>(keep),
+                    scratch->tops.end(),
+                    [this](uint32_t a, uint32_t b) { return Heavier(a, b); });
+  nodes_[node].top = static_cast<uint32_t>(tops_.size());
+  nodes_[node].top_count = static_cast<uint16_t>(keep);
+  nodes_[node].top_capacity = static_cast<uint16_t>(keep);
+  tops_.insert(tops_.end(), begin, begin + static_cast<ptrdiff_t>(keep));
+  scratch->tops.resize(top_begin);
+}
+
+uint32_t CompletionTrie::FindChild(uint32_t node,
+                                   std::string_view sequence) const {
+  uint32_t lo = nodes_[node].first_child;
+  uint32_t hi = lo + nodes_[node].child_count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    int cmp =
+        CompareFolded(sequence, Label(nodes_[mid]).substr(0, sequence.size()));
+    if (cmp == 0)
+      return mid;
+    if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return 0;
+}
+
+void CompletionTrie::Add(std::string_view text, uint32_t weight) {
+  if (text.empty())
+    return;
+  std::string key(text);
+  std::transform(key.begin(), key.end(), key.begin(), Fold);
+  std::vector<uint32_t> path = {0};
+  uint32_t node = 0;
+  size_t pos = 0;
+  while (pos < key.size()) {
+    std::string_view sequence =
+        std::string_view(key).substr(pos, SequenceAt(key, pos));
+    uint32_t child = FindChild(node, sequence);
+    if (child == 0) {
+      node = AddLeaf(node, key, pos);
+      path.push_back(node);
+      break;
+    }
+    std::string_view label = Label(nodes_[child]);
+    size_t matched = 0;
+    while (matched < label.size() && pos + matched < key.size()) {
+      size_t m = SequenceAt(key, pos + matched);
+      if (matched + m > label.size() ||
+          key.compare(pos + matched, m, label.data() + matched, m) != 0)
+        break;
+      matched += m;
+    }
+    if (matched < label.size())
+      Split(child, static_cast<uint32_t>(matched));
+    pos += matched;
+    node = child;
+    path.push_back(node);
+  }
+
+  uint32_t entry = nodes_[node].entry;
+  if (entry == kNoEntry) {
+    entry = static_cast<uint32_t>(entries_.size());
+    entries_.push_back(StoredEntry{static_cast<uint32_t>(texts_.size()),
+                                   static_cast<uint32_t>(text.size()), 0});
+    texts_.append(text.data(), text.size());
+    nodes_[node].entry = entry;
+  }
+  entries_[entry].weight = SaturatingAdd(entries_[entry].weight, weight);
+  for (uint32_t on_path : path)
+    Promote(on_path, entry);
+}
+
+uint32_t CompletionTrie::AddLeaf(uint32_t node, std::string_view key,
+                                 size_t pos) {
+  Node leaf;
+  leaf.label = static_cast<uint32_t>(labels_.size());
+  leaf.label_length = static_cast<uint32_t>(key.size() - pos);
+  labels_.append(key.data() + pos, key.size() - pos);
+
+  uint32_t count = nodes_[node].child_count;
+  if (count == nodes_[node].child_capacity) {
+    uint32_t capacity = std::max<uint32_t>(1, 2 * count);
+    auto moved = static_cast<uint32_t>(nodes_.size());
+    nodes_.resize(nodes_.size() + capacity);
+    uint32_t first = nodes_[node].first_child;
+    std::copy(nodes_.begin() + first, nodes_.begin() + first + count,
+              nodes_.begin() + moved);
+    nodes_[node].first_child = moved;
+    nodes_[node].child_capacity = capacity;
+  }
+  uint32_t first = nodes_[node].first_child;
+  uint32_t at = first;
+  uint32_t end = first + count;
+  std::string_view rest = Label(leaf);
+  while (at < end) {
+    uint32_t mid = at + (end - at) / 2;
+    if (Label(nodes_[mid]) < rest)
+      at = mid + 1;
+    else
+      end = mid;
+  }
+  std::copy_backward(nodes_.begin() + at, nodes_.begin() + first + count,
+                     nodes_.begin() + first + count + 1);
+  nodes_[at] = leaf;
+  ++nodes_[node].child_count;
+  return at;
+}
+
+void CompletionTrie::Split(uint32_t child, uint32_t length) {
+  Node tail = nodes_[child];
+  tail.label += length;
+  tail.label_length -= length;
+  // Both ends cover the same entries; the tail gets its own copy of the
+  // list so they can diverge.
+  uint32_t list[kTopK];
+  std::copy(tops_.begin() + tail.top, tops_.begin() + tail.top + tail.top_count,
+            list);
+  tail.top = static_cast<uint32_t>(tops_.size());
+  tail.top_capacity = tail.top_count;
+  tops_.insert(tops_.end(), list, list + tail.top_count);
+  auto moved = static_cast<uint32_t>(nodes_.size());
+  nodes_.push_back(tail);
+
+  Node &head = nodes_[child];
+  head.label_length = length;
+  head.first_child = moved;
+  head.child_count = 1;
+  head.child_capacity = 1;
+  head.entry = kNoEntry;
+}
+
+void CompletionTrie::Promote(uint32_t node, uint32_t entry) {
+  Node &n = nodes_[node];
+  uint32_t i = 0;
+  while (i < n.top_count && tops_[n.top + i] != entry)
+    ++i;
+  if (i == n.top_count) {
+    if (n.top_count < kTopK) {
+      if (n.top_count == n.top_capacity) {
+        auto capacity = static_cast<uint16_t>(
+            std::min<size_t>(kTopK, std::max(1, 2 * n.top_count)));
+        auto moved = static_cast<uint32_t>(tops_.size());
+        tops_.resize(tops_.size() + capacity);
+        std::copy(tops_.begin() + n.top, tops_.begin() + n.top + n.top_count,
+                  tops_.begin() + moved);
+        n.top = moved;
+        n.top_capacity = capacity;
+      }
+      ++n.top_count;
+    } else if (!Heavier(entry, tops_[n.top + i - 1])) {
+      return;
+    } else {
+      --i;
+    }
+    tops_[n.top + i] = entry;
+  }
+  for (; i > 0 && Heavier(tops_[n.top + i], tops_[n.top + i - 1]); --i)
+    std::swap(tops_[n.top + i], tops_[n.top + i - 1]);
+}
+
+size_t CompletionTrie::Complete(std::string_view prefix, Completion *out,
+                                size_t limit) const {
+  // A prefix cut inside a UTF-8 sequence completes as if the sequence had
+  // not been started.
+  prefix = prefix.substr(0, index::WholeSequencesLength(prefix));
+
+  uint32_t node = 0;
+  size_t pos = 0;
+  while (pos < prefix.size()) {
+    std::string_view sequence =
+        prefix.substr(pos, index::SequenceLength(prefix[pos]));
+    uint32_t child = FindChild(node, sequence);
+    if (child == 0)
+      return 0;
+    std::string_view label = Label(nodes_[child]);
+    size_t m = std::min(label.size(), prefix.size() - pos);
+    for (size_t k = sequence.size(); k < m; ++k) {
+      if (Fold(prefix[pos + k]) != label[k])
+        return 0;
+    }
+    pos += m;
+    node = child;
+  }
+
+  const Node &found = nodes_[node];
+  size_t count = std::min<size_t>(std::min(limit, kTopK), found.top_count);
+  for (size_t i = 0; i < count; ++i) {
+    const StoredEntry &entry = entries_[tops_[found.top + i]];
+    out[i] = Completion{
+        std::string_view(texts_).substr(entry.text, entry.text_length),
+        entry.weight};
+  }
+  return count;
+}
+
+size_t CompletionTrie::bytes() const {
+  return nodes_.capacity() * sizeof(Node) + labels_.capacity() +
+         tops_.capacity() * sizeof(uint32_t) +
+         entries_.capacity() * sizeof(StoredEntry) + texts_.capacity();
+}
+
+} // namespace suggest
+} // namespace epiphany
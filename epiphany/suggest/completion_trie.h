@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace epiphany {
+namespace suggest {
+
+// A radix trie from completion keys to their heaviest completions. Keys
+// are the entry texts with ASCII folded to lower case; edges are split only
+// between UTF-8 sequences, so the children of a node differ in their first
+// code point and a lookup picks one by binary search. Every node caches the
+// kTopK heaviest entries below it, so completing a prefix walks one node
+// per edge and reads the answer off the last one.
+//
+// Nodes, edge labels, cached lists and texts each live in one flat array.
+// Add grows the trie in place: a node's children and its cached list sit in
+// blocks that move to the end of their array, doubled, when they fill up,
+// so the space they leave behind stays bounded by what is in use.
+//
+// Not thread-safe; readers and Add need outside locking.
+class CompletionTrie {
+public:
+  // Completions cached per node, hence the most a lookup returns.
+  static constexpr size_t kTopK = 10;
+
+  struct Entry {
+    std::string text;
+    uint32_t weight{0};
+  };
+  struct Completion {
+    std::string_view text;
+    uint32_t weight;
+  };
+
+  CompletionTrie() : CompletionTrie(std::vector<Entry>()) {}
+  // Entries whose texts fold to the same key are merged: weights add up
+  // and the text of the heavier one is kept.
+  explicit CompletionTrie(std::vector<Entry> entries);
+
+  // Adds weight to the entry whose text folds like text, creating it with
+  // this text if there is none, and updates the lists cached along its
+  // path. Weights only ever grow this way; lowering one takes a new trie.
+  void Add(std::string_view text, uint32_t weight);
+
+  // Stores the heaviest completions of prefix, at most limit and kTopK,
+  // heaviest first, and returns how many. Equal weights come in key order
+  // among entries the trie was built with, and after them in the order Add
+  // created them. An empty prefix completes to the heaviest entries
+  // overall. The texts point into the trie until it next changes.
+  // Allocates nothing.
+  size_t Complete(std::string_view prefix, Completion *out,
+                  size_t limit) const;
+
+  size_t size() const { return entries_.size(); }
+  size_t node_count() const { return nodes_.size(); }
+  // Heap bytes held by the flat arrays.
+  size_t bytes() const;
+
+private:
+  static constexpr uint32_t kNoEntry = UINT32_MAX;
+
+  struct Node {
+    // Edge label from the parent, in labels_.
+    uint32_t label{0};
+    uint32_t label_length{0};
+    // Children are contiguous in nodes_, in label order.
+    uint32_t first_child{0};
+    uint32_t child_count{0};
+    uint32_t child_capacity{0};
+    // Entry indices in tops_, heaviest first.
+    uint32_t top{0};
+    uint16_t top_count{0};
+    uint16_t top_capacity{0};
+    // The entry whose key ends here, or kNoEntry.
+    uint32_t entry{kNoEntry};
+  };
+  struct StoredEntry {
+    uint32_t text;
+    uint32_t text_length;
+    uint32_t weight;
+  };
+  struct Group {
+    size_t lo;
+    size_t hi;
+    size_t depth;
+  };
+  // Reused by every level of Build so it allocates per trie, not per node.
+  struct Scratch {
+    std::vector<uint32_t> tops;
+    std::vector<Group> groups;
+  };
+
+  // Fills in node, whose keys are keys[lo, hi) and share their first depth
+  // bytes, and everything below it.
+  void Build(uint32_t node, const std::vector<std::string> &keys, size_t lo,
+             size_t hi, size_t depth, Scratch *scratch);
+  // The child of node whose label starts with sequence, or 0.
+  uint32_t FindChild(uint32_t node, std::string_view sequence) const;
+  // Inserts a leaf for key[pos..] under node and returns it.
+  uint32_t AddLeaf(uint32_t node, std::string_view key, size_t pos);
+  // Cuts child's label after length bytes, moving the rest into a new
+  // only child.
+  void Split(uint32_t child, uint32_t length);
+  // Puts entry, which just got heavier, in its place in node's list.
+  void Promote(uint32_t node, uint32_t entry);
+  bool Heavier(uint32_t a, uint32_t b) const {
+    if (entries_[a].weight != entries_[b].weight)
+      return entries_[a].weight > entries_[b].weight;
+    return a < b;
+  }
+  std::string_view Label(const Node &node) const {
+    return std::string_view(labels_).substr(node.label, node.label_length);
+  }
+
+  std::vector<Node> nodes_;
+  std::string labels_;
+  std::vector<uint32_t> tops_;
+  std::vector<StoredEntry> entries_;
+  std::string texts_;
+};
+
+} // namespace suggest
+} // namespace epiphany
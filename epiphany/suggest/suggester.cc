@@ -0,0 +1,143 @@
+#include "epiphany/suggest/suggester.h"
+#include "epiphany/database/json_writer.h"
+#include "epiphany/index/utf8.h"
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+namespace epiphany {
+namespace suggest {
+
+namespace {
+
+std::string Folded(std::string_view text) {
+  std::string key(text);
+  for (char &c : key) {
+    if (c >= 'A' && c <= 'Z')
+      c = static_cast<char>(c + ('a' - 'A'));
+  }
+  return key;
+}
+
+// ASCII letters and anything beyond ASCII, e.g. CJK category names.
+bool HasLetter(std::string_view word) {
+  return std::any_of(word.begin(), word.end(), [](char c) {
+    auto u = static_cast<unsigned char>(c);
+    return u >= 0x80 || (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z');
+  });
+}
+
+} // namespace
+
+Suggester::Suggester(std::shared_ptr<database::Database> db)
+    : db_(std::move(db)) {}
+
+std::string Suggester::SuggestJson(std::string_view prefix, int limit) {
+  auto start = std::chrono::high_resolution_clock::now();
+  // Echoed as completed, without a cut-off trailing sequence.
+  prefix = prefix.substr(0, index::WholeSequencesLength(prefix));
+  size_t n = static_cast<size_t>(
+      std::clamp<int>(limit, 1, static_cast<int>(CompletionTrie::kTopK)));
+  CatchUp();
+
+  std::string json;
+  database::JsonWriter out(&json);
+  out.Raw("{\"prefix\":").String(prefix).Raw(",\"suggestions\":[");
+  {
+    std::shared_lock<std::shared_mutex> lock(trie_mu_);
+    CompletionTrie::Completion completions[CompletionTrie::kTopK];
+    size_t count = trie_.Complete(prefix, completions, n);
+    for (size_t i = 0; i < count; ++i) {
+      if (i > 0)
+        out.Raw(",");
+      out.Raw("{\"text\":")
+          .String(completions[i].text)
+          .Raw(",\"weight\":")
+          .Int(completions[i].weight)
+          .Raw("}");
+    }
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::high_resolution_clock::now() - start;
+  out.Raw("],\"latency_ms\":").Fixed(elapsed.count(), 3).Raw("}");
+  return json;
+}
+
+void Suggester::CatchUp() {
+  if (db_->WriteGeneration() == generation_.load(std::memory_order_acquire))
+    return;
+  std::unique_lock<std::mutex> lock(sync_mu_, std::try_to_lock);
+  // While another thread scans, the trie answers as it stands, unless
+  // nothing has been scanned yet.
+  if (!lock.owns_lock()) {
+    if (generation_.load(std::memory_order_acquire) != UINT64_MAX)
+      return;
+    lock.lock();
+  }
+  uint64_t generation = db_->WriteGeneration();
+  if (generation != generation_.load(std::memory_order_relaxed))
+    Sync(generation);
+}
+
+void Suggester::Sync(uint64_t generation) {
+  // Read after generation, so any rewrite that generation covers shows.
+  uint64_t rewrites = db_->RewriteGeneration();
+  bool rebuild = generation_.load(std::memory_order_relaxed) == UINT64_MAX ||
+                 rewrites != rewrite_generation_;
+  int64_t after = rebuild ? 0 : max_id_;
+  Counts counts;
+  db_->ScanItems(after, [&](database::Database::Item &&item) {
+    AddTitle(item.title, &counts);
+    after = std::max(after, item.id);
+  });
+
+  if (rebuild) {
+    std::vector<CompletionTrie::Entry> entries;
+    entries.reserve(counts.size());
+    for (auto &kv : counts)
+      entries.push_back(
+          CompletionTrie::Entry{std::move(kv.second.text), kv.second.weight});
+    CompletionTrie trie(std::move(entries));
+    std::unique_lock<std::shared_mutex> lock(trie_mu_);
+    trie_ = std::move(trie);
+  } else if (!counts.empty()) {
+    std::unique_lock<std::shared_mutex> lock(trie_mu_);
+    for (const auto &kv : counts)
+      trie_.Add(kv.second.text, kv.second.weight);
+  }
+  max_id_ = after;
+  rewrite_generation_ = rewrites;
+  generation_.store(generation, std::memory_order_release);
+}
+
+void Suggester::AddTitle(const std::string &title, Counts *counts) {
+  auto add = [counts](std::string key, std::string_view text) {
+    Count &count = (*counts)[std::move(key)];
+    if (count.weight == 0)
+      count.text = std::string(text);
+    ++count.weight;
+  };
+  add(Folded(title), title);
+  // Each word counts once per title; a one-word title is already counted.
+  std::vector<std::string> seen;
+  size_t pos = 0;
+  while (pos < title.size()) {
+    size_t begin = title.find_first_not_of(" \t", pos);
+    if (begin == std::string::npos)
+      break;
+    size_t end = std::min(title.find_first_of(" \t", begin), title.size());
+    pos = end;
+    std::string_view word(title.data() + begin, end - begin);
+    if (word.size() == title.size() || !HasLetter(word))
+      continue;
+    std::string key = Folded(word);
+    if (std::find(seen.begin(), seen.end(), key) != seen.end())
+      continue;
+    seen.push_back(key);
+    add(std::move(key), word);
+  }
+}
+
+} // namespace suggest
+} // namespace epiphany
@@ -0,0 +1,63 @@
+#pragma once
+#include "epiphany/database/database.h"
+#include "epiphany/suggest/completion_trie.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace epiphany {
+namespace suggest {
+
+// Typeahead over a catalog. A prefix completes to whole titles and to the
+// words they are made of (brands, categories, model names); a word weighs
+// as many titles as hold it, a title weighs 1. Words without a letter,
+// such as model numbers, are left out.
+//
+// After plain INSERTs only rows past the largest id seen are scanned and
+// their weights added to the trie in place; any other write rescans the
+// catalog into a fresh trie. Lookups answer from the trie as it stands and
+// only wait for a scan when nothing has been scanned yet.
+class Suggester {
+public:
+  explicit Suggester(std::shared_ptr<database::Database> db);
+
+  // {"prefix": ..., "suggestions": [{"text": ..., "weight": N}, ...],
+  //  "latency_ms": N} with at most limit (clamped to 1..kTopK)
+  // suggestions, heaviest first.
+  std::string SuggestJson(std::string_view prefix, int limit);
+
+private:
+  struct Count {
+    std::string text;
+    uint32_t weight{0};
+  };
+  // Weights by key, text folded as CompletionTrie folds it.
+  using Counts = std::unordered_map<std::string, Count>;
+
+  // Catches the trie up with the catalog if no other thread is.
+  void CatchUp();
+  // Scans what the trie has not seen yet into it; sync_mu_ held.
+  void Sync(uint64_t generation);
+  static void AddTitle(const std::string &title, Counts *counts);
+
+  std::shared_ptr<database::Database> db_;
+
+  std::mutex sync_mu_;
+  // Guarded by sync_mu_: where the scans feeding the trie stopped.
+  int64_t max_id_{0};
+  uint64_t rewrite_generation_{0};
+  std::atomic<uint64_t> generation_{UINT64_MAX};
+
+  // Completions point into the trie, so readers hold the lock until they
+  // are done with them.
+  std::shared_mutex trie_mu_;
+  CompletionTrie trie_;
+};
+
+} // namespace suggest
+} // namespace epiphany
@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+# Builds the microbenchmarks with make and writes one Google Benchmark JSON
+# report per binary to $OUT. Extra arguments go to every binary, e.g.
+#   scripts/bench.sh --benchmark_filter=BM_Search --benchmark_repetitions=5
+# EP_BENCH_MAX_ROWS caps the catalog sizes (default 10M for sqlite).
+set -e
+OUT=${OUT:-bench_results}
+BENCHES=${BENCHES:-"database_bench json_bench http_bench metrics_bench suggest_bench"}
+make bench
+mkdir -p "$OUT"
+for b in $BENCHES; do
+  ./epiphany/bench/$b --benchmark_out="$OUT/$b.json" \
+    --benchmark_out_format=json "$@"
+done
@@ -1,6 +1,15 @@
 #!/usr/bin/env bash
+# Drives a running server at a fixed arrival rate with epiphany_load and
+# prints latency percentiles per endpoint. Extra arguments (e.g. --json)
+# are passed through.
 set -e
-URL=${URL:-http://localhost:8080/api/search_v2?q=phone&limit=10&offset=0}
-CONCURRENCY=${CONCURRENCY:-5}
-REQUESTS=${REQUESTS:-50}
-seq 1 $REQUESTS | xargs -n1 -P $CONCURRENCY -I{} curl -s "$URL" >/dev/null
+TARGET=${TARGET:-127.0.0.1:8080}
+MIX=${MIX:-$(dirname "$0")/load_mix.txt}
+RATE=${RATE:-200}
+DURATION=${DURATION:-30}
+WARMUP=${WARMUP:-5}
+CONNECTIONS=${CONNECTIONS:-32}
+THREADS=${THREADS:-2}
+[ -x ./epiphany_load ] || make epiphany_load
+./epiphany_load --rate="$RATE" --duration="$DURATION" --warmup="$WARMUP" \
+  --connections="$CONNECTIONS" --threads="$THREADS" "$@" "$TARGET" "$MIX"